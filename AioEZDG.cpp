@@ -3,9 +3,12 @@
 #include <cstdlib>
 #include <ctime>
 #include <deque>
+#include <functional>
 #include <sstream>
 #include <cctype>
 #include <map>
+#include <unordered_map>
+#include <unordered_set>
 #include <math.h>
 #include <numeric>
 #include <string>
@@ -18,11 +21,22 @@
 #include "limits.h"
 #include <stdexcept>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <memory>
+#include <new>
 #include <iostream>
 #include <iomanip>
 #include <cstring>
+#include <cerrno>
+#include <atomic>
+#include <thread>
+#include <mutex>
 #include "json.hpp"
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
 using json = nlohmann::ordered_json;
 
 using namespace MERC;
@@ -38,6 +52,7 @@ using namespace MERC;
 #define TT_Period (TT_User+6)
 #define TT_ForceTaskTimeOut (TT_User+7)
 #define TT_NtEnd (TT_User+8)
+#define TT_ResumeExec (TT_User+9)
 
 #define SMALL_QUEUE 2048
 #define BIG_QUEUE 4096
@@ -52,7 +67,16 @@ using namespace MERC;
 
 #define TS_GAP 100
 
+#define LAT_SUB_BITS 4
+#define LAT_BUCKETS 640
+
+#define MAX_OPEN_POSITION 256
+#define ORDER_SLOTS 4096
+#define ORDER_UNTRACKED (-9)
+#define ORDER_RESTORED (-4)
+
 #define TSC 0
+#define ALLOC_COUNT 0
 #define TRD_DETAILS 0
 #define ODR_REASON 0
 
@@ -98,6 +122,893 @@ public:
     }
 };
 
+inline long long nowNanos()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Resident set size of this process in KB, 0 if /proc is unavailable
+inline long rssKB()
+{
+    long pages = 0, rss = 0;
+    FILE *fp = fopen("/proc/self/statm", "r");
+    if (fp == NULL) return 0;
+    if (fscanf(fp, "%ld %ld", &pages, &rss) != 2) rss = 0;
+    fclose(fp);
+    return rss * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+// Construct fill into the reserved but unused tail of v and erase it again, so the first push_back
+// into it on the trading path does not take the page fault. Returns the bytes covered.
+template<class T> size_t prefaultTail(std::vector<T> &v, const T &fill = T())
+{
+    const size_t size = v.size(), capacity = v.capacity();
+    v.resize(capacity, fill);    // within capacity, no reallocation
+    v.erase(v.begin() + size, v.end());
+    return (capacity - size) * sizeof(T);
+}
+
+inline unsigned long long readTsc()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return (unsigned long long)nowNanos();
+#endif
+}
+
+class CTscClock
+{
+public:
+    static double &nsPerCycle(void) { static double s_nsPerCycle = 1.0; return s_nsPerCycle; }
+    static void calibrate(int sampleMs=20)
+    {
+        long long ns0 = nowNanos();
+        unsigned long long c0 = readTsc();
+        while (nowNanos() - ns0 < sampleMs*1000000LL) {}
+        long long ns1 = nowNanos();
+        unsigned long long c1 = readTsc();
+        if (c1 > c0) nsPerCycle() = double(ns1 - ns0) / double(c1 - c0);
+    }
+    static long long toNanos(unsigned long long cycles) { return (long long)(cycles * nsPerCycle()); }
+    static long long since(unsigned long long tsc) { return toNanos(readTsc() - tsc); }
+};
+
+#if ALLOC_COUNT
+// Heap allocations made by the calling thread; replaces the global allocator so keep it opt-in
+inline unsigned long long &allocCount(void) { static thread_local unsigned long long s_count = 0; return s_count; }
+void *operator new(std::size_t size)
+{
+    allocCount()++;
+    void *p = malloc(size ? size : 1);
+    if (p == NULL) throw std::bad_alloc();
+    return p;
+}
+void *operator new[](std::size_t size) { return operator new(size); }
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept { allocCount()++; return malloc(size ? size : 1); }
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept { allocCount()++; return malloc(size ? size : 1); }
+void operator delete(void *p) noexcept { free(p); }
+void operator delete[](void *p) noexcept { free(p); }
+void operator delete(void *p, std::size_t) noexcept { free(p); }
+void operator delete[](void *p, std::size_t) noexcept { free(p); }
+#endif
+
+// Per-callback allocation tally, filled only when ALLOC_COUNT is on
+class CAllocStats
+{
+public:
+    unsigned long long m_calls;
+    unsigned long long m_allocCalls;
+    unsigned long long m_allocs;
+    unsigned long long m_max;
+    CAllocStats() { clear(); }
+    void clear(void) { m_calls=m_allocCalls=m_allocs=m_max=0; }
+    void add(unsigned long long n)
+    {
+        m_calls++;
+        if (n == 0) return;
+        m_allocCalls++;
+        m_allocs += n;
+        if (n > m_max) m_max = n;
+    }
+};
+
+// Log-linear latency histogram: 2^LAT_SUB_BITS buckets per power of two, values in ns
+class CLatencyHist
+{
+protected:
+    unsigned m_counts[LAT_BUCKETS];
+    unsigned long long m_count;
+    long long m_sum;
+    long long m_max;
+public:
+    CLatencyHist() { clear(); }
+    void clear(void) { memset(this,0,sizeof(*this)); }
+    static int bucketOf(long long v)
+    {
+        const int sub = 1 << LAT_SUB_BITS;
+        if (v < sub) return v < 0 ? 0 : int(v);
+        int msb = 63 - __builtin_clzll((unsigned long long)v);
+        int e = msb - LAT_SUB_BITS;
+        int idx = (e+1)*sub + int((v >> e) - sub);
+        return idx < LAT_BUCKETS ? idx : LAT_BUCKETS-1;
+    }
+    static long long bucketValue(int idx)
+    {
+        const int sub = 1 << LAT_SUB_BITS;
+        if (idx < sub) return idx;
+        int e = idx/sub - 1;
+        long long mant = sub + idx%sub;
+        return (mant << e) + ((1LL << e) >> 1);
+    }
+    void add(long long v)
+    {
+        m_counts[bucketOf(v)]++;
+        m_count++;
+        m_sum += v;
+        if (v > m_max) m_max = v;
+    }
+    unsigned long long count(void) const { return m_count; }
+    long long sum(void) const { return m_sum; }
+    long long max(void) const { return m_max; }
+    double mean(void) const { return m_count > 0 ? double(m_sum) / m_count : 0.0; }
+    long long percentile(double pct) const
+    {
+        if (m_count == 0) return 0;
+        unsigned long long target = (unsigned long long)std::ceil(pct * m_count);
+        if (target == 0) target = 1;
+        unsigned long long acc = 0;
+        for (int i=0;i<LAT_BUCKETS;i++)
+        {
+            acc += m_counts[i];
+            if (acc >= target) return std::min(bucketValue(i), m_max);
+        }
+        return m_max;
+    }
+};
+
+// Binary event capture: fixed 64-byte records pushed into a preallocated SPSC ring
+// by the strategy thread and appended to disk by a background writer thread
+class CFlightRecorder
+{
+public:
+    enum { EV_MarketData=1, EV_Order=2, EV_Trade=3, EV_Timer=4, EV_Command=5, EV_Send=6, EV_Cancel=7, EV_Ready=8 };
+    enum { FL_FirstTime=1, FL_Finished=2, FL_Rejected=4 };
+    struct CEvent
+    {
+        unsigned char m_type;
+        unsigned char m_flag;
+        unsigned short m_reserved;
+        int m_curTS;            // host getCurTimeStamp() when the event was seen
+        long long m_ns;         // nowNanos()
+        int m_i[6];
+        double m_d[3];
+    };
+    struct CHeader
+    {
+        char m_magic[4];        // "EZFR"
+        int m_version;
+        int m_eventSize;
+        int m_tradingDay;
+        long long m_startNs;
+        char m_strategyName[40];
+    };
+private:
+    CEvent *m_ring;
+    unsigned long long m_mask;
+    std::atomic<unsigned long long> m_head;
+    std::atomic<unsigned long long> m_tail;
+    std::atomic<bool> m_running;
+    std::thread m_writer;
+    FILE *m_fp;
+    unsigned long long m_dropped;
+    void writerLoop(void)
+    {
+        while (m_running.load(std::memory_order_acquire))
+        {
+            if (drain() == 0) usleep(1000);
+        }
+        drain();
+    }
+    unsigned long long drain(void)
+    {
+        unsigned long long tail = m_tail.load(std::memory_order_relaxed);
+        unsigned long long head = m_head.load(std::memory_order_acquire);
+        unsigned long long n = head - tail;
+        while (tail != head)
+        {
+            unsigned long long idx = tail & m_mask;
+            unsigned long long chunk = std::min(head - tail, m_mask + 1 - idx);
+            fwrite(m_ring + idx, sizeof(CEvent), chunk, m_fp);
+            tail += chunk;
+        }
+        if (n > 0)
+        {
+            fflush(m_fp);
+            m_tail.store(tail, std::memory_order_release);
+        }
+        return n;
+    }
+public:
+    CFlightRecorder() : m_ring(NULL), m_mask(0), m_head(0), m_tail(0), m_running(false), m_fp(NULL), m_dropped(0) {}
+    ~CFlightRecorder() { close(); }
+    bool isOpen(void) const { return m_fp != NULL; }
+    unsigned long long recorded(void) const { return m_head.load(std::memory_order_relaxed); }
+    unsigned long long dropped(void) const { return m_dropped; }
+    bool open(const char *fileName, int ringSize, int tradingDay, const char *strategyName)
+    {
+        if (m_fp != NULL) return true;
+        m_fp = fopen(fileName, "ab");
+        if (m_fp == NULL) return false;
+        unsigned long long size = 1024;
+        while (size < (unsigned long long)ringSize) size <<= 1;
+        m_ring = new CEvent[size];
+        memset(m_ring, 0, size * sizeof(CEvent));
+        m_mask = size - 1;
+        CHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.m_magic, "EZFR", 4);
+        header.m_version = 2;
+        header.m_eventSize = sizeof(CEvent);
+        header.m_tradingDay = tradingDay;
+        header.m_startNs = nowNanos();
+        strncpy(header.m_strategyName, strategyName, sizeof(header.m_strategyName)-1);
+        fwrite(&header, sizeof(header), 1, m_fp);
+        fflush(m_fp);
+        m_running.store(true, std::memory_order_release);
+        m_writer = std::thread(&CFlightRecorder::writerLoop, this);
+        return true;
+    }
+    void close(void)
+    {
+        if (m_fp == NULL) return;
+        m_running.store(false, std::memory_order_release);
+        if (m_writer.joinable()) m_writer.join();
+        fclose(m_fp);
+        m_fp = NULL;
+        delete [] m_ring;
+        m_ring = NULL;
+    }
+    // Producer side: claim a zeroed slot, fill it, then commit; NULL when closed or the ring is full
+    CEvent *claim(int type, int curTS)
+    {
+        if (m_fp == NULL) return NULL;
+        unsigned long long head = m_head.load(std::memory_order_relaxed);
+        if (head - m_tail.load(std::memory_order_acquire) > m_mask) { m_dropped++; return NULL; }
+        CEvent *pEvent = m_ring + (head & m_mask);
+        memset(pEvent, 0, sizeof(CEvent));
+        pEvent->m_type = (unsigned char)type;
+        pEvent->m_curTS = curTS;
+        pEvent->m_ns = nowNanos();
+        return pEvent;
+    }
+    void commit(void) { m_head.store(m_head.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+};
+
+// Reads one recorded session back for replay. The strategy feeds the recorded inputs itself;
+// recorded sends and cancels are the reference its replayed decisions are matched against
+class CFlightReplay
+{
+public:
+    typedef CFlightRecorder::CEvent CEvent;
+private:
+    std::vector<CEvent> m_events;
+    std::vector<int> m_cause;           // index of the input event each recorded event followed
+    CFlightRecorder::CHeader m_header;
+    int m_ready;
+    int m_cur;
+    int m_pos[2];                       // scan positions for sends and cancels
+    static bool isOutput(int type) { return type == CFlightRecorder::EV_Send || type == CFlightRecorder::EV_Cancel; }
+    int &pos(int type) { return m_pos[type == CFlightRecorder::EV_Send ? 0 : 1]; }
+public:
+    unsigned long long m_matched;
+    unsigned long long m_mismatched;
+    unsigned long long m_extra;
+    CFlightReplay() : m_ready(-1), m_cur(-1), m_matched(0), m_mismatched(0), m_extra(0)
+    {
+        memset(&m_header, 0, sizeof(m_header));
+        m_pos[0] = m_pos[1] = 0;
+    }
+    // session counts from 0 in file order, -1 takes the last one
+    bool load(const char *fileName, int session)
+    {
+        FILE *fp = fopen(fileName, "rb");
+        if (fp == NULL) return false;
+        std::vector<CEvent> events;
+        CFlightRecorder::CHeader header;
+        int found = -1;
+        while (fread(&header, sizeof(header), 1, fp) == 1)
+        {
+            if (memcmp(header.m_magic, "EZFR", 4) != 0)
+            {
+                events.push_back(CEvent());
+                memcpy(&events.back(), &header, sizeof(CEvent));
+                continue;
+            }
+            if (session >= 0 && found == session) break;
+            if (header.m_version != 2 || header.m_eventSize != int(sizeof(CEvent))) { fclose(fp); return false; }
+            found++;
+            m_header = header;
+            events.clear();
+        }
+        fclose(fp);
+        if (found < 0 || (session >= 0 && found != session)) return false;
+        m_events.swap(events);
+        m_cause.resize(m_events.size());
+        int cause = -1;
+        for (int i=0; i<int(m_events.size()); i++)
+        {
+            if (m_ready < 0 && m_events[i].m_type == CFlightRecorder::EV_Ready) m_ready = i;
+            if (!isOutput(m_events[i].m_type)) cause = i;
+            m_cause[i] = cause;
+        }
+        m_pos[0] = m_pos[1] = m_ready + 1;
+        return m_ready >= 0;
+    }
+    const CFlightRecorder::CHeader &header(void) const { return m_header; }
+    int size(void) const { return int(m_events.size()); }
+    int readyIndex(void) const { return m_ready; }
+    const CEvent &at(int i) const { return m_events[i]; }
+    // marks event i as the one being fed; returns false for recorded outputs, which are not inputs
+    bool feed(int i) { if (isOutput(m_events[i].m_type)) return false; m_cur = i; return true; }
+    // next recorded send or cancel, NULL when the recording has no more
+    const CEvent *expect(int type)
+    {
+        int &p = pos(type);
+        while (p < size() && m_events[p].m_type != type) p++;
+        return p < size() ? &m_events[p++] : NULL;
+    }
+    // true when the recorded output was emitted while handling the input being fed now
+    bool sameStep(const CEvent *pEvent) const { return m_cause[pEvent - &m_events[0]] == m_cur; }
+    int remaining(int type)
+    {
+        int n = 0;
+        for (int p=pos(type); p<size(); p++) { if (m_events[p].m_type == type) n++; }
+        return n;
+    }
+};
+
+// In-process exchange stand-in for soak tests: limit/FAK matching against the last quote with
+// partial fills, random rejects and cancels, ack and fill latency on the host clock (ms)
+class CSimExchange
+{
+public:
+    struct CReport
+    {
+        int m_orderID;
+        int m_instRef;
+        int m_direction;
+        int m_volume;           // fill volume, 0 for an order status report
+        double m_price;
+        int m_tradeVolume;      // order traded volume after this report
+        bool m_firstTime;
+        bool m_finished;
+        bool m_rejected;
+    };
+private:
+    enum { EV_Ack=0, EV_Fill=1, EV_Cancel=2, EV_Reject=3 };
+    struct COrder
+    {
+        int m_orderID;
+        int m_instRef;
+        int m_type;
+        int m_direction;
+        double m_price;
+        int m_volume;
+        int m_traded;
+        int m_pending;          // matched volume whose fills are not delivered yet
+        bool m_live;
+        bool m_finished;
+        bool m_cancelling;
+    };
+    struct CEvent
+    {
+        int m_due;
+        unsigned m_seq;
+        int m_kind;
+        int m_orderID;
+        int m_volume;
+        double m_price;
+        // std heap is a max-heap, earliest (due, seq) on top
+        bool operator<(const CEvent &o) const { return m_due != o.m_due ? m_due > o.m_due : m_seq > o.m_seq; }
+    };
+    struct CBook
+    {
+        double m_bp;
+        double m_ap;
+        int m_bq;               // liquidity left at the top of book until the next quote
+        int m_aq;
+    };
+    COrder m_pool[ORDER_SLOTS];
+    std::vector<CEvent> m_events;
+    std::vector<CReport> m_reports;
+    int m_readPos;
+    std::vector<int> m_resting;
+    std::map<int, CBook> m_books;
+    int m_nextID;
+    unsigned m_seq;
+    unsigned m_rand;
+    int m_ackMs;
+    int m_fillMs;
+    int m_fillSplit;
+    int m_rejectPct;
+
+    unsigned nextRand() { m_rand = m_rand * 1103515245u + 12345u; return (m_rand >> 16) & 0x7fff; }
+    COrder *find(int orderID)
+    {
+        COrder &o = m_pool[orderID & (ORDER_SLOTS-1)];
+        return o.m_orderID == orderID ? &o : NULL;
+    }
+    void push(int due, int kind, int orderID, int volume=0, double price=0.0)
+    {
+        CEvent e = {due, m_seq++, kind, orderID, volume, price};
+        m_events.push_back(e);
+        std::push_heap(m_events.begin(), m_events.end());
+    }
+    void report(const COrder &o, int volume, double price, bool firstTime, bool rejected)
+    {
+        CReport r = {o.m_orderID, o.m_instRef, o.m_direction, volume, price, o.m_traded, firstTime, o.m_finished, rejected};
+        m_reports.push_back(r);
+    }
+    void unrest(int orderID)
+    {
+        std::vector<int>::iterator it = std::find(m_resting.begin(), m_resting.end(), orderID);
+        if (it != m_resting.end()) { *it = m_resting.back(); m_resting.pop_back(); }
+    }
+    void finish(COrder &o, bool rejected, bool firstTime)
+    {
+        o.m_finished = true;
+        unrest(o.m_orderID);
+        if (rejected) m_rejects++;
+        else if (o.m_traded < o.m_volume) m_cancels++;
+        report(o, 0, 0.0, firstTime, rejected);
+    }
+    void match(COrder &o, int now)
+    {
+        int open = o.m_volume - o.m_traded - o.m_pending;
+        if (open <= 0 || o.m_cancelling) return;
+        CBook &book = m_books[o.m_instRef];
+        bool buy = o.m_direction == D_Buy;
+        double px = buy ? book.m_ap : book.m_bp;
+        int &liquidity = buy ? book.m_aq : book.m_bq;
+        if (liquidity <= 0 || px <= 0.0 || (buy ? o.m_price < px - 1e-9 : o.m_price > px + 1e-9)) return;
+        int volume = std::min(open, liquidity);
+        liquidity -= volume;
+        o.m_pending += volume;
+        int parts = std::max(1, std::min(m_fillSplit, volume));
+        for (int k=0; k<parts; k++)
+        {
+            push(now + m_fillMs, EV_Fill, o.m_orderID, volume / parts + (k < volume % parts ? 1 : 0), px);
+        }
+    }
+    void process(const CEvent &e)
+    {
+        COrder *pOrder = find(e.m_orderID);
+        if (pOrder == NULL || pOrder->m_finished) return;
+        COrder &o = *pOrder;
+        switch (e.m_kind)
+        {
+        case EV_Reject:
+            finish(o, true, true);
+            break;
+        case EV_Ack:
+            o.m_live = true;
+            report(o, 0, 0.0, true, false);
+            match(o, e.m_due);
+            if (o.m_type == ODT_FAK) o.m_cancelling = true;
+            else if (o.m_traded + o.m_pending < o.m_volume) m_resting.push_back(o.m_orderID);
+            if (o.m_cancelling && o.m_pending == 0) finish(o, false, false);
+            m_maxResting = std::max(m_maxResting, int(m_resting.size()));
+            break;
+        case EV_Fill:
+            o.m_pending -= e.m_volume;
+            o.m_traded += e.m_volume;
+            m_fills++;
+            m_fillVolume += e.m_volume;
+            if (o.m_traded >= o.m_volume) o.m_finished = true;
+            report(o, e.m_volume, e.m_price, false, false);
+            if (o.m_finished) finish(o, false, false);
+            else if (o.m_cancelling && o.m_pending == 0) finish(o, false, false);
+            break;
+        case EV_Cancel:
+            if (!o.m_live) { push(e.m_due + m_ackMs, EV_Cancel, o.m_orderID); break; }
+            o.m_cancelling = true;
+            if (o.m_pending == 0) finish(o, false, false);
+            break;
+        default:
+            break;
+        }
+    }
+public:
+    unsigned long long m_orders;
+    unsigned long long m_fills;
+    unsigned long long m_fillVolume;
+    unsigned long long m_cancels;
+    unsigned long long m_rejects;
+    int m_maxResting;
+    CSimExchange(int ackMs, int fillMs, int fillSplit, int rejectPct, unsigned seed)
+        : m_readPos(0), m_nextID(1), m_seq(0), m_rand(seed), m_ackMs(std::max(0, ackMs)), m_fillMs(std::max(0, fillMs)),
+          m_fillSplit(std::max(1, fillSplit)), m_rejectPct(rejectPct), m_orders(0), m_fills(0), m_fillVolume(0), m_cancels(0), m_rejects(0), m_maxResting(0)
+    {
+        memset(m_pool, 0, sizeof(m_pool));
+        m_events.reserve(4*ORDER_SLOTS);
+        m_reports.reserve(64);
+        m_resting.reserve(ORDER_SLOTS);
+    }
+    int resting(void) const { return int(m_resting.size()); }
+    size_t prefault(void) { return prefaultTail(m_events) + prefaultTail(m_reports) + prefaultTail(m_resting); }
+    // orderID of the accepted order, -1 when its pool slot is still taken by a live order
+    int submit(int instRef, int type, int direction, double price, int volume, int now)
+    {
+        int orderID = m_nextID++;
+        COrder &o = m_pool[orderID & (ORDER_SLOTS-1)];
+        if (o.m_orderID != 0 && !o.m_finished) return -1;
+        memset(&o, 0, sizeof(o));
+        o.m_orderID = orderID;
+        o.m_instRef = instRef;
+        o.m_type = type;
+        o.m_direction = direction;
+        o.m_price = price;
+        o.m_volume = volume;
+        m_orders++;
+        bool reject = volume <= 0 || (m_rejectPct > 0 && int(nextRand() % 100) < m_rejectPct);
+        push(now + m_ackMs, reject ? EV_Reject : EV_Ack, orderID);
+        return orderID;
+    }
+    void cancel(int orderID, int now)
+    {
+        push(now + m_ackMs, EV_Cancel, orderID);
+    }
+    void autoCancel(int orderID, bool isFirstTime, int waitTime, int now)
+    {
+        if (isFirstTime && waitTime >= 0) push(now + waitTime, EV_Cancel, orderID);
+    }
+    // new top of book; refreshes the liquidity resting orders can take and matches them
+    void onQuote(int instRef, double bp, int bq, double ap, int aq, int now)
+    {
+        CBook &book = m_books[instRef];
+        book.m_bp = bp; book.m_bq = bq;
+        book.m_ap = ap; book.m_aq = aq;
+        for (int i=0; i<int(m_resting.size()); i++)
+        {
+            COrder *pOrder = find(m_resting[i]);
+            if (pOrder != NULL && pOrder->m_instRef == instRef) match(*pOrder, now);
+        }
+    }
+    // next report due at or before now, false when nothing is due
+    bool poll(int now, CReport &r)
+    {
+        while (m_readPos >= int(m_reports.size()))
+        {
+            m_reports.clear();
+            m_readPos = 0;
+            if (m_events.empty() || m_events.front().m_due > now) return false;
+            std::pop_heap(m_events.begin(), m_events.end());
+            CEvent e = m_events.back();
+            m_events.pop_back();
+            process(e);
+        }
+        r = m_reports[m_readPos++];
+        return true;
+    }
+};
+
+// Append-only write-ahead journal of state transitions between state file checkpoints. Records hold
+// the absolute values after the transition, so replaying a record that the checkpoint already covers
+// is harmless; the checkpoint stores the last sequence it covers and replay starts after it
+class CJournal
+{
+public:
+    enum
+    {
+        RT_Exec = 1,        // notifyExecFinished
+        RT_DynFactor,       // dynamic factor change
+        RT_Risk,            // risk mode entry or exit
+        RT_InstPos          // leg position after a trade
+    };
+    struct CRecord
+    {
+        unsigned long long m_seq;
+        int m_type;
+        int m_timeStamp;
+        char m_key[96];                 // spread name, or <InstrumentID>.<ExchangeID> for RT_InstPos
+        char m_tag[16];
+        int m_i[8];
+        double m_d[8];
+        unsigned m_check;
+    };
+    struct CHeader
+    {
+        char m_magic[4];                // "EZWL"
+        int m_version;
+        int m_recordSize;
+        int m_reserved;
+    };
+private:
+    int m_fd;
+    unsigned long long m_seq;
+    unsigned long long m_records;
+    unsigned long long m_failures;
+    static unsigned checksum(const CRecord &r)
+    {
+        const unsigned char *p = (const unsigned char *)&r;
+        unsigned h = 2166136261u;
+        for (size_t i=0; i<offsetof(CRecord, m_check); i++) h = (h ^ p[i]) * 16777619u;
+        return h;
+    }
+    static bool validHeader(const CHeader &h)
+    {
+        return memcmp(h.m_magic, "EZWL", 4) == 0 && h.m_version == 1 && h.m_recordSize == int(sizeof(CRecord));
+    }
+public:
+    CJournal() : m_fd(-1), m_seq(0), m_records(0), m_failures(0) {}
+    ~CJournal() { close(); }
+    bool isOpen(void) const { return m_fd >= 0; }
+    unsigned long long seq(void) const { return m_seq; }
+    unsigned long long records(void) const { return m_records; }
+    unsigned long long failures(void) const { return m_failures; }
+
+    // Calls apply(record) for every intact record after fromSeq, in order; stops at a torn tail.
+    // Returns the last intact sequence number, fromSeq when there is none
+    template<class F> static unsigned long long replay(const char *fileName, unsigned long long fromSeq, F apply, int &applied)
+    {
+        applied = 0;
+        unsigned long long lastSeq = fromSeq;
+        FILE *fp = fopen(fileName, "rb");
+        if (fp == NULL) return lastSeq;
+        CHeader header;
+        if (fread(&header, sizeof(header), 1, fp) == 1 && validHeader(header))
+        {
+            CRecord r;
+            while (fread(&r, sizeof(r), 1, fp) == 1 && r.m_check == checksum(r))
+            {
+                if (r.m_seq <= lastSeq) continue;
+                apply(r);
+                applied++;
+                lastSeq = r.m_seq;
+            }
+        }
+        fclose(fp);
+        return lastSeq;
+    }
+    // Opens for append after the last intact record; a torn tail is cut off. seq: the last sequence
+    // already applied (checkpoint plus replayed tail), new records continue after it
+    bool open(const char *fileName, unsigned long long seq)
+    {
+        if (m_fd >= 0) return true;
+        m_fd = ::open(fileName, O_RDWR | O_CREAT, 0644);
+        if (m_fd < 0) return false;
+        CHeader header;
+        off_t end = sizeof(CHeader);
+        if (pread(m_fd, &header, sizeof(header), 0) == ssize_t(sizeof(header)) && validHeader(header))
+        {
+            CRecord r;
+            while (pread(m_fd, &r, sizeof(r), end) == ssize_t(sizeof(r)) && r.m_check == checksum(r))
+            {
+                seq = std::max(seq, r.m_seq);
+                end += sizeof(CRecord);
+            }
+        }
+        else
+        {
+            memset(&header, 0, sizeof(header));
+            memcpy(header.m_magic, "EZWL", 4);
+            header.m_version = 1;
+            header.m_recordSize = sizeof(CRecord);
+            if (pwrite(m_fd, &header, sizeof(header), 0) != ssize_t(sizeof(header))) { close(); return false; }
+        }
+        if (ftruncate(m_fd, end) != 0 || lseek(m_fd, end, SEEK_SET) != end) { close(); return false; }
+        m_seq = seq;
+        return true;
+    }
+    // Trading thread: the record is in the page cache when this returns, so it survives a process crash
+    void append(CRecord &r)
+    {
+        if (m_fd < 0) return;
+        r.m_seq = ++m_seq;
+        r.m_check = checksum(r);
+        if (write(m_fd, &r, sizeof(r)) == ssize_t(sizeof(r))) m_records++;
+        else m_failures++;
+    }
+    static void init(CRecord &r, int type, int timeStamp, const char *key)
+    {
+        memset(&r, 0, sizeof(r));
+        r.m_type = type;
+        r.m_timeStamp = timeStamp;
+        strncpy(r.m_key, key, sizeof(r.m_key)-1);
+    }
+    // Follows a journal another process appends to: each poll() applies the intact records added since
+    // the last one. A checkpoint truncation restarts the file while sequence numbers keep growing, so when
+    // the last record read is gone the tail rereads from the header and skips what it already applied
+    class CTail
+    {
+    private:
+        int m_fd;
+        off_t m_offset;
+        unsigned long long m_seq;
+    public:
+        CTail() : m_fd(-1), m_offset(sizeof(CHeader)), m_seq(0) {}
+        ~CTail() { close(); }
+        bool isOpen(void) const { return m_fd >= 0; }
+        unsigned long long seq(void) const { return m_seq; }
+        // seq: the last record already applied; the file may not exist yet
+        bool open(const char *fileName, unsigned long long seq)
+        {
+            if (m_fd >= 0) return true;
+            m_fd = ::open(fileName, O_RDONLY);
+            m_offset = sizeof(CHeader);
+            m_seq = std::max(m_seq, seq);
+            return m_fd >= 0;
+        }
+        template<class F> int poll(F apply)
+        {
+            if (m_fd < 0) return 0;
+            CRecord r;
+            if (m_offset > off_t(sizeof(CHeader))
+                && (pread(m_fd, &r, sizeof(r), m_offset - sizeof(r)) != ssize_t(sizeof(r)) || r.m_seq != m_seq))
+                m_offset = sizeof(CHeader);
+            int applied = 0;
+            // a record still being written fails its checksum and is picked up by the next poll
+            while (pread(m_fd, &r, sizeof(r), m_offset) == ssize_t(sizeof(r)) && r.m_check == checksum(r))
+            {
+                m_offset += sizeof(r);
+                if (r.m_seq <= m_seq) continue;
+                apply(r);
+                applied++;
+                m_seq = r.m_seq;
+            }
+            return applied;
+        }
+        void close(void)
+        {
+            if (m_fd < 0) return;
+            ::close(m_fd);
+            m_fd = -1;
+        }
+    };
+    // Drops every record once a checkpoint covering m_seq is durable
+    bool truncate(void)
+    {
+        if (m_fd < 0) return false;
+        if (fdatasync(m_fd) != 0 || ftruncate(m_fd, sizeof(CHeader)) != 0) return false;
+        return lseek(m_fd, sizeof(CHeader), SEEK_SET) == off_t(sizeof(CHeader));
+    }
+    void close(void)
+    {
+        if (m_fd < 0) return;
+        ::close(m_fd);
+        m_fd = -1;
+    }
+};
+
+// Write lock on a file next to the state file, held by the instance that trades the state. The kernel
+// releases a record lock only when its owner closes the file or exits, so a stalled owner keeps it and
+// whoever acquires it next cannot be trading next to a live one
+class CStateLock
+{
+private:
+    int m_fd;
+    bool m_held;
+    std::string m_fileName;
+    bool openFile(const char *fileName)
+    {
+        if (m_fd >= 0) return true;
+        m_fd = ::open(fileName, O_RDWR | O_CREAT, 0644);
+        m_fileName = fileName;
+        return m_fd >= 0;
+    }
+    static struct flock wholeFile(void)
+    {
+        struct flock fl;
+        memset(&fl, 0, sizeof(fl));
+        fl.l_type = F_WRLCK;
+        fl.l_whence = SEEK_SET;
+        return fl;
+    }
+public:
+    CStateLock() : m_fd(-1), m_held(false) {}
+    ~CStateLock() { close(); }
+    bool isHeld(void) const { return m_held; }
+    // pid of the process holding it, 0 when nobody does, -1 when the file cannot be opened
+    int holder(const char *fileName)
+    {
+        if (!openFile(fileName)) return -1;
+        struct flock fl = wholeFile();
+        if (fcntl(m_fd, F_GETLK, &fl) != 0) return -1;
+        return fl.l_type == F_UNLCK ? 0 : int(fl.l_pid);
+    }
+    // does not wait: false while another process holds it
+    bool tryLock(const char *fileName)
+    {
+        if (m_held) return true;
+        if (!openFile(fileName)) return false;
+        struct flock fl = wholeFile();
+        m_held = fcntl(m_fd, F_SETLK, &fl) == 0;
+        return m_held;
+    }
+    // false once the file was removed or replaced: another instance could then lock the new one
+    bool isValid(void) const
+    {
+        struct stat locked, current;
+        if (!m_held || fstat(m_fd, &locked) != 0 || stat(m_fileName.c_str(), &current) != 0) return false;
+        return locked.st_dev == current.st_dev && locked.st_ino == current.st_ino;
+    }
+    void close(void)
+    {
+        if (m_fd < 0) return;
+        ::close(m_fd);
+        m_fd = -1;
+        m_held = false;
+    }
+};
+
+// Streams a state file of the form {section: {ticker: value}} in one pass, without building the document.
+// The visitor maps each section name once (section() < 0 skips it), then receives every scalar of the
+// section; a top-level scalar arrives with an empty ticker, a daily_high_lows array as begin() and day()s
+template<class V> class CStateSax : public nlohmann::json_sax<json>
+{
+private:
+    V &m_visitor;
+    int m_depth;
+    int m_section;
+    std::string m_ticker;
+    std::string m_field;
+    int m_day;
+    double m_high;
+    double m_low;
+    bool scalar(const json &value)
+    {
+        if (m_section < 0) return true;
+        if (m_depth == 1) m_visitor.value(m_section, std::string(), value);
+        else if (m_depth == 2) m_visitor.value(m_section, m_ticker, value);
+        else if (m_depth == 4)
+        {
+            if (m_field == "day") m_day = value.get<int>();
+            else if (m_field == "high") m_high = value.get<double>();
+            else if (m_field == "low") m_low = value.get<double>();
+        }
+        return true;
+    }
+public:
+    CStateSax(V &visitor) : m_visitor(visitor), m_depth(0), m_section(-1), m_day(0), m_high(0.0), m_low(0.0) {}
+    bool null() { return true; }
+    bool boolean(bool val) { return scalar(json(val)); }
+    bool number_integer(number_integer_t val) { return scalar(json(val)); }
+    bool number_unsigned(number_unsigned_t val) { return scalar(json(val)); }
+    bool number_float(number_float_t val, const string_t &) { return scalar(json(val)); }
+    bool string(string_t &val) { return scalar(json(val)); }
+    bool binary(binary_t &) { return true; }
+    bool start_object(std::size_t)
+    {
+        m_depth++;
+        if (m_depth == 4) { m_day = 0; m_high = -DBL_MAX; m_low = DBL_MAX; m_field.clear(); }
+        return true;
+    }
+    bool end_object()
+    {
+        if (m_depth == 4 && m_section >= 0 && m_day != 0) m_visitor.day(m_section, m_ticker, m_day, m_high, m_low);
+        m_depth--;
+        return true;
+    }
+    bool start_array(std::size_t)
+    {
+        m_depth++;
+        if (m_depth == 3 && m_section >= 0) m_visitor.begin(m_section, m_ticker);
+        return true;
+    }
+    bool end_array() { m_depth--; return true; }
+    bool key(string_t &val)
+    {
+        if (m_depth == 1) m_section = m_visitor.section(val);
+        else if (m_depth == 2) m_ticker = val;
+        else if (m_depth == 4) m_field = val;
+        return true;
+    }
+    bool parse_error(std::size_t, const std::string &, const nlohmann::detail::exception &ex) { throw std::runtime_error(ex.what()); }
+};
+
 double ema(double ema, double newVal, int period, int flag=0, int flag1=1, int flag2=2)
 {
     double alpha = 2.0/(period+1);
@@ -189,7 +1100,9 @@ private:
         return std::ceil(price / tick) * tick;
     }
 
-    // FuzzySort Logic kept as is
+    // FuzzySort: within a snapshot burst, counts how often each instrument quotes before each other one.
+    // Counts decay with a half-life in strategy time, by weighting new counts up instead of scaling old
+    // ones down; the ranking by (lead-lag)/(lead+lag) is kept sorted as counts arrive
     class CFuzzySort
     {
     public:
@@ -199,19 +1112,35 @@ private:
         int m_queueCount;
         int m_lastSysTS;
         int m_lastMdTS;
-        int m_sortMatrix[SMALL_QUEUE][SMALL_QUEUE]={{0}};
+        // lead/lag counts, row-major n x n over the subscribed instruments: cell(i,j) counts i quoted before j
+        std::vector<double> m_sortMatrix;
+        std::vector<double> m_lead;             // row sums
+        std::vector<double> m_lag;              // column sums
+        std::vector<int> m_rank;                // ids, best score first
+        std::vector<int> m_rankPos;             // id -> index in m_rank
+        int m_n;
+        int m_halfLifeMs;                       // <= 0: no decay
+        int m_originTS;                         // strategy time where m_weight is 1
+        double m_weight;                        // current weight of one count
+        unsigned m_version;                     // bumped whenever the ranking changes
         bool m_needFuzzySort;
-        CFuzzySort(int needFuzzySort)
+        CFuzzySort(int needFuzzySort, int halfLifeMs=0)
         {
             m_snapQueue.clear();
             m_needFuzzySort = needFuzzySort > 0 ? true : false;
             m_queueCount=m_lastSysTS=m_lastMdTS=0;
+            m_n = 0;
+            m_halfLifeMs = halfLifeMs;
+            m_originTS = 0;
+            m_weight = 1.0;
+            m_version = 0;
         }
+        double &cell(int i, int j) { return m_sortMatrix[i*m_n + j]; }
         bool subscribeInst(int ref)
         {
             int n = m_refMap.size();
             if (m_refMap.find(ref)!=m_refMap.end()) return false;
-            else if (n > SMALL_QUEUE) return false;
+            else if (n >= SMALL_QUEUE) return false;
             else
             {
                 m_refMap[ref] = n;
@@ -219,11 +1148,23 @@ private:
                 return true;
             }
         }
+        // sizes the tables once every instrument is subscribed; the ranking starts in subscription order
+        void finishSubscribe()
+        {
+            m_n = m_refMap.size();
+            m_sortMatrix.assign(m_n * m_n, 0.0);
+            m_lead.assign(m_n, 0.0);
+            m_lag.assign(m_n, 0.0);
+            m_rank.resize(m_n);
+            m_rankPos.resize(m_n);
+            for (int i=0;i<m_n;i++) m_rank[i] = m_rankPos[i] = i;
+        }
         int size() { return m_refMap.size(); }
+        unsigned version() const { return m_version; }
         int getSortId(int ref)
         {
-            if (m_refMap.find(ref)!=m_refMap.end()) return m_refMap[ref];
-            return -1;
+            auto it = m_refMap.find(ref);
+            return it != m_refMap.end() && it->second < m_n ? it->second : -1;
         }
         int updateOne(int ref,int sysTS,int mdTS)
         {
@@ -236,10 +1177,12 @@ private:
                 for (int i=m_queueCount-1;i>=0;i--)
                 {
                     int preId = m_snapQueue.get(i);
-                    if (preId != currId) m_sortMatrix[preId][currId] = m_sortMatrix[preId][currId] + 1;
+                    if (preId != currId) count(preId, currId);
                     else { newSnap = 1; m_queueCount=0; break; }
                 }
+                reposition(currId);
             }
+            if (newSnap > 0) decayTo(sysTS);
             m_queueCount++;
             m_snapQueue = currId;
             return newSnap;
@@ -270,35 +1213,72 @@ private:
             int currId = getSortId(ref1);
             if (m_needFuzzySort && preId>=0 && currId>=0)
             {
-                if (m_sortMatrix[preId][currId] > m_sortMatrix[currId][preId]) return 1;
-                else if (m_sortMatrix[preId][currId] < m_sortMatrix[currId][preId]) return -1;
+                if (cell(preId, currId) > cell(currId, preId)) return 1;
+                else if (cell(preId, currId) < cell(currId, preId)) return -1;
             }
             if (preId < currId) return 1;
             else if (preId > currId) return -1;
             else return 0;
         }
-        int *sortByScore()
+        double score(int id) const
+        {
+            double total = m_lead[id] + m_lag[id];
+            return total > 0 ? (m_lead[id] - m_lag[id]) / total : 0.0;
+        }
+        // i-th instrument ref by score, best first
+        int rankedRef(int i) { return m_idxMap[m_rank[i]]; }
+        void reset()
+        {
+            m_queueCount = 0; m_snapQueue.clear(); m_lastSysTS=m_lastMdTS=0;
+            std::fill(m_sortMatrix.begin(), m_sortMatrix.end(), 0.0);
+            std::fill(m_lead.begin(), m_lead.end(), 0.0);
+            std::fill(m_lag.begin(), m_lag.end(), 0.0);
+            m_originTS = 0;
+            m_weight = 1.0;
+        }
+    private:
+        void count(int preId, int currId)
+        {
+            cell(preId, currId) += m_weight;
+            m_lead[preId] += m_weight;
+            m_lag[currId] += m_weight;
+            reposition(preId);
+        }
+        // one score moved: adjacent swaps put it back in order, strict comparisons keep ties where they are
+        void reposition(int id)
         {
-            int n = m_idxMap.size();
-            int *ref = new int[n];
-            double *score = new double[n];
-            for (int i=0;i<n;i++)
+            int pos = m_rankPos[id];
+            double s = score(id);
+            int from = pos;
+            while (pos > 0 && score(m_rank[pos-1]) < s)
             {
-                double lead = 0; double lag = 0;
-                for (int j=0;j<n;j++) { lead += double(m_sortMatrix[i][j]); lag += double(m_sortMatrix[j][i]); }
-                ref[i] = m_idxMap[i];
-                score[i] = (lead+lag)>0 ? (lead-lag)/(lead+lag) : 0.0;
+                m_rank[pos] = m_rank[pos-1];
+                m_rankPos[m_rank[pos]] = pos;
+                pos--;
             }
-            for (int i=0;i<n;i++)
+            while (pos < m_n-1 && score(m_rank[pos+1]) > s)
             {
-                int k = i;
-                for (int j=i+1;j<n;j++) if (score[j]>score[k]) k = j;
-                double tmp = score[i]; score[i] = score[k]; score[k] = tmp;
-                int tmp1 = ref[i]; ref[i] = ref[k]; ref[k] = tmp1;
+                m_rank[pos] = m_rank[pos+1];
+                m_rankPos[m_rank[pos]] = pos;
+                pos++;
             }
-            return ref;
+            m_rank[pos] = id;
+            m_rankPos[id] = pos;
+            if (pos != from) m_version++;
+        }
+        // a count made now weighs 2^(elapsed/halfLife) of one made at the origin; ratios, and so scores
+        // and isFaster, are the same as decaying every count. Rescaled before the weights grow large
+        void decayTo(int sysTS)
+        {
+            if (m_halfLifeMs <= 0) return;
+            m_weight = std::exp2(double(sysTS - m_originTS) / m_halfLifeMs);
+            if (m_weight < 1e12) return;
+            double scale = 1.0 / m_weight;
+            for (auto& c : m_sortMatrix) c *= scale;
+            for (int i=0;i<m_n;i++) { m_lead[i] *= scale; m_lag[i] *= scale; }
+            m_originTS = sysTS;
+            m_weight = 1.0;
         }
-        void reset() { m_queueCount = 0; m_snapQueue.clear(); m_lastSysTS=m_lastMdTS=0; memset(m_sortMatrix,0,sizeof(m_sortMatrix)); }
     };
 
     class CStratsEnvAE
@@ -335,6 +1315,7 @@ private:
         int m_minEDC;
         int m_ltdD;
         int m_needFuzzySort;
+        int m_fuzzyHalfLifeMs;
         int m_isBacktest;
         int m_offsetStrategy;
         int m_twapSecond;
@@ -342,6 +1323,32 @@ private:
         double m_slipTics;
         double m_cancelRate;
         int m_logTrdFlw;
+        int m_benchLatency;
+        int m_benchKernels;
+        int m_cpuCost;
+        int m_recordEvents;
+        int m_recordRing;
+        const char* m_replayFile;
+        int m_replaySession;
+        int m_simExchange;
+        int m_simAckMs;
+        int m_simFillMs;
+        int m_simFillSplit;
+        int m_simRejectPct;
+        int m_simSeed;
+        int m_warmupFrames;
+        int m_persistMs;
+        int m_stateSnapshot;
+        int m_journal;
+        int m_execCheckpoint;
+        int m_resumeWaitMs;
+        int m_shmMirror;
+        const char* m_standbyOf;
+        int m_failoverMs;
+        int m_deferWork;
+        int m_deferMaxMs;
+        int m_dirtyTrigger;
+        int m_tickGate;
 
         std::vector<std::string> m_manSprds;
         std::map<std::string, std::vector<double>> m_manSprdExeCoefs;
@@ -455,6 +1462,7 @@ private:
             m_minEDC = pDesc->getIntProperty("MinEDC", 30);
             m_ltdD = pDesc->getIntProperty("LtdD", -1);
             m_needFuzzySort = pDesc->getIntProperty("FuzzySort", 0);
+            m_fuzzyHalfLifeMs = pDesc->getIntProperty("FuzzyHalfLifeMs", 0);
             m_isBacktest = pDesc->getIntProperty("IsBacktest", 0);
             m_offsetStrategy = pDesc->getIntProperty("OffsetStrategy", 3);
             m_twapSecond = pDesc->getIntProperty("TwapSecond", 10);
@@ -463,6 +1471,32 @@ private:
             m_cancelRate = pDesc->getDoubleProperty("CancelRate",0.2);
 
             m_logTrdFlw = pDesc->getIntProperty("LogTrdFlw",1);
+            m_benchLatency = pDesc->getIntProperty("BenchLatency",0);
+            m_benchKernels = pDesc->getIntProperty("BenchKernels",0);
+            m_cpuCost = pDesc->getIntProperty("CpuCost",0);
+            m_recordEvents = pDesc->getIntProperty("RecordEvents",0);
+            m_recordRing = pDesc->getIntProperty("RecordRing",65536);
+            m_replayFile = pDesc->getProperty("ReplayFile", "");
+            m_replaySession = pDesc->getIntProperty("ReplaySession",-1);
+            m_simExchange = pDesc->getIntProperty("SimExchange",0);
+            m_simAckMs = pDesc->getIntProperty("SimAckMs",1);
+            m_simFillMs = pDesc->getIntProperty("SimFillMs",1);
+            m_simFillSplit = pDesc->getIntProperty("SimFillSplit",1);
+            m_simRejectPct = pDesc->getIntProperty("SimRejectPct",0);
+            m_simSeed = pDesc->getIntProperty("SimSeed",1);
+            m_warmupFrames = pDesc->getIntProperty("WarmupFrames",0);
+            m_persistMs = pDesc->getIntProperty("PersistMs",100);
+            m_stateSnapshot = pDesc->getIntProperty("StateSnapshot",0);
+            m_journal = pDesc->getIntProperty("Journal",0);
+            m_execCheckpoint = pDesc->getIntProperty("ExecCheckpoint",0);
+            m_resumeWaitMs = pDesc->getIntProperty("ResumeWaitMs",3000);
+            m_shmMirror = pDesc->getIntProperty("ShmMirror",0);
+            m_standbyOf = pDesc->getProperty("StandbyOf", "");
+            m_failoverMs = pDesc->getIntProperty("FailoverMs",1000);
+            m_deferWork = pDesc->getIntProperty("DeferWork",0);
+            m_deferMaxMs = pDesc->getIntProperty("DeferMaxMs",20);
+            m_dirtyTrigger = pDesc->getIntProperty("DirtyTrigger",0);
+            m_tickGate = pDesc->getIntProperty("TickGate",0);
 
             m_mrgnRt = pDesc->getDoubleProperty("MrgnRt", 0.0);
             strcpySafe(m_sprdConn, pDesc->getProperty("SprdConn", "-"));
@@ -739,13 +1773,9 @@ private:
         double entryPrice;    // Grid level price where position was opened
         int direction;        // 1 for long, -1 for short
         double entrySpread;   // Actual spread value when position was opened
-        std::vector<double> legPricesAtEntry;  // Prices of each leg when position opened
         
         COpenPosition(double ep, int dir, double es) 
             : entryPrice(ep), direction(dir), entrySpread(es) {}
-        
-        COpenPosition(double ep, int dir, double es, const std::vector<double>& legPrices) 
-            : entryPrice(ep), direction(dir), entrySpread(es), legPricesAtEntry(legPrices) {}
     };
     
     // Structure to track daily high/low for boundary calculation
@@ -781,6 +1811,8 @@ private:
         
         // Dynamic grid strategy fields
         std::vector<COpenPosition> m_openPositions;  // Track all open grid positions
+        std::vector<double> m_openLegPrices;         // leg prices at entry, m_legCount per open position
+        int m_legCount = 0;                          // legs of the spread, set by sizeLegs
         double m_dynamicFactorLong = 1.0;            // Dynamic adjustment for long grid
         double m_dynamicFactorShort = 1.0;           // Dynamic adjustment for short grid
         int m_numOpensLong = 0;                      // Count of long position opens
@@ -810,31 +1842,408 @@ private:
         int m_riskStartIndex = 0;                    // Index when risk mode started (for momentum calc)
         double m_centerAtRiskStart = 0.0;            // Center value when risk started
         std::vector<double> m_legPricesAtRiskStart;  // Leg prices when risk started
+        int m_riskLegCount = 0;                      // Valid entries in m_legPricesAtRiskStart
         
         // Daily high/low tracking for N-day boundaries
         std::deque<CDailyHighLow> m_dailyHighLows;   // Daily highs/lows for boundary calculation
         int m_maxHistoryDays = 360;                  // Maximum days to keep in history
         double m_currentDayHigh = -DBL_MAX;          // Current day's high
         double m_currentDayLow = DBL_MAX;            // Current day's low
+        int m_historyVersion = 0;                    // bumped at each day roll; the history file is rewritten only then
         int m_currentDay = 0;                        // Current trading day
         
         // Boundary tracking
         double m_prevArbitrageLower = 0.0;
         double m_prevArbitrageUpper = 0.0;
-    };
- 
-    class CSpreadSignalManager
-    {
-    private:
-        std::vector<CSpreadSignal *> m_persistentArray;
-        json m_sprdsData;
-        std::map<int, CSpreadSignal *> m_signalMap;
+
+        // Sizes the per-leg state when the spread is created, so opens and risk starts do not allocate
+        void sizeLegs(int legCount)
+        {
+            m_legCount = legCount;
+            m_legPricesAtRiskStart.resize(legCount, 0.0);
+            m_openPositions.reserve(MAX_OPEN_POSITION);
+            m_openLegPrices.reserve(size_t(MAX_OPEN_POSITION) * legCount);
+            m_openLegPrices.resize(m_openPositions.size() * legCount, 0.0);
+        }
+        void openPosition(double entryPrice, int direction, double entrySpread, const double *legPrices)
+        {
+            m_openPositions.emplace_back(entryPrice, direction, entrySpread);
+            m_openLegPrices.insert(m_openLegPrices.end(), legPrices, legPrices + m_legCount);
+        }
+        // removes the oldest open position in direction
+        void closePosition(int direction)
+        {
+            for (size_t i=0; i<m_openPositions.size(); i++)
+            {
+                if (m_openPositions[i].direction != direction) continue;
+                m_openPositions.erase(m_openPositions.begin() + i);
+                m_openLegPrices.erase(m_openLegPrices.begin() + i * m_legCount, m_openLegPrices.begin() + (i + 1) * m_legCount);
+                return;
+            }
+        }
+        const double *openLegPrices(size_t i) const { return &m_openLegPrices[i * m_legCount]; }
+    };
+ 
+    // Fixed-layout binary state file, the mmap alternative to the JSON data file. One header, then one
+    // record per instrument and one per spread; the daily history lives in the history files. Records are
+    // patched in place; m_seq is odd while a record is being rewritten, so a torn record is detected at load
+    class CStateSnapshot
+    {
+    public:
+        struct CInstState
+        {
+            int m_preOI;
+            double m_LP;
+            double m_theoLst;
+            int m_pos;
+        };
+        struct CSpreadState
+        {
+            int m_pos;
+            double m_ttlMrgn;
+            double m_refMid;
+            int m_sprdMaxLot;
+            int m_stepSize;
+            double m_awp;
+            double m_sprdAP;
+            double m_sprdBP;
+            int m_sprdAQ;
+            int m_sprdBQ;
+            double m_buy;
+            double m_sell;
+            double m_atp;
+            double m_diPnl;
+            double m_dnPnl;
+            double m_pnl;
+            double m_dynamicFactorLong;
+            double m_dynamicFactorShort;
+            int m_numOpensLong;
+            int m_numOpensShort;
+            int m_profitableClosesLong;
+            int m_profitableClosesShort;
+            bool m_inRiskMode;
+            char m_reducedLeg[16];
+            double m_reducedAmount;
+            int m_reducedDirection;
+            int m_arbitragePos;
+            int m_riskPos;
+            int m_currentDay;
+            double m_currentDayHigh;
+            double m_currentDayLow;
+        };
+        struct CHeader
+        {
+            char m_magic[4];             // "EZSS"
+            int m_version;
+            int m_headerSize;
+            int m_instRecordSize;
+            int m_sprdRecordSize;
+            int m_instCount;
+            int m_sprdCount;
+            long long m_startNs;
+            unsigned long long m_journalSeq;   // last journal record the image covers
+        };
+        struct CInstRecord
+        {
+            unsigned m_seq;
+            char m_instKey[48];          // <InstrumentID>.<ExchangeID>
+            CInstState m_state;
+        };
+        struct CSprdRecord
+        {
+            unsigned m_seq;
+            char m_sprdNm[96];
+            bool m_tradable;
+            CSpreadState m_state;
+        };
+        static const int VERSION = 3;
+    private:
+        char *m_pBase;
+        size_t m_size;
+        std::string m_fileName;
+        std::string m_tmpName;
+        bool m_published;
+
+        CInstRecord *inst(int i) const { return (CInstRecord *)(m_pBase + sizeof(CHeader)) + i; }
+        CSprdRecord *sprd(int i) const
+        {
+            const CHeader *pHeader = (const CHeader *)m_pBase;
+            return (CSprdRecord *)(m_pBase + sizeof(CHeader) + size_t(pHeader->m_instCount) * sizeof(CInstRecord)) + i;
+        }
+        static void beginWrite(unsigned &seq) { seq++; std::atomic_thread_fence(std::memory_order_release); }
+        static void endWrite(unsigned &seq) { std::atomic_thread_fence(std::memory_order_release); seq++; }
+    public:
+        CStateSnapshot() : m_pBase(NULL), m_size(0), m_published(false) {}
+        ~CStateSnapshot() { close(); }
+        bool isOpen(void) const { return m_pBase != NULL; }
+
+        // Writer: lays the file out under <fileName>.tmp; publish() renames it once every record is filled
+        bool create(const std::string &fileName, const std::vector<std::string> &instKeys, const std::vector<std::string> &sprdNms,
+            const std::vector<bool> &tradable)
+        {
+            for (auto& key : instKeys) if (key.size() >= sizeof(((CInstRecord *)0)->m_instKey)) return false;
+            for (auto& nm : sprdNms) if (nm.size() >= sizeof(((CSprdRecord *)0)->m_sprdNm)) return false;
+            m_fileName = fileName;
+            m_tmpName = fileName + ".tmp";
+            m_size = sizeof(CHeader) + instKeys.size() * sizeof(CInstRecord) + sprdNms.size() * sizeof(CSprdRecord);
+            int fd = ::open(m_tmpName.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+            if (fd < 0) return false;
+            if (ftruncate(fd, m_size) != 0) { ::close(fd); return false; }
+            void *pBase = mmap(NULL, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            ::close(fd);
+            if (pBase == MAP_FAILED) return false;
+            m_pBase = (char *)pBase;
+            m_published = false;
+
+            CHeader *pHeader = (CHeader *)m_pBase;
+            memcpy(pHeader->m_magic, "EZSS", 4);
+            pHeader->m_version = VERSION;
+            pHeader->m_headerSize = sizeof(CHeader);
+            pHeader->m_instRecordSize = sizeof(CInstRecord);
+            pHeader->m_sprdRecordSize = sizeof(CSprdRecord);
+            pHeader->m_instCount = int(instKeys.size());
+            pHeader->m_sprdCount = int(sprdNms.size());
+            pHeader->m_startNs = nowNanos();
+            for (int i=0; i<int(instKeys.size()); i++) strcpySafe(inst(i)->m_instKey, instKeys[i].c_str());
+            for (int i=0; i<int(sprdNms.size()); i++)
+            {
+                strcpySafe(sprd(i)->m_sprdNm, sprdNms[i].c_str());
+                sprd(i)->m_tradable = tradable[i];
+            }
+            return true;
+        }
+        void putInst(int i, const CInstState &state)
+        {
+            CInstRecord *pRec = inst(i);
+            beginWrite(pRec->m_seq);
+            pRec->m_state = state;
+            endWrite(pRec->m_seq);
+        }
+        void putSpread(int i, const CSpreadState &state)
+        {
+            CSprdRecord *pRec = sprd(i);
+            beginWrite(pRec->m_seq);
+            pRec->m_state = state;
+            endWrite(pRec->m_seq);
+        }
+        void putJournalSeq(unsigned long long seq) { ((CHeader *)m_pBase)->m_journalSeq = seq; }
+        // first complete image: flush it and move it over the previous snapshot; later puts are in place
+        bool publish(void)
+        {
+            if (m_published) return msync(m_pBase, m_size, MS_ASYNC) == 0;
+            if (msync(m_pBase, m_size, MS_SYNC) != 0) return false;
+            if (rename(m_tmpName.c_str(), m_fileName.c_str()) != 0) return false;
+            m_published = true;
+            return true;
+        }
+        void close(void)
+        {
+            if (m_pBase == NULL) return;
+            msync(m_pBase, m_size, MS_SYNC);
+            munmap(m_pBase, m_size);
+            m_pBase = NULL;
+        }
+
+        // Reader: maps fileName read-only; false when missing, of another layout, or holding a torn record
+        bool load(const char *fileName)
+        {
+            int fd = ::open(fileName, O_RDONLY);
+            if (fd < 0) return false;
+            struct stat st;
+            if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(CHeader)) { ::close(fd); return false; }
+            void *pBase = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            ::close(fd);
+            if (pBase == MAP_FAILED) return false;
+            m_pBase = (char *)pBase;
+            m_size = st.st_size;
+            const CHeader *pHeader = (const CHeader *)m_pBase;
+            bool ok = memcmp(pHeader->m_magic, "EZSS", 4) == 0 && pHeader->m_version == VERSION && pHeader->m_headerSize == int(sizeof(CHeader))
+                && pHeader->m_instRecordSize == int(sizeof(CInstRecord)) && pHeader->m_sprdRecordSize == int(sizeof(CSprdRecord))
+                && m_size == sizeof(CHeader) + size_t(pHeader->m_instCount) * sizeof(CInstRecord) + size_t(pHeader->m_sprdCount) * sizeof(CSprdRecord);
+            for (int i=0; ok && i<pHeader->m_instCount; i++) ok = (inst(i)->m_seq & 1) == 0;
+            for (int i=0; ok && i<pHeader->m_sprdCount; i++) ok = (sprd(i)->m_seq & 1) == 0;
+            if (!ok)
+            {
+                munmap(m_pBase, m_size);
+                m_pBase = NULL;
+            }
+            return ok;
+        }
+        unsigned long long journalSeq(void) const { return ((const CHeader *)m_pBase)->m_journalSeq; }
+        int instCount(void) const { return ((const CHeader *)m_pBase)->m_instCount; }
+        int sprdCount(void) const { return ((const CHeader *)m_pBase)->m_sprdCount; }
+        const CInstRecord &instAt(int i) const { return *inst(i); }
+        const CSprdRecord &sprdAt(int i) const { return *sprd(i); }
+    };
+
+    // Live per-spread state for external monitors in a POSIX shared-memory segment. Fixed layout: one
+    // header, then one record per spread. The trading thread is the only writer; each record is guarded
+    // by a seqlock, so a reader copies it and retries while m_seq is odd or changed under it
+    class CShmMirror
+    {
+    public:
+        struct CHeader
+        {
+            char m_magic[4];            // "EZSM"
+            int m_version;
+            int m_headerSize;
+            int m_recordSize;
+            int m_count;
+            int m_pid;
+            int m_tradingDay;
+            long long m_startNs;
+            char m_strategyName[64];
+            long long m_heartbeatNs;    // CLOCK_MONOTONIC, bumped while the trading thread runs
+        };
+        struct CSpreadRecord
+        {
+            unsigned m_seq;
+            char m_sprdNm[96];
+            int m_tradable;
+            int m_pos;
+            int m_timeStamp;            // strategy time of the last publish
+            int m_processing;           // legging execution in flight
+            long long m_updateNs;
+            double m_buy;               // theo bid / ask
+            double m_sell;
+            double m_refMid;
+            double m_spBP;
+            double m_spAP;
+            double m_entryIntervalLong;
+            double m_entryIntervalShort;
+            double m_exitInterval;
+            double m_dynamicFactorLong;
+            double m_dynamicFactorShort;
+            int m_inRiskMode;
+            int m_reducedDirection;
+            int m_arbitragePos;
+            int m_riskPos;
+            double m_reducedAmount;
+            double m_atp;
+            double m_diPnl;
+            double m_dnPnl;
+            double m_pnl;
+        };
+        static const int VERSION = 2;
+    private:
+        char *m_pBase;
+        size_t m_size;
+        std::string m_name;
+        CSpreadRecord *record(int i) const { return (CSpreadRecord *)(m_pBase + sizeof(CHeader)) + i; }
+    public:
+        CShmMirror() : m_pBase(NULL), m_size(0) {}
+        ~CShmMirror() { close(); }
+        bool isOpen(void) const { return m_pBase != NULL; }
+        const std::string &name(void) const { return m_name; }
+
+        // name: "/<ShmNmPrefix><strategy>.ezdg"; the segment is recreated so readers never see an old layout
+        bool open(const std::string &name, const char *strategyName, int tradingDay, const std::vector<std::string> &sprdNms, const std::vector<bool> &tradable)
+        {
+            m_name = name;
+            m_size = sizeof(CHeader) + sprdNms.size() * sizeof(CSpreadRecord);
+            shm_unlink(m_name.c_str());
+            int fd = shm_open(m_name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+            if (fd < 0) return false;
+            if (ftruncate(fd, m_size) != 0) { ::close(fd); return false; }
+            void *pBase = mmap(NULL, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            ::close(fd);
+            if (pBase == MAP_FAILED) return false;
+            m_pBase = (char *)pBase;
+            for (int i=0; i<int(sprdNms.size()); i++)
+            {
+                strncpy(record(i)->m_sprdNm, sprdNms[i].c_str(), sizeof(record(i)->m_sprdNm)-1);
+                record(i)->m_tradable = tradable[i];
+            }
+            CHeader *pHeader = (CHeader *)m_pBase;
+            pHeader->m_version = VERSION;
+            pHeader->m_headerSize = sizeof(CHeader);
+            pHeader->m_recordSize = sizeof(CSpreadRecord);
+            pHeader->m_count = int(sprdNms.size());
+            pHeader->m_pid = getpid();
+            pHeader->m_tradingDay = tradingDay;
+            pHeader->m_startNs = pHeader->m_heartbeatNs = nowNanos();
+            strncpy(pHeader->m_strategyName, strategyName, sizeof(pHeader->m_strategyName)-1);
+            // the magic goes last: a reader that sees it sees a complete header
+            std::atomic_thread_fence(std::memory_order_release);
+            memcpy(pHeader->m_magic, "EZSM", 4);
+            return true;
+        }
+        // Writer: returns the record open for update; end() publishes it
+        CSpreadRecord *begin(int i)
+        {
+            CSpreadRecord *pRec = record(i);
+            pRec->m_seq++;
+            std::atomic_thread_fence(std::memory_order_release);
+            return pRec;
+        }
+        void end(CSpreadRecord *pRec)
+        {
+            std::atomic_thread_fence(std::memory_order_release);
+            pRec->m_seq++;
+        }
+        void beat(long long nowNs)
+        {
+            ((volatile CHeader *)m_pBase)->m_heartbeatNs = nowNs;
+        }
+        // Reader side: maps another process's segment read-only; NULL while it is absent or incomplete
+        static const char *attach(const std::string &name, size_t &size)
+        {
+            int fd = shm_open(name.c_str(), O_RDONLY, 0);
+            if (fd < 0) return NULL;
+            struct stat st;
+            void *pBase = MAP_FAILED;
+            if (fstat(fd, &st) == 0 && st.st_size >= off_t(sizeof(CHeader)))
+                pBase = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+            ::close(fd);
+            if (pBase == MAP_FAILED) return NULL;
+            const volatile CHeader *pHeader = (const volatile CHeader *)pBase;
+            if (memcmp((const void *)pHeader->m_magic, "EZSM", 4) != 0 || pHeader->m_version != VERSION)
+            {
+                munmap(pBase, st.st_size);
+                return NULL;
+            }
+            size = st.st_size;
+            return (const char *)pBase;
+        }
+        static void detach(const char *pBase, size_t size)
+        {
+            if (pBase != NULL) munmap((void *)pBase, size);
+        }
+        static const volatile CHeader *header(const char *pBase) { return (const volatile CHeader *)pBase; }
+        // false while the record is being written
+        static bool read(const char *pBase, int i, CSpreadRecord &out)
+        {
+            const volatile CSpreadRecord *pRec = (const volatile CSpreadRecord *)(pBase + sizeof(CHeader)) + i;
+            unsigned seq0 = pRec->m_seq;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            memcpy(&out, (const void *)pRec, sizeof(out));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            return (seq0 & 1) == 0 && pRec->m_seq == seq0;
+        }
+        void close(void)
+        {
+            if (m_pBase == NULL) return;
+            munmap(m_pBase, m_size);
+            m_pBase = NULL;
+        }
+    };
+
+    class CSpreadSignalManager
+    {
+    private:
+        std::vector<CSpreadSignal *> m_persistentArray;
+        json m_sprdsData;
+        std::map<int, CSpreadSignal *> m_signalMap;
+        std::unordered_map<std::string, CSpreadSignal *> m_nameIndex;
     public:
         CStratsEnvAE *m_pEnv;
+        unsigned long long m_journalSeq = 0;         // last journal record the loaded state covers
         CSpreadSignalManager(const char *jsonFilename, CStratsEnvAE *pEnv)
         {
             m_pEnv = pEnv;
-            json2SprdArray(jsonFilename);
+            if (m_pEnv->m_stateSnapshot <= 0 || !snap2SprdArray((std::string(jsonFilename) + ".snap").c_str()))
+                json2SprdArray(jsonFilename);
+            loadHistory(jsonFilename);
             for (int i=0;i<m_persistentArray.size();i++)
             {
                 CSpreadSignal *pSignal = m_persistentArray.at(i);
@@ -897,15 +2306,20 @@ private:
             pSig->m_sprdNm = sprdNm;
 
             m_persistentArray.push_back(pSig);
+            m_nameIndex[sprdNm] = pSig;
             return pSig;
         }
 
         CSpreadSignal *getSignal(std::string sprdNm)
         {
+            auto it = m_nameIndex.find(sprdNm);
+            if (it != m_nameIndex.end())
+                return it->second;
+            // signals made by id are named later, index them on first lookup
             for (auto pSig: m_persistentArray)
             {
                 if (sprdNm == pSig->m_sprdNm)
-                    return pSig;
+                    return m_nameIndex[sprdNm] = pSig;
             }
             return mkSig(sprdNm);
         }
@@ -922,9 +2336,179 @@ private:
             }
         }
 
+        // Daily high/low history, one file per spread under <data file>.hist; a missing file keeps
+        // whatever the data file itself carried (files written before the split)
+        void loadHistory(const char *jsonFilename)
+        {
+            int loaded = 0;
+            for (auto pSig: m_persistentArray)
+            {
+                std::ifstream f(std::string(jsonFilename) + ".hist/" + pSig->m_sprdNm + ".json");
+                if (!f.is_open())
+                    continue;
+                json days = json::parse(f, nullptr, false);
+                if (!days.is_array())
+                    continue;
+                pSig->m_dailyHighLows.clear();
+                for (const auto& dayObj : days)
+                {
+                    if (dayObj.contains("day") && dayObj.contains("high") && dayObj.contains("low"))
+                        pSig->m_dailyHighLows.push_back(CDailyHighLow(dayObj["day"].get<int>(), dayObj["high"].get<double>(), dayObj["low"].get<double>()));
+                }
+                loaded++;
+            }
+            g_pMercLog->log("[loadHistory]%s.hist,spreads,%d", jsonFilename, loaded);
+        }
+
+        // Same fields as json2SprdArray, copied straight out of the mapped records
+        bool snap2SprdArray(const char *snapFilename)
+        {
+            CStateSnapshot snapshot;
+            if (!snapshot.load(snapFilename))
+            {
+                g_pMercLog->log("[snap2SprdArray]%s,NOT_LOADED,fallback json", snapFilename);
+                return false;
+            }
+            for (int i=0; i<snapshot.sprdCount(); i++)
+            {
+                const CStateSnapshot::CSprdRecord &rec = snapshot.sprdAt(i);
+                const CStateSnapshot::CSpreadState &st = rec.m_state;
+                CSpreadSignal *pSig = getSignal(std::string(rec.m_sprdNm));
+                pSig->m_pos = st.m_pos;
+                pSig->m_theoLst = pSig->m_awp = st.m_awp;
+                pSig->m_sprdAP = st.m_sprdAP;
+                pSig->m_sprdBP = st.m_sprdBP;
+                pSig->m_sprdAQ = st.m_sprdAQ;
+                pSig->m_sprdBQ = st.m_sprdBQ;
+                pSig->m_stepSize = st.m_stepSize;
+                pSig->m_refMid = st.m_refMid;
+                pSig->m_sprdMaxLot = st.m_sprdMaxLot;
+                pSig->m_atp = st.m_atp;
+                pSig->m_diPnl = st.m_diPnl;
+                pSig->m_dnPnl = st.m_dnPnl;
+                pSig->m_pnl = st.m_pnl;
+                pSig->m_dynamicFactorLong = st.m_dynamicFactorLong;
+                pSig->m_dynamicFactorShort = st.m_dynamicFactorShort;
+                pSig->m_numOpensLong = st.m_numOpensLong;
+                pSig->m_numOpensShort = st.m_numOpensShort;
+                pSig->m_profitableClosesLong = st.m_profitableClosesLong;
+                pSig->m_profitableClosesShort = st.m_profitableClosesShort;
+                pSig->m_inRiskMode = st.m_inRiskMode;
+                pSig->m_reducedLeg = st.m_reducedLeg;
+                pSig->m_reducedAmount = st.m_reducedAmount;
+                pSig->m_reducedDirection = st.m_reducedDirection;
+                pSig->m_arbitragePos = st.m_arbitragePos;
+                pSig->m_riskPos = st.m_riskPos;
+                pSig->m_currentDay = st.m_currentDay;
+                pSig->m_currentDayHigh = st.m_currentDayHigh;
+                pSig->m_currentDayLow = st.m_currentDayLow;
+            }
+            m_journalSeq = snapshot.journalSeq();
+            g_pMercLog->log("[snap2SprdArray]%s,spreads,%d,journalSeq,%llu", snapFilename, snapshot.sprdCount(), m_journalSeq);
+            snapshot.close();
+            return true;
+        }
+        // json2SprdArray visitor: spreads are staged by name and kept at the end if they have a position entry
+        struct CSprdLoader
+        {
+            enum
+            {
+                F_JournalSeq, F_Pos, F_Awp, F_SprdAP, F_SprdBP, F_SprdAQ, F_SprdBQ, F_StepSize, F_RefMid, F_SprdMaxLot,
+                F_Atp, F_DiPnl, F_DnPnl, F_Pnl, F_DynamicFactorLong, F_DynamicFactorShort, F_NumOpensLong, F_NumOpensShort,
+                F_ProfitableClosesLong, F_ProfitableClosesShort, F_InRiskMode, F_ReducedLeg, F_ReducedAmount,
+                F_ReducedDirection, F_ArbitragePos, F_RiskPos, F_DailyHighLows, F_CurrentDay, F_CurrentDayHigh,
+                F_CurrentDayLow, F_Count
+            };
+            CSpreadSignalManager *m_pManager;
+            std::unordered_map<std::string, CSpreadSignal *> m_staged;
+            std::vector<CSpreadSignal *> m_order;            // first appearance, the order the old loader created them in
+            std::unordered_set<std::string> m_withPos;       // keys of sprd_poss
+            unsigned long long m_journalSeq = 0;
+            CSpreadSignal *m_pLast = NULL;
+
+            int section(const std::string &name)
+            {
+                static const char *names[F_Count] = {
+                    "journal_seq", "sprd_poss", "awps", "sprd_aps", "sprd_bps", "sprd_aqs", "sprd_bqs", "step_sizes", "ref_mids", "sprd_max_lots",
+                    "atps", "di_pnls", "dn_pnls", "pnls", "dynamic_factor_long", "dynamic_factor_short", "num_opens_long", "num_opens_short",
+                    "profitable_closes_long", "profitable_closes_short", "in_risk_mode", "reduced_leg", "reduced_amount",
+                    "reduced_direction", "arbitrage_pos", "risk_pos", "daily_high_lows", "current_day", "current_day_high",
+                    "current_day_low" };
+                for (int i=0; i<F_Count; i++) if (name == names[i]) return i;
+                return -1;
+            }
+            CSpreadSignal *stage(const std::string &tkr)
+            {
+                // ignore instrument
+                if (tkr.find(m_pManager->m_pEnv->m_sprdConn) == std::string::npos && tkr.find('.') != std::string::npos)
+                    return NULL;
+                if (m_pLast != NULL && m_pLast->m_sprdNm == tkr) return m_pLast;
+                auto it = m_staged.find(tkr);
+                if (it != m_staged.end()) return m_pLast = it->second;
+                CSpreadSignal *pSig = new CSpreadSignal();
+                pSig->m_sprdNm = tkr;
+                m_staged[tkr] = pSig;
+                m_order.push_back(pSig);
+                return m_pLast = pSig;
+            }
+            void value(int field, const std::string &tkr, const json &v)
+            {
+                if (tkr.empty())
+                {
+                    if (field == F_JournalSeq) m_journalSeq = v.get<unsigned long long>();
+                    return;
+                }
+                CSpreadSignal *pSig = stage(tkr);
+                if (pSig == NULL) return;
+                switch (field)
+                {
+                case F_Pos: pSig->m_pos = v; m_withPos.insert(tkr); break;
+                case F_Awp: pSig->m_theoLst = v; pSig->m_awp = v; break;
+                case F_SprdAP: pSig->m_sprdAP = v; break;
+                case F_SprdBP: pSig->m_sprdBP = v; break;
+                case F_SprdAQ: pSig->m_sprdAQ = v; break;
+                case F_SprdBQ: pSig->m_sprdBQ = v; break;
+                case F_StepSize: pSig->m_stepSize = v; break;
+                case F_RefMid: pSig->m_refMid = v; break;
+                case F_SprdMaxLot: pSig->m_sprdMaxLot = v; break;
+                case F_Atp: pSig->m_atp = v; break;
+                case F_DiPnl: pSig->m_diPnl = v; break;
+                case F_DnPnl: pSig->m_dnPnl = v; break;
+                case F_Pnl: pSig->m_pnl = v; break;
+                // dynamic grid state
+                case F_DynamicFactorLong: pSig->m_dynamicFactorLong = v; break;
+                case F_DynamicFactorShort: pSig->m_dynamicFactorShort = v; break;
+                case F_NumOpensLong: pSig->m_numOpensLong = v; break;
+                case F_NumOpensShort: pSig->m_numOpensShort = v; break;
+                case F_ProfitableClosesLong: pSig->m_profitableClosesLong = v; break;
+                case F_ProfitableClosesShort: pSig->m_profitableClosesShort = v; break;
+                // risk management state
+                case F_InRiskMode: pSig->m_inRiskMode = v; break;
+                case F_ReducedLeg: pSig->m_reducedLeg = v.get<std::string>(); break;
+                case F_ReducedAmount: pSig->m_reducedAmount = v; break;
+                case F_ReducedDirection: pSig->m_reducedDirection = v; break;
+                case F_ArbitragePos: pSig->m_arbitragePos = v; break;
+                case F_RiskPos: pSig->m_riskPos = v; break;
+                case F_CurrentDay: pSig->m_currentDay = v; break;
+                case F_CurrentDayHigh: pSig->m_currentDayHigh = v; break;
+                case F_CurrentDayLow: pSig->m_currentDayLow = v; break;
+                }
+            }
+            // daily high/low history of data files written before it moved to the history files
+            void begin(int field, const std::string &tkr)
+            {
+                CSpreadSignal *pSig = field == F_DailyHighLows ? stage(tkr) : NULL;
+                if (pSig != NULL) pSig->m_dailyHighLows.clear();
+            }
+            void day(int field, const std::string &tkr, int tradingDay, double high, double low)
+            {
+                CSpreadSignal *pSig = field == F_DailyHighLows ? stage(tkr) : NULL;
+                if (pSig != NULL) pSig->m_dailyHighLows.push_back(CDailyHighLow(tradingDay, high, low));
+            }
+        };
         void json2SprdArray(const char *jsonFilename)
         {
-            // Read json data file and assemble spread persistent array
+            // Read json data file and assemble spread persistent array, one streaming pass
             std::ifstream f(jsonFilename);
             if (!f.is_open())
             {
@@ -932,99 +2516,26 @@ private:
                 return;
             }
 
-			json m_sprdsData = json::parse(f);
-            std::vector<std::string> sprds;
-            for (auto sprdNPos=m_sprdsData["sprd_poss"].begin(); sprdNPos!=m_sprdsData["sprd_poss"].end();sprdNPos++)
-            {
-                sprds.push_back(sprdNPos.key());
-            }
-
-            for (json::iterator sprdData=m_sprdsData.begin(); sprdData != m_sprdsData.end(); ++sprdData) 
+            CSprdLoader loader;
+            loader.m_pManager = this;
+            CStateSax<CSprdLoader> sax(loader);
+            json::sax_parse(f, &sax);
+            m_journalSeq = loader.m_journalSeq;
+            int dropped = 0;
+            for (auto pSig: loader.m_order)
             {
-                std::string paramNm = sprdData.key();
-                auto paramData = sprdData.value();
-
-                bool isOneVal = (paramData.is_boolean() || paramData.is_number() || paramData.is_string());
-                if (isOneVal)
-                    continue;
-                else if (paramData.is_array())
-                    continue;
-                else
+                if (loader.m_withPos.count(pSig->m_sprdNm) == 0)
                 {
-                    for (json::iterator kv=paramData.begin(); kv!=paramData.end(); ++kv) 
-                    {
-                        std::string tkr = kv.key();
-                        auto paramVal = kv.value();
-
-                        // ignore instrument
-                        if (tkr.find(m_pEnv->m_sprdConn) == std::string::npos && tkr.find('.') != std::string::npos)
-                            continue;
-
-                        std::vector<CSpreadSignal*> pSigs;
-                        std::string arbKey = tkr;
-                        bool arbTrd = std::find(sprds.begin(), sprds.end(), arbKey) != sprds.end();
-                        if (!arbTrd)
-                            continue;
-
-                        CSpreadSignal *pSig = getSignal(tkr);
-
-                        if (paramNm == "sprd_poss") pSig->m_pos = paramVal;
-                        if (paramNm == "awps") { pSig->m_theoLst = paramVal; pSig->m_awp = paramVal; }
-                        if (paramNm == "sprd_aps") pSig->m_sprdAP = paramVal;
-                        if (paramNm == "sprd_bps") pSig->m_sprdBP = paramVal;
-                        if (paramNm == "sprd_aqs") pSig->m_sprdAQ = paramVal;
-                        if (paramNm == "sprd_bqs") pSig->m_sprdBQ = paramVal;
-                        if (paramNm == "step_sizes") pSig->m_stepSize = paramVal;
-                        if (paramNm == "ref_mids") pSig->m_refMid = paramVal;
-                        if (paramNm == "sprd_max_lots") pSig->m_sprdMaxLot = paramVal;
-                        if (paramNm == "atps") pSig->m_atp = paramVal;
-                        if (paramNm == "di_pnls") pSig->m_diPnl = paramVal;
-                        if (paramNm == "dn_pnls") pSig->m_dnPnl = paramVal;
-                        if (paramNm == "pnls") pSig->m_pnl = paramVal;
-                        
-                        // Load dynamic grid state
-                        if (paramNm == "dynamic_factor_long") pSig->m_dynamicFactorLong = paramVal;
-                        if (paramNm == "dynamic_factor_short") pSig->m_dynamicFactorShort = paramVal;
-                        if (paramNm == "num_opens_long") pSig->m_numOpensLong = paramVal;
-                        if (paramNm == "num_opens_short") pSig->m_numOpensShort = paramVal;
-                        if (paramNm == "profitable_closes_long") pSig->m_profitableClosesLong = paramVal;
-                        if (paramNm == "profitable_closes_short") pSig->m_profitableClosesShort = paramVal;
-                        
-                        // Load risk management state
-                        if (paramNm == "in_risk_mode") pSig->m_inRiskMode = paramVal;
-                        if (paramNm == "reduced_leg") pSig->m_reducedLeg = paramVal.get<std::string>();
-                        if (paramNm == "reduced_amount") pSig->m_reducedAmount = paramVal;
-                        if (paramNm == "reduced_direction") pSig->m_reducedDirection = paramVal;
-                        if (paramNm == "arbitrage_pos") pSig->m_arbitragePos = paramVal;
-                        if (paramNm == "risk_pos") pSig->m_riskPos = paramVal;
-                        
-                        // Load daily high/low history
-                        if (paramNm == "daily_high_lows" && paramVal.is_array())
-                        {
-                            pSig->m_dailyHighLows.clear();
-                            for (const auto& dayObj : paramVal)
-                            {
-                                if (dayObj.contains("day") && dayObj.contains("high") && dayObj.contains("low"))
-                                {
-                                    CDailyHighLow dayData(
-                                        dayObj["day"].get<int>(),
-                                        dayObj["high"].get<double>(),
-                                        dayObj["low"].get<double>()
-                                    );
-                                    pSig->m_dailyHighLows.push_back(dayData);
-                                }
-                            }
-                        }
-                        if (paramNm == "current_day") pSig->m_currentDay = paramVal;
-                        if (paramNm == "current_day_high") pSig->m_currentDayHigh = paramVal;
-                        if (paramNm == "current_day_low") pSig->m_currentDayLow = paramVal;
-                     
-                        bool inPersistentArray = std::find(m_persistentArray.begin(), m_persistentArray.end(), pSig) != m_persistentArray.end();
-                        if (!inPersistentArray)
-                            m_persistentArray.push_back(pSig);
-                    }
+                    delete pSig;
+                    dropped++;
+                    continue;
                 }
+                int id = m_signalMap.size();
+                m_signalMap[id] = pSig;
+                m_persistentArray.push_back(pSig);
+                m_nameIndex[pSig->m_sprdNm] = pSig;
             }
+            g_pMercLog->log("[json2sprdArray]%s,spreads,%d,dropped,%d,journalSeq,%llu", jsonFilename, int(m_persistentArray.size()), dropped, m_journalSeq);
         }
         void logSignal(int idx,CSpreadSignal *pSig)
         {
@@ -1047,6 +2558,8 @@ private:
                 pSig->m_pos = 0;
                 g_pMercLog->log("remove signal,%s", pSig->m_sprdNm.c_str());
                 m_persistentArray.erase(std::remove(m_persistentArray.begin(), m_persistentArray.end(), pSig), m_persistentArray.end());
+                auto it = m_nameIndex.find(pSig->m_sprdNm);
+                if (it != m_nameIndex.end() && it->second == pSig) m_nameIndex.erase(it);
             }
         }
     };
@@ -1066,9 +2579,10 @@ private:
         json m_instsData;
         std::map<std::string,CSignalAE *> m_signalMap;
     public:
-        CSignalManagerAE(const char *jsonFilename)
+        CSignalManagerAE(const char *jsonFilename, bool useSnapshot=false)
         {
-            json2InstArray(jsonFilename);
+            if (!useSnapshot || !snap2InstArray((std::string(jsonFilename) + ".snap").c_str()))
+                json2InstArray(jsonFilename);
             for (int i=0;i<m_persistentArray.size();i++)
             {
                 CSignalAE *pSignal=m_persistentArray.at(i);
@@ -1080,54 +2594,73 @@ private:
             }
         }
 
-        void json2InstArray(const char *jsonFilename)
+        bool snap2InstArray(const char *snapFilename)
         {
-            // Read json data file and assemble spread persistent array
-            std::ifstream f(jsonFilename);
-            if (!f.is_open())
-                return;
-
-			json m_instsData = json::parse(f);
-            std::vector<std::string> FUT_DATA = {"inst_poss", "ois", "lps", "emas", "awps"};
+            CStateSnapshot snapshot;
+            if (!snapshot.load(snapFilename))
+                return false;
+            for (int i=0; i<snapshot.instCount(); i++)
+            {
+                const CStateSnapshot::CInstRecord &rec = snapshot.instAt(i);
+                std::vector<std::string> instNExchg;
+                split(rec.m_instKey, instNExchg, ".");
+                CSignalAE* pSig = getSignal(instNExchg.at(0).c_str());
+                pSig->m_pos = rec.m_state.m_pos;
+                pSig->m_oi = rec.m_state.m_preOI;
+                pSig->m_theoLst = rec.m_state.m_LP;
+                pSig->m_awp = rec.m_state.m_theoLst;
+            }
+            g_pMercLog->log("[snap2InstArray]%s,instruments,%d", snapFilename, snapshot.instCount());
+            snapshot.close();
+            return true;
+        }
+        // json2InstArray visitor: instrument entries of the position, open interest and price sections
+        struct CInstLoader
+        {
+            enum { F_Pos, F_OI, F_LP, F_Ema, F_Awp, F_Count };
+            CSignalManagerAE *m_pManager;
+            std::string m_lastKey;
+            CSignalAE *m_pLast = NULL;
 
-            for (json::iterator instData=m_instsData.begin(); instData != m_instsData.end(); ++instData) 
+            int section(const std::string &name)
             {
-                bool isFutData = std::find(FUT_DATA.begin(), FUT_DATA.end(), instData.key()) != FUT_DATA.end();
-                if (!isFutData)
-                    continue;
-                for (json::iterator kv=instData.value().begin(); kv!=instData.value().end(); ++kv) 
+                static const char *names[F_Count] = { "inst_poss", "ois", "lps", "emas", "awps" };
+                for (int i=0; i<F_Count; i++) if (name == names[i]) return i;
+                return -1;
+            }
+            void value(int field, const std::string &key, const json &v)
+            {
+                // ignore spread
+                if (key.empty() || key.find('-') != std::string::npos)
+                    return;
+                if (m_pLast == NULL || key != m_lastKey)
                 {
-                    // ignore spread
-                    if (kv.key().find('-') != std::string::npos)
-                        continue;
-
-                    std::string instID, exchg;
-                    if (kv.key().find('.') == std::string::npos)
-                         instID = kv.key();
-                    else
-                    {
-                        std::vector<std::string> instNExchg;
-                        split(kv.key(), instNExchg, ".");
-                        instID = instNExchg.at(0);
-                        exchg = instNExchg.at(1);
-                    }
-
-                    CSignalAE* pSig = getSignal(instID.c_str());
-
-                    if (instData.key() == "inst_poss")
-                        pSig->m_pos = kv.value();
-                    if (instData.key() == "ois")
-                        pSig->m_oi = kv.value();
-                    if (instData.key() == "lps")
-                        pSig->m_theoLst = kv.value();
-                    if (instData.key() == "awps")
-                        pSig->m_awp = kv.value();
-
-                    bool inPerArray = std::find(m_persistentArray.begin(), m_persistentArray.end(), pSig) != m_persistentArray.end();
-                    if (!inPerArray)
-                        m_persistentArray.push_back(pSig);
+                    std::string::size_type dot = key.find('.');
+                    m_pLast = m_pManager->getSignal(key.substr(0, dot).c_str());
+                    m_lastKey = key;
+                }
+                switch (field)
+                {
+                case F_Pos: m_pLast->m_pos = v; break;
+                case F_OI: m_pLast->m_oi = v; break;
+                case F_LP: m_pLast->m_theoLst = v; break;
+                case F_Awp: m_pLast->m_awp = v; break;
                 }
             }
+            void begin(int, const std::string &) {}
+            void day(int, const std::string &, int, double, double) {}
+        };
+        void json2InstArray(const char *jsonFilename)
+        {
+            // Read json data file and assemble instrument persistent array, one streaming pass
+            std::ifstream f(jsonFilename);
+            if (!f.is_open())
+                return;
+
+            CInstLoader loader;
+            loader.m_pManager = this;
+            CStateSax<CInstLoader> sax(loader);
+            json::sax_parse(f, &sax);
         }
         CSignalAE *getSignal(const char *instrumentID)
         {            
@@ -1231,6 +2764,10 @@ private:
             m_fatGap=0.0;
         }
         void update(const CMarketData *pMD)
+        {
+            updateQuote(pMD->getBidVolume(), pMD->getAskVolume(), pMD->getLastPrice(), pMD->getBidPrice(), pMD->getAskPrice(), pMD->getVolume());
+        }
+        void updateQuote(int bq, int aq, double lp, double bp, double ap, int lv)
         {
             m_LLV=m_LV;
             m_LBQ=m_BQ;
@@ -1240,13 +2777,13 @@ private:
             m_LAP=m_AP;
             m_LGAP=m_GAP;
             
-            m_BQ=pMD->getBidVolume();
-            m_AQ=pMD->getAskVolume();
-            m_LP=pMD->getLastPrice();
-            m_BP=pMD->getBidPrice();
-            m_AP=pMD->getAskPrice();
+            m_BQ=bq;
+            m_AQ=aq;
+            m_LP=lp;
+            m_BP=bp;
+            m_AP=ap;
 
-            m_LV=pMD->getVolume();
+            m_LV=lv;
             m_LQ = (m_LLV > 0 && m_LV > m_LLV) ? (m_LV - m_LLV) : 0;
 
             m_GAP = (m_BQ * m_AQ > 0) ? (m_AP - m_BP) : 0.0;
@@ -1376,7 +2913,9 @@ private:
         double m_margin;
         double m_commission;
         int m_predict;
-        std::map<int,int> m_pForceTasks;
+        std::vector<int> m_forceTaskIDs;   // taskID by workerID, -1 when the worker is not on this leg
+        int m_stateSlot = -1;              // index in the state persister
+        int m_slot = -1;                   // index in the strategy's dense instrument table
         CFutureExtentionAE(int id, IMercStrategy *pStrat, const CStratsEnvAE *pEnv,const CInstrument *pInst,CSignalAE *pSig)
             :m_id(id), m_pEnv(pEnv), m_pInstrument(pInst), m_pSignal(pSig)
         {
@@ -1388,6 +2927,7 @@ private:
             m_snapTagger = m_realTagger = 0;
             m_margin = m_commission = 0.0;
             m_predict = 0;
+            m_forceTaskIDs.assign(std::max(pEnv->m_maxWorker, 0), -1);
         }
         bool inSession(int timeStamp) { if (m_pSectionList!=NULL) { return m_pSectionList->isIn(timeStamp); } return false; }
         bool checkStaticError()
@@ -1410,6 +2950,7 @@ private:
             return m_staticError;
         }
         void updatePrice(const CMarketData *pMD) { m_pMD->update(pMD); }
+        void updatePrice(int bq, int aq, double lp, double bp, double ap, int lv) { m_pMD->updateQuote(bq, aq, lp, bp, ap, lv); }
                 
         void onBar()
         {
@@ -1434,6 +2975,7 @@ private:
         const CInstrument *pInstrument() { return m_pInstrument; }
         bool hasOrder() { return m_pMercPos->hasOrder(); }
         int mercPos() { return m_pMercPos->m_position; }
+        int pos() { return m_pSignal->m_pos; }
         double commission() { return m_commission; }
         int ED() { return m_pMD->m_expirationDate; }
         int EDC() { return m_pMD->m_expirationDayCount; }
@@ -1460,7 +3002,7 @@ private:
         double lastTheo(void) { return m_pSignal->m_theoLst; }
         CSignalAE *signalAE(void) { return m_pSignal; }
         bool staticError() { return m_staticError; }
-        void subscribeTask(int workerID,int taskID) { m_pForceTasks[workerID] = taskID; }
+        void subscribeTask(int workerID,int taskID) { if (workerID>=0 && workerID<int(m_forceTaskIDs.size())) { m_forceTaskIDs[workerID] = taskID; } }
 
         double margin()
         {
@@ -1477,13 +3019,36 @@ private:
             return marginPerLot;
         }
 
-        void unsubscribeTask(int workerID)
-        {
-            if (m_pForceTasks.find(workerID)!=m_pForceTasks.end())
-            {
-                m_pForceTasks.erase(workerID);
-            }
-        }
+        void unsubscribeTask(int workerID) { if (workerID>=0 && workerID<int(m_forceTaskIDs.size())) { m_forceTaskIDs[workerID] = -1; } }
+    };
+
+    // Hot-path stage latencies, all in ns
+    struct CStageLatency
+    {
+        CLatencyHist m_mdToDecision;    // market data arrival -> trySignal decision
+        CLatencyHist m_tickToOrder;     // market data arrival -> try order handed to host
+        CLatencyHist m_orderToAck;      // order handed to host -> first notifyOrder
+        CLatencyHist m_orderToFill;     // order handed to host -> first notifyTrade
+        void clear(void) { m_mdToDecision.clear(); m_tickToOrder.clear(); m_orderToAck.clear(); m_orderToFill.clear(); }
+    };
+
+    // TSC cycles and call count of one per-spread kernel, reset every period
+    struct CCpuCost
+    {
+        unsigned long long m_cycles;
+        unsigned long long m_calls;
+        CCpuCost() { clear(); }
+        void clear(void) { m_cycles = m_calls = 0; }
+        void add(unsigned long long cycles) { m_cycles += cycles; m_calls++; }
+        long long nanos(void) const { return CTscClock::toNanos(m_cycles); }
+        double avgNanos(void) const { return m_calls > 0 ? double(nanos()) / m_calls : 0.0; }
+    };
+    struct CSpreadCost
+    {
+        CCpuCost m_trySignal;       // whole trySignal, includes the two below
+        CCpuCost m_updateSignal;    // updateSignal, constrain 0/1 only
+        CCpuCost m_riskCheck;       // checkRiskBoundaryBreak
+        void clear(void) { m_trySignal.clear(); m_updateSignal.clear(); m_riskCheck.clear(); }
     };
 
     class CForceTask
@@ -1510,6 +3075,7 @@ private:
         unsigned m_triedCountAfterMD;
         unsigned m_errorCount;
         bool m_timeOut;
+        unsigned long long m_orderSentTsc;
         CForceTask(int id,const CStratsEnvAE *pEnv)
         {
             m_workerID=id;
@@ -1528,6 +3094,7 @@ private:
             m_expVlm=m_trdVlm=0;
             m_triedCount=m_triedCountBetweenMD=m_triedCountAfterMD=m_errorCount=0;
             m_timeOut=false;
+            m_orderSentTsc=0;
         }
         void init(int taskID)
         {
@@ -1633,6 +3200,232 @@ private:
         }
     };
 
+    class CSpreadExec;
+    // Per-order bookkeeping kept by the strategy instead of in the host order item, so host
+    // orders and replayed ones go through the same order and trade paths
+    struct COrderSlot
+    {
+        int m_orderID;
+        const CMercStrategyOrderItem *m_pItem;  // NULL when the order was not sent to the host
+        CSpreadExec *m_pExec;
+        int m_orderType;        // -1 try, >=0 force task id, -2 clear remain, -3 risk, -4 force order of a restored exec
+        int m_filledVlm;        // volume seen through notifyTrade
+        int m_tradeVlm;         // order state as last reported
+        int m_direction;
+        bool m_finished;
+        bool m_rejected;
+        bool m_restored;        // adopted after a restart: fills are taken from the order's traded volume
+        bool m_used;
+    };
+    // orderID -> order slot, open addressing over a preallocated slot array
+    class COrderTable
+    {
+    private:
+        COrderSlot m_slots[ORDER_SLOTS];
+        int m_size;
+        static unsigned mask(void) { return ORDER_SLOTS-1; }
+        static unsigned home(int orderID) { return (unsigned(orderID) * 2654435761u) & mask(); }
+        int locate(int orderID) const
+        {
+            unsigned i = home(orderID);
+            for (int n=0; n<ORDER_SLOTS; n++, i=(i+1)&mask())
+            {
+                if (!m_slots[i].m_used) return -1;
+                if (m_slots[i].m_orderID == orderID) return int(i);
+            }
+            return -1;
+        }
+    public:
+        COrderTable() { clear(); }
+        void clear(void)
+        {
+            memset(m_slots, 0, sizeof(m_slots));
+            m_size = 0;
+        }
+        int size(void) const { return m_size; }
+        // one slot stays free so a probe always ends
+        bool full(void) const { return m_size >= ORDER_SLOTS-1; }
+        bool has(int orderID) const { return locate(orderID) >= 0; }
+        COrderSlot *get(int orderID) { int i = locate(orderID); return i >= 0 ? &m_slots[i] : NULL; }
+        // returns a reset slot for the order, NULL when the table is full; erase may move slots
+        COrderSlot *put(int orderID)
+        {
+            int i = locate(orderID);
+            if (i < 0)
+            {
+                if (full()) return NULL;
+                unsigned j = home(orderID);
+                while (m_slots[j].m_used) { j = (j+1)&mask(); }
+                i = int(j);
+                m_size++;
+            }
+            COrderSlot &slot = m_slots[i];
+            memset(&slot, 0, sizeof(slot));
+            slot.m_orderID = orderID;
+            slot.m_used = true;
+            return &slot;
+        }
+        void erase(int orderID)
+        {
+            int i = locate(orderID);
+            if (i < 0) return;
+            // backward-shift deletion, keeps probe chains intact without tombstones
+            unsigned hole = i;
+            for (unsigned j=(hole+1)&mask(); m_slots[j].m_used; j=(j+1)&mask())
+            {
+                unsigned h = home(m_slots[j].m_orderID);
+                if (((j-h)&mask()) >= ((j-hole)&mask())) { m_slots[hole] = m_slots[j]; hole = j; }
+            }
+            memset(&m_slots[hole], 0, sizeof(COrderSlot));
+            m_size--;
+        }
+        COrderSlot *at(int slot) { return m_slots[slot].m_used ? &m_slots[slot] : NULL; }
+    };
+
+    // Execution layer checkpoint: one fixed record per tradable spread in a MAP_SHARED file, rewritten in
+    // place on the trading thread whenever a legging execution or one of its orders changes. A store is a
+    // copy into the page cache, so the last record survives a process crash; m_seq is odd while torn.
+    // Each record carries as many leg records as the widest tradable spread has legs
+    class CExecCheckpoint
+    {
+    public:
+        enum { K_Try = 1, K_Force, K_Clear };
+        struct COrderRef
+        {
+            int m_orderID;              // -1: none
+            int m_kind;
+            int m_filledVlm;            // volume already applied to the exec
+        };
+        struct CLegRecord
+        {
+            int m_expVlm;
+            int m_trdVlm;
+            double m_avgPrice;
+            int m_remainVlm;
+            COrderRef m_order;          // force or clear order working on the leg
+        };
+        // followed in the file by the header's m_legSlots leg records
+        struct CExecRecord
+        {
+            unsigned m_seq;
+            char m_sprdNm[96];
+            int m_processing;
+            int m_legCount;
+            int m_spreadExpVlm;
+            int m_tryLegID;
+            int m_tryExpVlm;
+            int m_tryTrdVlm;
+            double m_tryAvgPrice;
+            double m_sprdTgtPr;
+            COrderRef m_tryOrder;
+        };
+        struct CHeader
+        {
+            char m_magic[4];            // "EZEX"
+            int m_version;
+            int m_recordSize;
+            int m_count;
+            int m_tradingDay;
+            int m_legSlots;
+        };
+        struct CSavedExec
+        {
+            CExecRecord m_exec;
+            std::vector<CLegRecord> m_legs;
+        };
+        // an order of a restored exec, waiting for the host to report it again
+        struct CRestoredOrder
+        {
+            CSpreadExec *m_pExec;
+            int m_kind;
+            int m_filledVlm;
+        };
+    private:
+        char *m_pBase;
+        size_t m_size;
+        size_t m_recordSize;
+        std::string m_fileName;
+        std::string m_tmpName;
+        static size_t recordSize(int legSlots) { return sizeof(CExecRecord) + size_t(legSlots) * sizeof(CLegRecord); }
+        CExecRecord *record(int i) const { return (CExecRecord *)(m_pBase + sizeof(CHeader) + size_t(i) * m_recordSize); }
+        static CLegRecord *legs(CExecRecord *pRec) { return (CLegRecord *)(pRec + 1); }
+    public:
+        CExecCheckpoint() : m_pBase(NULL), m_size(0), m_recordSize(0) {}
+        ~CExecCheckpoint() { close(); }
+        bool isOpen(void) const { return m_pBase != NULL; }
+
+        // Copies the intact records of fileName when it was written on tradingDay; orders do not outlive the day
+        static int load(const char *fileName, int tradingDay, std::vector<CSavedExec> &records)
+        {
+            records.clear();
+            FILE *fp = fopen(fileName, "rb");
+            if (fp == NULL) return -1;
+            CHeader header;
+            int torn = 0;
+            if (fread(&header, sizeof(header), 1, fp) == 1 && memcmp(header.m_magic, "EZEX", 4) == 0 && header.m_version == 2
+                && header.m_legSlots > 0 && header.m_recordSize == int(recordSize(header.m_legSlots)) && header.m_tradingDay == tradingDay)
+            {
+                std::vector<char> buffer(header.m_recordSize);
+                CExecRecord *pRec = (CExecRecord *)buffer.data();
+                for (int i=0; i<header.m_count && fread(buffer.data(), buffer.size(), 1, fp) == 1; i++)
+                {
+                    if (pRec->m_seq & 1) { torn++; continue; }
+                    if (pRec->m_legCount < 0 || pRec->m_legCount > header.m_legSlots) continue;
+                    records.push_back({*pRec, std::vector<CLegRecord>(legs(pRec), legs(pRec) + pRec->m_legCount)});
+                }
+            }
+            fclose(fp);
+            return torn;
+        }
+        // Lays the new file out under <fileName>.tmp; publish() moves it over the old one once every record is stored
+        bool create(const std::string &fileName, int tradingDay, int count, int legSlots)
+        {
+            m_fileName = fileName;
+            m_tmpName = fileName + ".tmp";
+            m_recordSize = recordSize(legSlots);
+            m_size = sizeof(CHeader) + size_t(count) * m_recordSize;
+            int fd = ::open(m_tmpName.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+            if (fd < 0) return false;
+            if (ftruncate(fd, m_size) != 0) { ::close(fd); return false; }
+            void *pBase = mmap(NULL, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            ::close(fd);
+            if (pBase == MAP_FAILED) return false;
+            m_pBase = (char *)pBase;
+            CHeader *pHeader = (CHeader *)m_pBase;
+            memcpy(pHeader->m_magic, "EZEX", 4);
+            pHeader->m_version = 2;
+            pHeader->m_recordSize = int(m_recordSize);
+            pHeader->m_count = count;
+            pHeader->m_tradingDay = tradingDay;
+            pHeader->m_legSlots = legSlots;
+            return true;
+        }
+        bool publish(void)
+        {
+            if (msync(m_pBase, m_size, MS_SYNC) != 0) return false;
+            return rename(m_tmpName.c_str(), m_fileName.c_str()) == 0;
+        }
+        // pLegs: r.m_legCount leg records, at most the legSlots the file was created with
+        void store(int i, const CExecRecord &r, const CLegRecord *pLegs)
+        {
+            CExecRecord *pRec = record(i);
+            unsigned seq = pRec->m_seq + 1;
+            pRec->m_seq = seq;
+            std::atomic_thread_fence(std::memory_order_release);
+            memcpy((char *)pRec + sizeof(unsigned), (const char *)&r + sizeof(unsigned), sizeof(CExecRecord) - sizeof(unsigned));
+            memcpy(legs(pRec), pLegs, size_t(r.m_legCount) * sizeof(CLegRecord));
+            std::atomic_thread_fence(std::memory_order_release);
+            pRec->m_seq = seq + 1;
+        }
+        void close(void)
+        {
+            if (m_pBase == NULL) return;
+            msync(m_pBase, m_size, MS_SYNC);
+            munmap(m_pBase, m_size);
+            m_pBase = NULL;
+        }
+    };
+
     class CSpreadExec
     {
     private:
@@ -1646,7 +3439,7 @@ private:
         std::vector<double> m_exeCoefs = {};
         CFutureExtentionAE *m_pTryLeg;
         std::vector<CFutureExtentionAE *>m_pFrcLegs = {};
-        std::map<int,CForceTask*> m_pForceTasks;
+        std::vector<CForceTask *> m_pLegTasks;
 
 		double m_sprdMulti = 0.0;
 
@@ -1655,10 +3448,10 @@ private:
         int m_spreadTrdVlm;
         int m_tryExpVlm;
         int m_tryTrdVlm;
-        std::map<int, int> m_expVlmMap = {};
-        std::map<int, int> m_trdVlmMap = {};
+        std::vector<int> m_expVlms;
+        std::vector<int> m_trdVlms;
         double m_tryAvgPrice;
-        std::map<int, double> m_avgPriceMap = {};
+        std::vector<double> m_avgPrices;
         double m_spreadAvgPrice;
         double m_sprdExeAvgPr;
         double m_sprdTgtPr;
@@ -1668,7 +3461,14 @@ private:
         int m_tryOrderDirection;
         int m_tryOrderVolume;
         double m_tryOrderPrice;
-        std::map<int,int> m_remainPositions;
+        std::map<int,int> m_remainPositions;    // instRef -> volume still to trade
+        std::vector<int> m_clearOrderIDs;       // clearRemainPositions order working on the leg
+        std::vector<int> m_restoredOrderIDs;    // force order of a restored exec not finished yet; the leg is not hedged again meanwhile
+        int m_checkpointSlot;
+
+        CStageLatency m_latency;
+        unsigned long long m_decisionTsc;
+        unsigned long long m_tryOrderSentTsc;
 
         CSpreadExec(int id,const CStratsEnvAE *pEnv)
         {
@@ -1681,6 +3481,24 @@ private:
             m_tryAvgPrice=m_spreadAvgPrice=m_sprdExeAvgPr=0.0;
             m_tryOrderID=-1;
             m_sprdMulti = 0.0;
+            m_decisionTsc = m_tryOrderSentTsc = 0;
+            m_checkpointSlot = -1;
+        }
+        // per-leg state follows m_pLegs, set once when the spread is created
+        void sizeLegs()
+        {
+            int n = int(m_pLegs.size());
+            m_pFrcLegs.reserve(n);
+            m_pLegTasks.assign(n, NULL);
+            m_clearOrderIDs.assign(n, -1);
+            m_restoredOrderIDs.assign(n, -1);
+            m_expVlms.assign(n, 0);
+            m_trdVlms.assign(n, 0);
+            m_avgPrices.assign(n, 0.0);
+        }
+        void clearLegs()
+        {
+            for (int i=0; i<int(m_expVlms.size()); i++) { m_expVlms[i] = m_trdVlms[i] = 0; m_avgPrices[i] = 0.0; }
         }
         void start(int expVlm, int tryLegID)
         {
@@ -1690,6 +3508,7 @@ private:
             }
             m_spreadExpVlm = expVlm;
             m_tryLegID = tryLegID;
+            m_pFrcLegs.clear();
             for (int i=0; i<m_pLegs.size(); i++)
             {
                 if (i == m_tryLegID)
@@ -1700,9 +3519,9 @@ private:
                 else if (m_exeCoefs.at(i) != 0)
                     m_pFrcLegs.push_back(m_pLegs.at(i));
 
-                m_expVlmMap[i] = m_spreadExpVlm * m_exeCoefs.at(i);
-                m_trdVlmMap[i] = 0;
-                m_avgPriceMap[i] = 0;
+                m_expVlms[i] = m_spreadExpVlm * m_exeCoefs.at(i);
+                m_trdVlms[i] = 0;
+                m_avgPrices[i] = 0;
             }
 
             m_isProcessing = true;
@@ -1731,9 +3550,7 @@ private:
             m_spreadExpVlm=m_spreadTrdVlm=m_tryExpVlm=m_tryTrdVlm=0;
             m_tryAvgPrice=m_spreadAvgPrice=m_sprdExeAvgPr=0.0;
             m_tryOrderID=-1;
-            m_expVlmMap.clear();
-            m_trdVlmMap.clear();
-            m_avgPriceMap.clear();
+            clearLegs();
             m_isProcessing = false;
         }
         bool tryStop()
@@ -1743,12 +3560,12 @@ private:
             {
                 pendingVlmZero = pendingVlmZero && (pendingVlm(i) == 0);
                 /* // try leg must trade volume even to coef */
-                /* if (i == m_tryLegID && evnLegVlm(i, m_trdVlmMap[i]) != m_trdVlmMap[i]) */
+                /* if (i == m_tryLegID && evnLegVlm(i, m_trdVlms[i]) != m_trdVlms[i]) */
                 /*     pendingVlmZero = false; */
                 if (!pendingVlmZero)
                     g_pMercLog->log("[CSpreadExec.tryStop|FAILED]%s,pendingVlm,%d,legID,%d", m_sprdNm.c_str(), pendingVlm(i), i);
             }
-            bool tryStopRes = (m_tryOrderID<0 && pendingVlmZero && m_pForceTasks.size()==0);
+            bool tryStopRes = (m_tryOrderID<0 && pendingVlmZero && taskCount()==0 && restoredCount()==0);
             return tryStopRes;
         }
         void tryOrderSent(int orderID) { m_tryOrderID = orderID; }
@@ -1797,27 +3614,27 @@ private:
             if (m_tryTrdVlm!=0)
             {
                 m_tryAvgPrice = (m_tryAvgPrice*m_tryTrdVlm+price*volume) / (m_tryTrdVlm+volume);
-                m_avgPriceMap[m_tryLegID] = (m_avgPriceMap[m_tryLegID] * m_trdVlmMap[m_tryLegID] + price*volume) / (m_trdVlmMap[m_tryLegID] + volume);
+                m_avgPrices[m_tryLegID] = (m_avgPrices[m_tryLegID] * m_trdVlms[m_tryLegID] + price*volume) / (m_trdVlms[m_tryLegID] + volume);
             }
             else
             {
                 m_tryAvgPrice = price;
-                m_avgPriceMap[m_tryLegID] = price;
+                m_avgPrices[m_tryLegID] = price;
             }
             m_tryTrdVlm += volume;
-            m_trdVlmMap[m_tryLegID] += volume;
+            m_trdVlms[m_tryLegID] += volume;
         }
         void forceOrderTraded(int legID, int volume,double price)
         {
-            if (m_trdVlmMap[legID]!=0)
+            if (m_trdVlms[legID]!=0)
             {
-                m_avgPriceMap[legID] = (m_avgPriceMap[legID] * m_trdVlmMap[legID] + price*volume) / (m_trdVlmMap[legID] + volume);
+                m_avgPrices[legID] = (m_avgPrices[legID] * m_trdVlms[legID] + price*volume) / (m_trdVlms[legID] + volume);
             }
             else
             {
-                m_avgPriceMap[legID] = price;
+                m_avgPrices[legID] = price;
             }
-            m_trdVlmMap[legID] += volume;
+            m_trdVlms[legID] += volume;
         }
         void forceOrderFinished()
         {
@@ -1825,22 +3642,19 @@ private:
         int pendingVlm(int legID)
         {
             int tryTrdVlm2SprdVlm = calcSprdVlmCeil(m_tryLegID, m_tryTrdVlm);
-            // in case legID not trd yet
-            if (m_trdVlmMap.find(legID) == m_trdVlmMap.end())
-                m_trdVlmMap[legID] = 0;
-            return tryTrdVlm2SprdVlm * m_exeCoefs.at(legID) - m_trdVlmMap[legID];
+            return tryTrdVlm2SprdVlm * m_exeCoefs.at(legID) - m_trdVlms[legID];
         }
 
         int pendingTask(int legID)
         {
-            for (auto pFrcTask: m_pForceTasks)
-            {
-                if (pFrcTask.second->m_legID == legID)
-                {
-                    return pFrcTask.second->taskID();
-                }
-            }
-            return -1;
+            CForceTask *pTask = m_pLegTasks[legID];
+            return pTask != NULL ? pTask->taskID() : -1;
+        }
+        int taskCount()
+        {
+            int count = 0;
+            for (auto pTask: m_pLegTasks) { if (pTask != NULL) count++; }
+            return count;
         }
 
         bool isBalanced()
@@ -1850,7 +3664,7 @@ private:
                 if (m_exeCoefs.at(legID) == 0)
                     continue;
                 
-                int vlm = m_trdVlmMap[legID];
+                int vlm = m_trdVlms[legID];
                 int sprdVlm = calcSprdVlm(legID, vlm);
                 int legVlm = calcLegVlm(legID, sprdVlm);
                 if (sprdVlm != m_spreadTrdVlm || legVlm != vlm)
@@ -1866,13 +3680,13 @@ private:
             for (int i=0; i<m_pLegs.size(); i++)
             {
                 if (m_exeCoefs.at(i) != 0)
-                    m_spreadTrdVlm = std::min(m_spreadTrdVlm, abs(calcSprdVlm(i, m_trdVlmMap[i])));
+                    m_spreadTrdVlm = std::min(m_spreadTrdVlm, abs(calcSprdVlm(i, m_trdVlms[i])));
             }
             for (int i=0; i<m_pLegs.size(); i++)
             {
                 if (m_exeCoefs.at(i) != 0)
                 {
-                    m_spreadAvgPrice += m_coefs.at(i) * m_avgPriceMap[i];
+                    m_spreadAvgPrice += m_coefs.at(i) * m_avgPrices[i];
                 }
                 else
                 {
@@ -1888,7 +3702,7 @@ private:
                 }
 
                 double legMultiCoef = m_pLegs.at(i)->multiply() / m_sprdMulti;
-                m_sprdExeAvgPr += m_exeCoefs.at(i) * m_avgPriceMap[i] * legMultiCoef;
+                m_sprdExeAvgPr += m_exeCoefs.at(i) * m_avgPrices[i] * legMultiCoef;
             }
             m_spreadTrdVlm = m_spreadExpVlm < 0? -m_spreadTrdVlm: m_spreadTrdVlm;
 
@@ -1907,7 +3721,7 @@ private:
             int tgtSprdVlm = 0;
             for (int legID=0; legID<m_pLegs.size(); legID++)
             {
-                int vlm = m_trdVlmMap[legID];
+                int vlm = m_trdVlms[legID];
                 int sprdVlm = calcSprdVlmCeil(legID, vlm); 
                 if (abs(sprdVlm) > abs(tgtSprdVlm))
                 {
@@ -1917,46 +3731,133 @@ private:
 
             for (int legID=0; legID<m_pLegs.size(); legID++)
             {
-                int vlm = m_trdVlmMap[legID];
+                int vlm = m_trdVlms[legID];
                 int tgtVlm = calcLegVlm(legID, tgtSprdVlm);
-                // persist remainPositions
+                // persist remainPositions, by instrument like clearRemainPositions and its fills look them up
                 if (vlm != tgtVlm)
                 {
-                    m_remainPositions[legID] += tgtVlm - vlm;
+                    m_remainPositions[m_pLegs.at(legID)->id()] += tgtVlm - vlm;
+                }
+            }
+        }
+        void reduceRemainPositions(int instRef, int pos)
+        {
+            if (m_remainPositions.find(instRef) != m_remainPositions.end())
+            {
+                m_remainPositions[instRef] += pos;
+                if (m_remainPositions[instRef]==0)
+                {
+                    m_remainPositions.erase(instRef);
                 }
             }
         }
-        void reduceRemainPositions(int legID, int pos)
+        void clearOrderSent(int instRef, int orderID)
+        {
+            int legID = getLegId(instRef);
+            if (legID >= 0) m_clearOrderIDs[legID] = orderID;
+        }
+        // a restored clear order not reported yet is not in the host's order list for the leg
+        bool clearOrderWorking(int instRef)
+        {
+            int legID = getLegId(instRef);
+            return legID >= 0 && m_clearOrderIDs[legID] >= 0;
+        }
+        void clearOrderFinished(int orderID)
+        {
+            for (auto &clearOrderID: m_clearOrderIDs) { if (clearOrderID == orderID) clearOrderID = -1; }
+        }
+        // returns the leg the restored order worked on, -1 when it was not one
+        int restoredOrderFinished(int orderID)
+        {
+            for (int i=0; i<int(m_restoredOrderIDs.size()); i++)
+            {
+                if (m_restoredOrderIDs[i] == orderID) { m_restoredOrderIDs[i] = -1; return i; }
+            }
+            return -1;
+        }
+        int restoredCount()
+        {
+            int count = 0;
+            for (auto restoredOrderID: m_restoredOrderIDs) { if (restoredOrderID >= 0) count++; }
+            return count;
+        }
+        // Order volumes already applied are filled in by the caller, which owns the order table
+        void save(CExecCheckpoint::CExecRecord &r, CExecCheckpoint::CLegRecord *pLegs)
+        {
+            memset(&r, 0, sizeof(r));
+            memset(pLegs, 0, m_pLegs.size() * sizeof(CExecCheckpoint::CLegRecord));
+            strncpy(r.m_sprdNm, m_sprdNm.c_str(), sizeof(r.m_sprdNm)-1);
+            r.m_processing = m_isProcessing;
+            r.m_legCount = int(m_pLegs.size());
+            r.m_spreadExpVlm = m_spreadExpVlm;
+            r.m_tryLegID = m_tryLegID;
+            r.m_tryExpVlm = m_tryExpVlm;
+            r.m_tryTrdVlm = m_tryTrdVlm;
+            r.m_tryAvgPrice = m_tryAvgPrice;
+            r.m_sprdTgtPr = m_sprdTgtPr;
+            r.m_tryOrder.m_orderID = m_tryOrderID;
+            r.m_tryOrder.m_kind = CExecCheckpoint::K_Try;
+            for (int i=0; i<m_pLegs.size(); i++)
+            {
+                CExecCheckpoint::CLegRecord &leg = pLegs[i];
+                leg.m_expVlm = m_expVlms[i];
+                leg.m_trdVlm = m_trdVlms[i];
+                leg.m_avgPrice = m_avgPrices[i];
+                auto it = m_remainPositions.find(m_pLegs.at(i)->id());
+                leg.m_remainVlm = it != m_remainPositions.end() ? it->second : 0;
+                CExecCheckpoint::COrderRef &ref = leg.m_order;
+                ref.m_orderID = -1;
+                if (m_pLegTasks[i] != NULL && m_pLegTasks[i]->hasOrder()) { ref.m_orderID = m_pLegTasks[i]->orderID(); ref.m_kind = CExecCheckpoint::K_Force; }
+                else if (m_restoredOrderIDs[i] >= 0) { ref.m_orderID = m_restoredOrderIDs[i]; ref.m_kind = CExecCheckpoint::K_Force; }
+                else if (m_clearOrderIDs[i] >= 0) { ref.m_orderID = m_clearOrderIDs[i]; ref.m_kind = CExecCheckpoint::K_Clear; }
+            }
+        }
+        void restore(const CExecCheckpoint::CExecRecord &r, const CExecCheckpoint::CLegRecord *pLegs)
         {
-            if (m_remainPositions.find(legID) != m_remainPositions.end())
+            if (r.m_processing)
+            {
+                start(r.m_spreadExpVlm, r.m_tryLegID);
+                m_tryExpVlm = r.m_tryExpVlm;
+                m_tryTrdVlm = r.m_tryTrdVlm;
+                m_tryAvgPrice = r.m_tryAvgPrice;
+                m_sprdTgtPr = r.m_sprdTgtPr;
+                m_tryOrderID = r.m_tryOrder.m_orderID;
+            }
+            for (int i=0; i<m_pLegs.size(); i++)
             {
-                m_remainPositions[legID] += pos;
-                if (m_remainPositions[legID]==0)
+                const CExecCheckpoint::CLegRecord &leg = pLegs[i];
+                if (r.m_processing)
                 {
-                    m_remainPositions.erase(legID);
+                    m_expVlms[i] = leg.m_expVlm;
+                    m_trdVlms[i] = leg.m_trdVlm;
+                    m_avgPrices[i] = leg.m_avgPrice;
                 }
+                if (leg.m_remainVlm != 0) m_remainPositions[m_pLegs.at(i)->id()] = leg.m_remainVlm;
+                const CExecCheckpoint::COrderRef &ref = leg.m_order;
+                if (ref.m_orderID < 0) continue;
+                if (ref.m_kind == CExecCheckpoint::K_Force && r.m_processing) m_restoredOrderIDs[i] = ref.m_orderID;
+                else if (ref.m_kind == CExecCheckpoint::K_Clear) m_clearOrderIDs[i] = ref.m_orderID;
             }
         }
         void subscribeTask(CForceTask *pTask, int legID)
         {
-            m_expVlmMap[legID] = pTask->m_expVlm;
-            m_pForceTasks[pTask->taskID()]=pTask;
+            m_expVlms[legID] = pTask->m_expVlm;
+            m_pLegTasks[legID]=pTask;
         }
         CForceTask *getTask(int taskID)
         {
-            if (m_pForceTasks.find(taskID) != m_pForceTasks.end())
+            for (auto pTask: m_pLegTasks)
             {
-                return m_pForceTasks[taskID];
+                if (pTask != NULL && pTask->taskID() == taskID) return pTask;
             }
             return NULL;
         }
         void unsubscribeTask(int taskID)
         {
-            if (m_pForceTasks.find(taskID) != m_pForceTasks.end())
+            for (auto &pTask: m_pLegTasks)
             {
-                m_pForceTasks.erase(taskID);
+                if (pTask != NULL && pTask->taskID() == taskID) pTask = NULL;
             }
-            return;
         }
         int tryID() { return m_pTryLeg->id(); }
         int forceID(int legID) { return m_pLegs.at(legID)->id(); }
@@ -1966,6 +3867,82 @@ private:
         int spreadID() { return m_spreadID; }
     };
 
+    // Work the hot path owes but no decision waits for: status pushes, state file marks, trade-flow logs,
+    // the trigger order. A post only sets flags, so a burst coalesces into one run per item; the host's
+    // idle time drains it, or the next event once the oldest post is DeferMaxMs old
+    class CSpreadExtentionAE;
+    class CDeferredWork
+    {
+    public:
+        enum
+        {
+            DW_Risk = 1,                // refreshRiskStatus
+            DW_SyncData = 2,            // syncData
+            DW_PeriodLog = 4            // logTrds "Period" of every tradable spread
+        };
+        enum
+        {
+            DS_Signal = 1,              // model status of a spread evaluated without action
+            DS_Exec = 2,                // trade and PnL status after an execution
+            DS_Sync = 4                 // state file mark
+        };
+    private:
+        unsigned m_flags;
+        std::vector<CSpreadExtentionAE *> m_spreads;    // listed once, the pending bits are on the spread
+        std::vector<CSpreadExtentionAE *> m_draining;
+        int m_oldestTS;                                 // strategy time of the oldest pending post, -1 when none
+    public:
+        unsigned long long m_posts;
+        unsigned long long m_runs;
+        unsigned long long m_drains;
+        unsigned long long m_idleDrains;
+        long long m_maxDrainNs;
+        CDeferredWork() : m_flags(0), m_oldestTS(-1), m_posts(0), m_runs(0), m_drains(0), m_idleDrains(0), m_maxDrainNs(0) {}
+        void reserve(int spreads)
+        {
+            m_spreads.reserve(spreads);
+            m_draining.reserve(spreads);
+        }
+        bool due(int timeStamp, int maxMs) const { return m_oldestTS >= 0 && timeStamp - m_oldestTS >= maxMs; }
+        void post(unsigned flags, int timeStamp)
+        {
+            m_posts++;
+            m_flags |= flags;
+            if (m_oldestTS < 0) m_oldestTS = timeStamp;
+        }
+        void postSpread(CSpreadExtentionAE *pSpread, unsigned what, int timeStamp)
+        {
+            m_posts++;
+            if (pSpread->m_deferred == 0) m_spreads.push_back(pSpread);
+            pSpread->m_deferred |= what;
+            if (m_oldestTS < 0) m_oldestTS = timeStamp;
+        }
+        // run(flags) does the strategy-wide work, runSpread(pSpread, what) a spread's; anything posted
+        // meanwhile waits for the next drain
+        template<class F, class G> void drain(bool idle, F run, G runSpread)
+        {
+            if (m_oldestTS < 0) return;
+            long long t0 = nowNanos();
+            unsigned flags = m_flags;
+            m_flags = 0;
+            m_oldestTS = -1;
+            m_draining.swap(m_spreads);
+            for (auto pSpread: m_draining)
+            {
+                unsigned what = pSpread->m_deferred;
+                pSpread->m_deferred = 0;
+                runSpread(pSpread, what);
+                m_runs += __builtin_popcount(what);
+            }
+            m_draining.clear();
+            if (flags != 0) run(flags);
+            m_runs += __builtin_popcount(flags);
+            m_drains++;
+            if (idle) m_idleDrains++;
+            m_maxDrainNs = std::max(m_maxDrainNs, nowNanos() - t0);
+        }
+    };
+
     class CSpreadExtentionAE
     {
     private:
@@ -2015,6 +3992,16 @@ private:
         int m_stepSize;
 
         int m_sprdNmPos = 0;
+        int m_stateSlot = -1;                        // index in the state persister
+        int m_mirrorSlot = -1;                       // record in the shared-memory mirror
+        CJournal *m_pJournal = NULL;                 // state transitions between checkpoints, NULL when off
+        CDeferredWork *m_pDeferred = NULL;           // status pushes wait for idle time, NULL when off
+        bool m_legsChanged = true;                   // a leg quoted, or state moved, since the last evaluation
+        int m_triggerPos = -1;                       // index in m_sortedSpreads
+        bool m_gateArmed = false;                    // farFromGrid() may reject ticks
+        std::vector<double> m_gateLP;                // leg last prices the grid was sized with
+        std::vector<double> m_legPrices;             // scratch for loadLegPrices
+        unsigned m_deferred = 0;                     // CDeferredWork::DS_* bits pending
         double m_buy;
         double m_sell;
         double m_refBuy;
@@ -2063,7 +4050,12 @@ private:
         CMercStrategyStatus *m_pTrdStatus;
         CMercStrategyStatus *m_pPnlStatusArb;
         CMercStrategyStatus *m_pPnlStatusVw;
+        CMercStrategyStatus *m_pLatencyStatus;
+        CMercStrategyStatus *m_pCostStatus;
+        CSpreadCost m_cost;
         CMercStrategyFlow *m_pTradeFlow;
+        // single-leg risk orders go through the strategy's sendOrder so they are tracked like exec orders
+        std::function<bool(const CInstrument *, int, double, int)> m_sendRiskOrder;
 
         CSpreadExtentionAE(int id,IMercStrategy *pStrategy,const CStratsEnvAE *pEnv,CFuzzySort *pFuzzySorter)
         {
@@ -2108,6 +4100,8 @@ private:
             m_pTrdStatus=NULL;
             m_pPnlStatusArb=NULL;
             m_pPnlStatusVw=NULL;
+            m_pLatencyStatus=NULL;
+            m_pCostStatus=NULL;
             m_pTradeFlow=NULL;
         }
         void refreshPrMdlOpnStatus()
@@ -2293,6 +4287,61 @@ private:
             m_pSprdIdxStatus->IntValue[0] = m_id;
             m_pStrategy->refreshStrategyStatus(m_pSprdIdxStatus);
         }
+        void refreshLatencyStatus()
+        {
+            if (m_pLatencyStatus==NULL)
+            {
+                int idxCoef = 10000;
+                int leaderID = m_pLegs.size() > 0? m_pLegs.at(0)->id(): -1;
+                int laggerID = (m_pLegs.size() > 1? m_pLegs.at(1)->id(): -1) * idxCoef;
+                for (int i=2; i<m_pLegs.size(); i++) { idxCoef *= 10; laggerID += m_pLegs.at(i)->id() * idxCoef; }
+                m_pLatencyStatus=m_pStrategy->createStrategyStatus(16, leaderID, laggerID);
+            }
+            // microseconds
+            const CStageLatency &lat = m_pSpreadExec->m_latency;
+            m_pLatencyStatus->IntValue[0] = int(lat.m_tickToOrder.percentile(0.5) / 1000);
+            m_pLatencyStatus->IntValue[1] = int(lat.m_tickToOrder.percentile(0.99) / 1000);
+            m_pLatencyStatus->IntValue[2] = int(lat.m_orderToFill.percentile(0.5) / 1000);
+            m_pLatencyStatus->IntValue[3] = int(lat.m_orderToFill.percentile(0.99) / 1000);
+            m_pLatencyStatus->FloatValue[0] = lat.m_orderToAck.percentile(0.5) / 1000.0;
+            m_pLatencyStatus->FloatValue[1] = lat.m_orderToAck.percentile(0.99) / 1000.0;
+            m_pStrategy->refreshStrategyStatus(m_pLatencyStatus);
+        }
+        void refreshCostStatus(unsigned long long totalCycles=0)
+        {
+            if (m_pCostStatus==NULL)
+            {
+                int idxCoef = 10000;
+                int leaderID = m_pLegs.size() > 0? m_pLegs.at(0)->id(): -1;
+                int laggerID = (m_pLegs.size() > 1? m_pLegs.at(1)->id(): -1) * idxCoef;
+                for (int i=2; i<m_pLegs.size(); i++) { idxCoef *= 10; laggerID += m_pLegs.at(i)->id() * idxCoef; }
+                m_pCostStatus=m_pStrategy->createStrategyStatus(17, leaderID, laggerID);
+            }
+            m_pCostStatus->IntValue[0] = int(m_cost.m_trySignal.m_calls);
+            m_pCostStatus->IntValue[1] = int(m_cost.m_trySignal.nanos() / 1000);
+            m_pCostStatus->IntValue[2] = int(m_cost.m_updateSignal.avgNanos());
+            m_pCostStatus->IntValue[3] = int(m_cost.m_riskCheck.avgNanos());
+            m_pCostStatus->FloatValue[0] = m_cost.m_trySignal.avgNanos();
+            m_pCostStatus->FloatValue[1] = totalCycles > 0 ? 100.0 * m_cost.m_trySignal.m_cycles / totalCycles : 0.0;
+            m_pStrategy->refreshStrategyStatus(m_pCostStatus);
+        }
+        void refreshSignalStatus()
+        {
+            refreshPrMdlOpnStatus();
+            refreshPrMdlClsStatus();
+            refreshPrMdlParamStatus();
+            refreshPrMdlParamTicStatus();
+            refreshEMAStatus();
+            refreshSprdIdxStatus();
+            refreshMDStatus();
+            refreshBollStatus();
+        }
+        void refreshExecStatus()
+        {
+            refreshBollStatus();
+            refreshTrdStatus();
+            refreshPnlStatus();
+        }
         void refreshAllStatus()
         {
             refreshPrMdlOpnStatus();
@@ -2305,6 +4354,10 @@ private:
             refreshBollStatus();
             refreshTrdStatus();
             refreshPnlStatus();
+#if TSC
+            refreshLatencyStatus();
+#endif
+            if (m_pEnv->m_cpuCost > 0) refreshCostStatus();
         }
         void refreshTrdFlow(int volume,double price,int timeStamp)
         {
@@ -2353,6 +4406,9 @@ private:
             m_pSpreadExec->m_pLegs = m_pLegs;
             m_pSpreadExec->m_coefs = m_coefs;
             m_pSpreadExec->m_exeCoefs = exeCoefs;
+            m_pSpreadExec->sizeLegs();
+            m_gateLP.assign(m_pLegs.size(), 0.0);
+            m_legPrices.assign(m_pLegs.size(), 0.0);
 
             m_sprdMulti = 0.0;
             for (int i=0; i<pLegs.size(); i++)
@@ -2426,6 +4482,7 @@ private:
         void finishComb(CSpreadSignal *pSignal)
         {
             m_pSignal = pSignal;
+            m_pSignal->sizeLegs(int(m_pLegs.size()));
             syncSig2Obj();
             adjMaxAmt();
             adjustPositionLimit(m_manSprdMaxLot);
@@ -2516,16 +4573,65 @@ private:
             return m_spAvg;
         }
 
-        bool isReadyToTrade()
+        // After an evaluation without action, and only where the next one could at most act on a grid
+        // crossing: not squeezing or clearing, not in risk mode, the bar spread inside the risk bounds
+        void armGate(int constrain)
         {
-            double GAP = 0.0;
+            m_gateArmed = std::max(m_selfConstrain, constrain) <= 1 && !m_pSignal->m_inRiskMode
+                && m_spAvg <= m_riskUpper && m_spAvg >= m_riskLower && isReadyToTrade();
+            if (!m_gateArmed) return;
+            for (int i=0; i<m_pLegs.size(); i++) m_gateLP[i] = m_pLegs[i]->LP();
+        }
+        // The spread bid and ask as updatePrice sums them, against m_buy/m_sell of the last evaluation:
+        // true when neither side reaches the grid. The grid is sized on leg last prices, so a changed LP
+        // means a full evaluation. A rejected tick still refreshes the signal's spread quote in session,
+        // as updatePrice would: it is persisted and published in the MD status
+        bool farFromGrid(int timeStamp)
+        {
+            if (!m_gateArmed) return false;
+            double bp = 0.0;
+            double ap = 0.0;
+            int bq = INT_MAX;
+            int aq = INT_MAX;
             for (int i=0; i<m_pLegs.size(); i++)
             {
-                if (!m_pLegs.at(i)->m_pMD->isReadyToTrade())
-                    return false;
-                GAP += m_pLegs.at(i)->GAP();
-            }
-
+                CFutureExtentionAE *pLeg = m_pLegs[i];
+                if (pLeg->LP() != m_gateLP[i]) return false;
+                if (m_coefs[i] > 0)
+                {
+                    bp += m_coefs[i] * pLeg->BP();
+                    ap += m_coefs[i] * pLeg->AP();
+                    bq = std::min(bq, pLeg->BQ());
+                    aq = std::min(aq, pLeg->AQ());
+                }
+                else
+                {
+                    bp += m_coefs[i] * pLeg->AP();
+                    ap += m_coefs[i] * pLeg->BP();
+                    bq = std::min(bq, pLeg->AQ());
+                    aq = std::min(aq, pLeg->BQ());
+                }
+            }
+            if (bp >= m_sell || ap <= m_buy) return false;
+            if (inSession(timeStamp))
+            {
+                m_pSignal->m_sprdBP = bp;
+                m_pSignal->m_sprdAP = ap;
+                m_pSignal->m_sprdBQ = bq;
+                m_pSignal->m_sprdAQ = aq;
+            }
+            return true;
+        }
+        bool isReadyToTrade()
+        {
+            double GAP = 0.0;
+            for (int i=0; i<m_pLegs.size(); i++)
+            {
+                if (!m_pLegs.at(i)->m_pMD->isReadyToTrade())
+                    return false;
+                GAP += m_pLegs.at(i)->GAP();
+            }
+
             // TODO TODO TODO how to add back?
             /* if (GAP > m_gapThreshold) */
             /* { */
@@ -2655,6 +4761,22 @@ private:
             }
         }
         int trySignal(int constrain,int timeStamp, bool &toSyncData)
+        {
+            if (m_pEnv->m_cpuCost <= 0) return internalTrySignal(constrain, timeStamp, toSyncData);
+            unsigned long long tsc = readTsc();
+            int act = internalTrySignal(constrain, timeStamp, toSyncData);
+            m_cost.m_trySignal.add(readTsc() - tsc);
+            return act;
+        }
+        int timedUpdateSignal(bool &toSyncData, bool closeOnly)
+        {
+            if (m_pEnv->m_cpuCost <= 0) return updateSignal(toSyncData, closeOnly);
+            unsigned long long tsc = readTsc();
+            int act = updateSignal(toSyncData, closeOnly);
+            m_cost.m_updateSignal.add(readTsc() - tsc);
+            return act;
+        }
+        int internalTrySignal(int constrain,int timeStamp, bool &toSyncData)
         {
             updatePrice(timeStamp);
             constrain = std::max(m_selfConstrain,constrain);
@@ -2665,17 +4787,26 @@ private:
             if (constrain == 0)
             {
                 double currentSpread = m_spAvg;
-                checkRiskBoundaryBreak(currentSpread, timeStamp);
+                if (m_pEnv->m_cpuCost > 0)
+                {
+                    unsigned long long tsc = readTsc();
+                    checkRiskBoundaryBreak(currentSpread, timeStamp);
+                    m_cost.m_riskCheck.add(readTsc() - tsc);
+                }
+                else
+                {
+                    checkRiskBoundaryBreak(currentSpread, timeStamp);
+                }
             }
             
             int act = 0;
             switch (constrain)
             {
             case 0:
-                act = updateSignal(toSyncData, false);
+                act = timedUpdateSignal(toSyncData, false);
                 break;
             case 1:
-                act = updateSignal(toSyncData, true);
+                act = timedUpdateSignal(toSyncData, true);
                 break;
             case 2:
                 act = squeezeSignal(timeStamp);
@@ -2701,14 +4832,8 @@ private:
             if (act > 0 && isSafeToBuy()) return act;
             else if (act < 0 && isSafeToSell()) return act;
 
-            refreshPrMdlOpnStatus();
-            refreshPrMdlClsStatus();
-            refreshPrMdlParamStatus();
-            refreshPrMdlParamTicStatus();
-            refreshEMAStatus();
-            refreshSprdIdxStatus();
-            refreshMDStatus();
-            refreshBollStatus();
+            if (m_pDeferred != NULL) m_pDeferred->postSpread(this, CDeferredWork::DS_Signal, timeStamp);
+            else refreshSignalStatus();
             return 0;
         }
         
@@ -2717,9 +4842,9 @@ private:
             return (val > 0) ? 1 : ((val < 0) ? -1 : 0);
         }
         
-        std::string identifyLosingLeg(double spreadMom, const std::vector<double>& legPricesAtStart, const std::vector<double>& currentLegPrices)
+        const char *identifyLosingLeg(double spreadMom, const double *legPricesAtStart, const double *currentLegPrices, int legCount)
         {
-            if (m_pLegs.size() < 2 || legPricesAtStart.size() < 2 || currentLegPrices.size() < 2)
+            if (m_pLegs.size() < 2 || legCount < 2)
             {
                 return "";
             }
@@ -2732,7 +4857,7 @@ private:
             int hedgeSign = hedgeMom > 0 ? 1 : (hedgeMom < 0 ? -1 : 0);
             int spreadSign = spreadMom > 0 ? 1 : (spreadMom < 0 ? -1 : 0);
             
-            std::string losingLeg = "";
+            const char *losingLeg = "";
             
             // Logic from Python to identify losing leg
             if (baseSign == hedgeSign)
@@ -2773,7 +4898,7 @@ private:
             }
             
             g_pMercLog->log("[identifyLosingLeg],%s,baseMom,%g,hedgeMom,%g,spreadMom,%g,baseSign,%d,hedgeSign,%d,spreadSign,%d,losingLeg,%s",
-                m_sprdNm.c_str(), baseMom, hedgeMom, spreadMom, baseSign, hedgeSign, spreadSign, losingLeg.c_str());
+                m_sprdNm.c_str(), baseMom, hedgeMom, spreadMom, baseSign, hedgeSign, spreadSign, losingLeg);
             
             return losingLeg;
         }
@@ -2794,17 +4919,14 @@ private:
                     m_pSignal->m_centerAtRiskStart = center;
                     
                     // Store current leg prices
-                    m_pSignal->m_legPricesAtRiskStart.clear();
-                    for (auto pLeg : m_pLegs)
-                    {
-                        m_pSignal->m_legPricesAtRiskStart.push_back(pLeg->LP());
-                    }
+                    storeRiskStartPrices();
                     
                     g_pMercLog->log("[checkRiskBoundaryBreak],%s,UPPER_BREAK,spread,%g,riskUpper,%g,center,%g",
                         m_sprdNm.c_str(), currentSpread, m_riskUpper, center);
                     
                     // Trigger position reduction
                     reduceLosingLegPosition(currentSpread, timeStamp);
+                    if (m_pJournal != NULL) journalRisk(currentSpread, timeStamp);
                 }
                 else if (currentSpread < m_riskLower)
                 {
@@ -2815,17 +4937,14 @@ private:
                     m_pSignal->m_centerAtRiskStart = center;
                     
                     // Store current leg prices
-                    m_pSignal->m_legPricesAtRiskStart.clear();
-                    for (auto pLeg : m_pLegs)
-                    {
-                        m_pSignal->m_legPricesAtRiskStart.push_back(pLeg->LP());
-                    }
+                    storeRiskStartPrices();
                     
                     g_pMercLog->log("[checkRiskBoundaryBreak],%s,LOWER_BREAK,spread,%g,riskLower,%g,center,%g",
                         m_sprdNm.c_str(), currentSpread, m_riskLower, center);
                     
                     // Trigger position reduction
                     reduceLosingLegPosition(currentSpread, timeStamp);
+                    if (m_pJournal != NULL) journalRisk(currentSpread, timeStamp);
                 }
             }
             else
@@ -2835,9 +4954,24 @@ private:
             }
         }
         
+        void storeRiskStartPrices()
+        {
+            m_pSignal->m_riskLegCount = int(m_pLegs.size());
+            for (int i=0; i<m_pSignal->m_riskLegCount; i++)
+            {
+                m_pSignal->m_legPricesAtRiskStart[i] = m_pLegs[i]->LP();
+            }
+        }
+        int loadLegPrices(double *legPrices)
+        {
+            int legCount = int(m_pLegs.size());
+            for (int i=0; i<legCount; i++) { legPrices[i] = m_pLegs[i]->LP(); }
+            return legCount;
+        }
+        
         void reduceLosingLegPosition(double currentSpread, int timeStamp)
         {
-            if (m_pLegs.size() < 2 || m_pSignal->m_legPricesAtRiskStart.empty())
+            if (m_pLegs.size() < 2 || m_pSignal->m_riskLegCount == 0)
             {
                 return;
             }
@@ -2845,16 +4979,12 @@ private:
             // Calculate momentum
             double spreadMom = currentSpread - m_pSignal->m_centerAtRiskStart;
             
-            std::vector<double> currentLegPrices;
-            for (auto pLeg : m_pLegs)
-            {
-                currentLegPrices.push_back(pLeg->LP());
-            }
+            int legCount = std::min(loadLegPrices(m_legPrices.data()), m_pSignal->m_riskLegCount);
             
             // Identify losing leg
-            std::string losingLeg = identifyLosingLeg(spreadMom, m_pSignal->m_legPricesAtRiskStart, currentLegPrices);
+            const char *losingLeg = identifyLosingLeg(spreadMom, m_pSignal->m_legPricesAtRiskStart.data(), m_legPrices.data(), legCount);
             
-            if (losingLeg.empty())
+            if (losingLeg[0] == '\0')
             {
                 return;
             }
@@ -2862,7 +4992,7 @@ private:
             m_pSignal->m_reducedLeg = losingLeg;
             
             // Calculate how much to reduce
-            int legIndex = (losingLeg == "base") ? 0 : 1;
+            int legIndex = (strcmp(losingLeg, "base") == 0) ? 0 : 1;
             CFutureExtentionAE* pLeg = m_pLegs[legIndex];
             
             // Get current position of this leg
@@ -2910,31 +5040,18 @@ private:
                 
                 // Send order through the strategy's order system
                 // This creates a single-leg order (not a spread)
-                CInputOrder inputOrder;
-                inputOrder.setOrderType(ODT_Limit);
-                inputOrder.setDirection(orderDirection);
-                inputOrder.setPrice(orderPrice);
-                inputOrder.setOrderVolume(orderVolume);
-                
-                const CMercStrategyOrderItem *pOrderItem = m_pStrategy->controledInsertOrder(
-                    &inputOrder, 
-                    pLeg->pInstrument(), 
-                    m_pStrategy->getAccountManager(),
-                    m_pEnv->m_offsetStrategy
-                );
-                
-                if (pOrderItem != NULL)
+                if (m_sendRiskOrder(pLeg->pInstrument(), orderDirection, orderPrice, orderVolume))
                 {
                     // Track this as a risk management position
                     m_pSignal->m_riskPos += reduceDirection * orderVolume;
                     
                     g_pMercLog->log("[reduceLosingLegPosition],%s,ORDER_SENT,losingLeg,%s,legPos,%d,orderVolume,%d,orderDirection,%d,orderPrice,%g,riskPos,%d",
-                        m_sprdNm.c_str(), losingLeg.c_str(), legPos, orderVolume, orderDirection, orderPrice, m_pSignal->m_riskPos);
+                        m_sprdNm.c_str(), losingLeg, legPos, orderVolume, orderDirection, orderPrice, m_pSignal->m_riskPos);
                 }
                 else
                 {
                     g_pMercLog->log("[reduceLosingLegPosition],%s,ORDER_FAILED,losingLeg,%s,legPos,%d,orderVolume,%d",
-                        m_sprdNm.c_str(), losingLeg.c_str(), legPos, orderVolume);
+                        m_sprdNm.c_str(), losingLeg, legPos, orderVolume);
                 }
             }
         }
@@ -3017,20 +5134,7 @@ private:
                     }
                     
                     // Send order to restore position
-                    CInputOrder inputOrder;
-                    inputOrder.setOrderType(ODT_Limit);
-                    inputOrder.setDirection(orderDirection);
-                    inputOrder.setPrice(orderPrice);
-                    inputOrder.setOrderVolume(orderVolume);
-                    
-                    const CMercStrategyOrderItem *pOrderItem = m_pStrategy->controledInsertOrder(
-                        &inputOrder, 
-                        pLeg->pInstrument(), 
-                        m_pStrategy->getAccountManager(),
-                        m_pEnv->m_offsetStrategy
-                    );
-                    
-                    if (pOrderItem != NULL)
+                    if (m_sendRiskOrder(pLeg->pInstrument(), orderDirection, orderPrice, orderVolume))
                     {
                         // Update risk position tracking
                         m_pSignal->m_riskPos += signedSupplement;
@@ -3051,6 +5155,7 @@ private:
                 m_pSignal->m_reducedAmount = 0.0;
                 m_pSignal->m_reducedDirection = 0;
                 m_pSignal->m_breakDirection = 0;
+                if (m_pJournal != NULL) journalRisk(currentSpread, timeStamp);
             }
         }
 
@@ -3129,8 +5234,9 @@ private:
             // Update current day tracking
             if (m_pSignal->m_currentDay != tradingDay)
             {
-                // New day - save previous day's high/low
-                if (m_pSignal->m_currentDay > 0)
+                // New day - save previous day's high/low, unless a restart already stored it
+                bool stored = !m_pSignal->m_dailyHighLows.empty() && m_pSignal->m_dailyHighLows.back().tradingDay == m_pSignal->m_currentDay;
+                if (m_pSignal->m_currentDay > 0 && !stored)
                 {
                     CDailyHighLow dayData(m_pSignal->m_currentDay, 
                                          m_pSignal->m_currentDayHigh, 
@@ -3142,6 +5248,7 @@ private:
                     {
                         m_pSignal->m_dailyHighLows.pop_front();
                     }
+                    m_pSignal->m_historyVersion++;
                 }
                 
                 // Reset for new day
@@ -3313,6 +5420,7 @@ private:
             g_pMercLog->log("[updateBoundariesAndGrids],%s,ProfitRateLong,%g,ProfitRateShort,%g,DynFactorLong,%g,DynFactorShort,%g",
                 m_sprdNm.c_str(), profitableRateLong, profitableRateShort,
                 m_pSignal->m_dynamicFactorLong, m_pSignal->m_dynamicFactorShort);
+            if (m_pJournal != NULL) journalDynFactor(m_pStrategy->getCurTimeStamp());
             
             // Recalculate grids with new factors
             double equityPerSet = 0.0;
@@ -3578,16 +5686,11 @@ private:
             if (isOpening)
             {
                 // Store leg prices at entry for risk management
-                std::vector<double> legPricesAtEntry;
-                for (auto pLeg : m_pLegs)
-                {
-                    legPricesAtEntry.push_back(pLeg->LP());
-                }
+                int legCount = loadLegPrices(m_legPrices.data());
                 
                 // Add to open positions list with leg prices
                 int direction = spreadTrdVolume > 0 ? 1 : -1;
-                COpenPosition newPos(spreadTrdPrice, direction, spreadExePrice, legPricesAtEntry);
-                m_pSignal->m_openPositions.push_back(newPos);
+                m_pSignal->openPosition(spreadTrdPrice, direction, spreadExePrice, m_legPrices.data());
                 
                 if (spreadTrdVolume > 0)
                 {
@@ -3598,8 +5701,8 @@ private:
                     m_pSignal->m_numOpensShort++;
                 }
                 
-                g_pMercLog->log("[notifyExecFinished],%s,OPEN,vol,%d,entryPrice,%g,spread,%g,legPricesCount,%lu",
-                    m_sprdNm.c_str(), spreadTrdVolume, spreadTrdPrice, spreadExePrice, legPricesAtEntry.size());
+                g_pMercLog->log("[notifyExecFinished],%s,OPEN,vol,%d,entryPrice,%g,spread,%g,legPricesCount,%d",
+                    m_sprdNm.c_str(), spreadTrdVolume, spreadTrdPrice, spreadExePrice, legCount);
             }
             
             if (isClosing)
@@ -3617,14 +5720,7 @@ private:
                     }
                     
                     // Remove oldest long position
-                    for (auto it = m_pSignal->m_openPositions.begin(); it != m_pSignal->m_openPositions.end(); ++it)
-                    {
-                        if (it->direction == 1)
-                        {
-                            m_pSignal->m_openPositions.erase(it);
-                            break;
-                        }
-                    }
+                    m_pSignal->closePosition(1);
                 }
                 else if (prevPos < 0 && spreadTrdVolume > 0)
                 {
@@ -3637,14 +5733,7 @@ private:
                     }
                     
                     // Remove oldest short position
-                    for (auto it = m_pSignal->m_openPositions.begin(); it != m_pSignal->m_openPositions.end(); ++it)
-                    {
-                        if (it->direction == -1)
-                        {
-                            m_pSignal->m_openPositions.erase(it);
-                            break;
-                        }
-                    }
+                    m_pSignal->closePosition(-1);
                 }
                 
                 g_pMercLog->log("[notifyExecFinished],%s,CLOSE,vol,%d,pnl,%g,openPosCount,%lu",
@@ -3652,13 +5741,55 @@ private:
             }
             
             refreshPos();
+            if (m_pJournal != NULL) journalExec(spreadTrdVolume, spreadTrdPrice, spreadExePrice, prevPos, isOpening ? 1 : (isClosing ? -1 : 0), timeStamp);
 
             internalConstrain();
-            refreshBollStatus();
-            refreshTrdStatus();
-            refreshPnlStatus();
+            if (m_pDeferred != NULL) m_pDeferred->postSpread(this, CDeferredWork::DS_Exec, timeStamp);
+            else refreshExecStatus();
             refreshTrdFlow(spreadTrdVolume,spreadExePrice,timeStamp);
         }
+        void journalExec(int volume, double price, double exePr, int prevPos, int kind, int timeStamp)
+        {
+            CJournal::CRecord r;
+            CJournal::init(r, CJournal::RT_Exec, timeStamp, m_sprdNm.c_str());
+            r.m_i[0] = volume;
+            r.m_i[1] = prevPos;
+            r.m_i[2] = kind;
+            r.m_i[3] = m_pSignal->m_pos;
+            r.m_i[4] = m_pSignal->m_numOpensLong;
+            r.m_i[5] = m_pSignal->m_numOpensShort;
+            r.m_i[6] = m_pSignal->m_profitableClosesLong;
+            r.m_i[7] = m_pSignal->m_profitableClosesShort;
+            r.m_d[0] = price;
+            r.m_d[1] = exePr;
+            r.m_d[2] = m_pSignal->m_atp;
+            r.m_d[3] = m_pSignal->m_dnPnl;
+            r.m_d[4] = m_pSignal->m_diPnl;
+            r.m_d[5] = m_pSignal->m_pnl;
+            m_pJournal->append(r);
+        }
+        void journalDynFactor(int timeStamp)
+        {
+            CJournal::CRecord r;
+            CJournal::init(r, CJournal::RT_DynFactor, timeStamp, m_sprdNm.c_str());
+            r.m_d[0] = m_pSignal->m_dynamicFactorLong;
+            r.m_d[1] = m_pSignal->m_dynamicFactorShort;
+            m_pJournal->append(r);
+        }
+        void journalRisk(double currentSpread, int timeStamp)
+        {
+            CJournal::CRecord r;
+            CJournal::init(r, CJournal::RT_Risk, timeStamp, m_sprdNm.c_str());
+            strncpy(r.m_tag, m_pSignal->m_reducedLeg.c_str(), sizeof(r.m_tag)-1);
+            r.m_i[0] = m_pSignal->m_inRiskMode;
+            r.m_i[1] = m_pSignal->m_breakDirection;
+            r.m_i[2] = m_pSignal->m_reducedDirection;
+            r.m_i[3] = m_pSignal->m_arbitragePos;
+            r.m_i[4] = m_pSignal->m_riskPos;
+            r.m_d[0] = currentSpread;
+            r.m_d[1] = m_pSignal->m_reducedAmount;
+            m_pJournal->append(r);
+        }
         void notifyOpenTrade(int volume, double price, double exePr)
         {
             if (m_pSignal->m_pos + volume == 0)
@@ -3683,6 +5814,673 @@ private:
         }
         void logDetail() { g_pMercLog->log("%d,%s,signal %d,selfConstrain %d", m_id, m_sprdNm.c_str(), m_pos, m_selfConstrain); }
     };
+
+    // Background writer of the state file. The trading thread copies the persisted fields of a changed
+    // spread and its legs into pending records; the writer patches only those entries of its cached
+    // document and replaces the file by writing a temp file and renaming it over the old one.
+    // With a snapshot open, the same records are also patched in place into <file>.snap. The daily
+    // high/low history is cold: one file per spread under <file>.hist, rewritten only after a day roll
+    class CStatePersister
+    {
+    public:
+        typedef CStateSnapshot::CInstState CInstState;
+        typedef CStateSnapshot::CSpreadState CSpreadState;
+        std::atomic<unsigned long long> m_writes;
+        std::atomic<unsigned long long> m_failures;
+        std::atomic<unsigned long long> m_lastBytes;
+        std::atomic<long long> m_maxWriteNs;
+        std::atomic<unsigned long long> m_historyWrites;
+    private:
+        std::string m_fileName;
+        std::string m_tmpName;
+        std::string m_histDir;
+        int m_intervalMs;
+        std::vector<CFutureExtentionAE *> m_pInsts;
+        std::vector<CSpreadExtentionAE *> m_pSprds;
+        std::vector<std::string> m_instKeys;
+        std::vector<std::string> m_sprdNms;
+        std::vector<std::string> m_trdSprdNms;
+        // pending side, guarded by m_lock
+        std::vector<CInstState> m_instPending;
+        std::vector<CSpreadState> m_sprdPending;
+        std::vector<std::vector<CDailyHighLow> > m_historyPending;
+        std::vector<unsigned char> m_historyChanged;
+        std::vector<int> m_historyVersion;
+        std::vector<unsigned char> m_instDirty;
+        std::vector<unsigned char> m_sprdDirty;
+        std::vector<int> m_instDirtyList;
+        std::vector<int> m_sprdDirtyList;
+        // writer side, guarded by m_flushLock
+        std::vector<CInstState> m_instShadow;
+        std::vector<CSpreadState> m_sprdShadow;
+        std::vector<std::vector<CDailyHighLow> > m_historyShadow;
+        std::vector<int> m_instFlushList;
+        std::vector<int> m_sprdFlushList;
+        std::vector<unsigned char> m_historyFlush;
+        unsigned long long m_journalSeqPending;
+        unsigned long long m_journalSeqShadow;
+        bool m_lastFlushOk;
+        json m_doc;
+        bool m_built;
+        CStateSnapshot m_snapshot;
+        std::mutex m_lock;
+        std::mutex m_flushLock;
+        std::atomic<bool> m_running;
+        std::thread m_writer;
+
+        void writerLoop(void)
+        {
+            while (m_running.load(std::memory_order_acquire))
+            {
+                for (int ms=0; ms<m_intervalMs && m_running.load(std::memory_order_relaxed); ms++) usleep(1000);
+                flush();
+            }
+        }
+        void captureInst(CFutureExtentionAE *pInst)
+        {
+            const int i = pInst->m_stateSlot;
+            CInstState &s = m_instPending[i];
+            s.m_preOI = pInst->preOI();
+            s.m_LP = pInst->LP();
+            s.m_theoLst = pInst->m_pSignal->m_theoLst;
+            s.m_pos = pInst->m_pSignal->m_pos;
+            if (!m_instDirty[i]) { m_instDirty[i] = 1; m_instDirtyList.push_back(i); }
+        }
+        void captureSpread(CSpreadExtentionAE *pSprd)
+        {
+            const int i = pSprd->m_stateSlot;
+            const CSpreadSignal *pSig = pSprd->m_pSignal;
+            CSpreadState &s = m_sprdPending[i];
+            s.m_pos = pSig->m_pos;
+            s.m_ttlMrgn = pSprd->m_ttlMrgn;
+            s.m_refMid = pSig->m_refMid;
+            s.m_sprdMaxLot = pSig->m_sprdMaxLot;
+            s.m_stepSize = pSig->m_stepSize;
+            s.m_awp = pSig->m_awp;
+            s.m_sprdAP = pSig->m_sprdAP;
+            s.m_sprdBP = pSig->m_sprdBP;
+            s.m_sprdAQ = pSig->m_sprdAQ;
+            s.m_sprdBQ = pSig->m_sprdBQ;
+            s.m_buy = pSprd->m_buy;
+            s.m_sell = pSprd->m_sell;
+            s.m_atp = pSig->m_atp;
+            s.m_diPnl = pSig->m_diPnl;
+            s.m_dnPnl = pSig->m_dnPnl;
+            s.m_pnl = pSig->m_pnl;
+            s.m_dynamicFactorLong = pSig->m_dynamicFactorLong;
+            s.m_dynamicFactorShort = pSig->m_dynamicFactorShort;
+            s.m_numOpensLong = pSig->m_numOpensLong;
+            s.m_numOpensShort = pSig->m_numOpensShort;
+            s.m_profitableClosesLong = pSig->m_profitableClosesLong;
+            s.m_profitableClosesShort = pSig->m_profitableClosesShort;
+            s.m_inRiskMode = pSig->m_inRiskMode;
+            strcpySafe(s.m_reducedLeg, pSig->m_reducedLeg.c_str());
+            s.m_reducedAmount = pSig->m_reducedAmount;
+            s.m_reducedDirection = pSig->m_reducedDirection;
+            s.m_arbitragePos = pSig->m_arbitragePos;
+            s.m_riskPos = pSig->m_riskPos;
+            s.m_currentDay = pSig->m_currentDay;
+            s.m_currentDayHigh = pSig->m_currentDayHigh;
+            s.m_currentDayLow = pSig->m_currentDayLow;
+            // the history only moves at a day roll, copy it then and not on every tick
+            if (m_historyVersion[i] != pSig->m_historyVersion)
+            {
+                m_historyPending[i].assign(pSig->m_dailyHighLows.begin(), pSig->m_dailyHighLows.end());
+                m_historyVersion[i] = pSig->m_historyVersion;
+                m_historyChanged[i] = 1;
+            }
+            if (!m_sprdDirty[i]) { m_sprdDirty[i] = 1; m_sprdDirtyList.push_back(i); }
+        }
+        void patchInst(int i)
+        {
+            const CInstState &s = m_instShadow[i];
+            const std::string &instKey = m_instKeys[i];
+            m_doc["ois"][instKey] = s.m_preOI;
+            m_doc["lps"][instKey] = s.m_LP;
+            m_doc["awps"][instKey] = s.m_theoLst;
+            m_doc["inst_poss"][instKey] = s.m_pos;
+        }
+        void patchSpread(int i)
+        {
+            const CSpreadState &s = m_sprdShadow[i];
+            const std::string &sprdNm = m_sprdNms[i];
+            m_doc["sprd_poss"][sprdNm] = s.m_pos;
+            m_doc["mrgns"][sprdNm] = s.m_ttlMrgn;
+            m_doc["ref_mids"][sprdNm] = s.m_refMid;
+            m_doc["sprd_max_lots"][sprdNm] = s.m_sprdMaxLot;
+            m_doc["step_sizes"][sprdNm] = s.m_stepSize;
+            m_doc["awps"][sprdNm] = s.m_awp;
+            m_doc["sprd_aps"][sprdNm] = s.m_sprdAP;
+            m_doc["sprd_bps"][sprdNm] = s.m_sprdBP;
+            m_doc["sprd_aqs"][sprdNm] = s.m_sprdAQ;
+            m_doc["sprd_bqs"][sprdNm] = s.m_sprdBQ;
+            m_doc["theo_bids"][sprdNm] = s.m_buy;
+            m_doc["theo_asks"][sprdNm] = s.m_sell;
+            m_doc["atps"][sprdNm] = s.m_atp;
+            m_doc["di_pnls"][sprdNm] = s.m_diPnl;
+            m_doc["dn_pnls"][sprdNm] = s.m_dnPnl;
+            m_doc["pnls"][sprdNm] = s.m_pnl;
+
+            // Persist dynamic grid state
+            m_doc["dynamic_factor_long"][sprdNm] = s.m_dynamicFactorLong;
+            m_doc["dynamic_factor_short"][sprdNm] = s.m_dynamicFactorShort;
+            m_doc["num_opens_long"][sprdNm] = s.m_numOpensLong;
+            m_doc["num_opens_short"][sprdNm] = s.m_numOpensShort;
+            m_doc["profitable_closes_long"][sprdNm] = s.m_profitableClosesLong;
+            m_doc["profitable_closes_short"][sprdNm] = s.m_profitableClosesShort;
+
+            // Persist risk management state
+            m_doc["in_risk_mode"][sprdNm] = s.m_inRiskMode;
+            m_doc["reduced_leg"][sprdNm] = std::string(s.m_reducedLeg);
+            m_doc["reduced_amount"][sprdNm] = s.m_reducedAmount;
+            m_doc["reduced_direction"][sprdNm] = s.m_reducedDirection;
+            m_doc["arbitrage_pos"][sprdNm] = s.m_arbitragePos;
+            m_doc["risk_pos"][sprdNm] = s.m_riskPos;
+            m_doc["current_day"][sprdNm] = s.m_currentDay;
+            m_doc["current_day_high"][sprdNm] = s.m_currentDayHigh;
+            m_doc["current_day_low"][sprdNm] = s.m_currentDayLow;
+        }
+        // same key order as the synchronous writer produced, so readers of the file see no difference
+        void build(void)
+        {
+            m_doc = json::parse(R"(
+            {
+                "ois": {},
+                "lps": {},
+                "awps": {},
+                "sprd_aps": {},
+                "sprd_bps": {},
+                "sprd_aqs": {},
+                "sprd_bqs": {},
+                "trd_sprds": [],
+                "sprds": [],
+                "step_sizes": {},
+                "theo_bids": {},
+                "theo_asks": {},
+                "sprd_max_lots": {},
+                "ref_mids": {},
+                "inst_poss": {},
+                "sprd_poss": {},
+                "mrgns": {},
+                "atps": {},
+                "di_pnls": {},
+                "dn_pnls": {},
+                "pnls": {}
+            }
+            )");
+            for (int i=0; i<int(m_instShadow.size()); i++) patchInst(i);
+            for (int i=0; i<int(m_sprdShadow.size()); i++) patchSpread(i);
+            m_doc["trd_sprds"] = m_trdSprdNms;
+            m_doc["sprds"] = m_sprdNms;
+            m_built = true;
+        }
+        static bool writeText(const std::string &text, const std::string &fileName, const std::string &tmpName)
+        {
+            FILE *fp = fopen(tmpName.c_str(), "w");
+            if (fp == NULL) return false;
+            bool ok = fwrite(text.data(), 1, text.size(), fp) == text.size();
+            ok = fflush(fp) == 0 && ok;
+            ok = fsync(fileno(fp)) == 0 && ok;
+            ok = fclose(fp) == 0 && ok;
+            return ok && rename(tmpName.c_str(), fileName.c_str()) == 0;
+        }
+        bool writeFile(void)
+        {
+            std::string text = m_doc.dump(4);
+            text += '\n';
+            bool ok = writeText(text, m_fileName, m_tmpName);
+            if (ok) m_lastBytes.store(text.size(), std::memory_order_relaxed);
+            return ok;
+        }
+        bool writeHistory(int i)
+        {
+            json days = json::array();
+            for (const auto& dayData : m_historyShadow[i])
+            {
+                json dayObj;
+                dayObj["day"] = dayData.tradingDay;
+                dayObj["high"] = dayData.dailyHigh;
+                dayObj["low"] = dayData.dailyLow;
+                days.push_back(dayObj);
+            }
+            std::string fileName = m_histDir + "/" + m_sprdNms[i] + ".json";
+            bool ok = writeText(days.dump(4) + "\n", fileName, fileName + ".tmp");
+            if (ok) m_historyWrites.fetch_add(1, std::memory_order_relaxed);
+            return ok;
+        }
+    public:
+        CStatePersister() : m_writes(0), m_failures(0), m_lastBytes(0), m_maxWriteNs(0), m_historyWrites(0), m_intervalMs(0),
+            m_journalSeqPending(0), m_journalSeqShadow(0), m_lastFlushOk(true), m_built(false), m_running(false) {}
+        ~CStatePersister() { stop(); }
+        bool isStarted(void) const { return !m_pInsts.empty() || !m_pSprds.empty(); }
+        bool isAsync(void) const { return m_intervalMs > 0; }
+        // intervalMs <= 0 writes on the calling thread at every mark, like the old synchronous path
+        void start(const std::string &fileName, int intervalMs, bool snapshot, unsigned long long journalSeq, const std::map<int, CFutureExtentionAE *> &pInsts,
+            const std::map<int, CSpreadExtentionAE *> &pSprds, const std::map<int, CSpreadExtentionAE *> &pTrdSprds)
+        {
+            m_fileName = fileName;
+            m_tmpName = fileName + ".tmp";
+            m_histDir = fileName + ".hist";
+            m_intervalMs = intervalMs;
+            for (auto& it : pInsts)
+            {
+                it.second->m_stateSlot = int(m_pInsts.size());
+                m_pInsts.push_back(it.second);
+                m_instKeys.push_back(std::string(it.second->ID()) + "." + it.second->exchangeID());
+            }
+            std::vector<bool> tradable;
+            for (auto& it : pSprds)
+            {
+                tradable.push_back(pTrdSprds.find(it.first) != pTrdSprds.end());
+                it.second->m_stateSlot = int(m_pSprds.size());
+                m_pSprds.push_back(it.second);
+                m_sprdNms.push_back(it.second->m_sprdNm);
+            }
+            for (auto& it : pTrdSprds) m_trdSprdNms.push_back(it.second->m_sprdNm);
+
+            // sized once here: marking on the trading thread never allocates
+            m_instPending.resize(m_pInsts.size());
+            m_instShadow.resize(m_pInsts.size());
+            m_instDirty.assign(m_pInsts.size(), 0);
+            m_instDirtyList.reserve(m_pInsts.size());
+            m_instFlushList.reserve(m_pInsts.size());
+            memset(m_instPending.data(), 0, m_instPending.size() * sizeof(CInstState));
+            m_sprdPending.resize(m_pSprds.size());
+            m_sprdShadow.resize(m_pSprds.size());
+            m_sprdDirty.assign(m_pSprds.size(), 0);
+            m_sprdDirtyList.reserve(m_pSprds.size());
+            m_sprdFlushList.reserve(m_pSprds.size());
+            memset(m_sprdPending.data(), 0, m_sprdPending.size() * sizeof(CSpreadState));
+            m_historyPending.resize(m_pSprds.size());
+            m_historyShadow.resize(m_pSprds.size());
+            m_historyChanged.assign(m_pSprds.size(), 0);
+            m_historyVersion.assign(m_pSprds.size(), -1);   // the first capture writes every history file
+            m_historyFlush.assign(m_pSprds.size(), 0);
+            for (int i=0; i<int(m_pSprds.size()); i++) m_historyPending[i].reserve(m_pSprds[i]->m_pSignal->m_maxHistoryDays + 1);
+            if (mkdir(m_histDir.c_str(), 0755) != 0 && errno != EEXIST)
+                g_pMercLog->log("[persist],%s,mkdir failed,errno,%d", m_histDir.c_str(), errno);
+            if (snapshot)
+            {
+                if (!m_snapshot.create(fileName + ".snap", m_instKeys, m_sprdNms, tradable))
+                    g_pMercLog->log("[persist],%s.snap,create failed,snapshot off", fileName.c_str());
+            }
+            markAll(journalSeq);
+            if (m_intervalMs > 0)
+            {
+                m_running.store(true, std::memory_order_release);
+                m_writer = std::thread(&CStatePersister::writerLoop, this);
+            }
+        }
+        void stop(void)
+        {
+            if (m_running.load(std::memory_order_acquire))
+            {
+                m_running.store(false, std::memory_order_release);
+                if (m_writer.joinable()) m_writer.join();
+            }
+            if (isStarted()) flush();
+        }
+        // Trading thread: copy one spread and its legs, O(legs)
+        void markSpread(CSpreadExtentionAE *pSprd)
+        {
+            if (pSprd->m_stateSlot < 0) return;
+            {
+                std::lock_guard<std::mutex> guard(m_lock);
+                captureSpread(pSprd);
+                for (auto pLeg: pSprd->m_pLegs) captureInst(pLeg);
+            }
+            if (m_intervalMs <= 0) flush();
+        }
+        // Cold paths: startup, bars, session ends. journalSeq: last journal record the captured state includes;
+        // only a full capture may move the checkpoint's journal position
+        bool markAll(unsigned long long journalSeq=0)
+        {
+            {
+                std::lock_guard<std::mutex> guard(m_lock);
+                for (auto pInst: m_pInsts) captureInst(pInst);
+                for (auto pSprd: m_pSprds) captureSpread(pSprd);
+                m_journalSeqPending = journalSeq;
+            }
+            return m_intervalMs <= 0 ? flush() : true;
+        }
+        // Writes whatever is dirty; called by the writer thread, or directly when a caller needs the file current
+        bool flush(void)
+        {
+            std::lock_guard<std::mutex> flushGuard(m_flushLock);
+            {
+                std::lock_guard<std::mutex> guard(m_lock);
+                m_instFlushList.swap(m_instDirtyList);
+                m_sprdFlushList.swap(m_sprdDirtyList);
+                for (int i: m_instFlushList)
+                {
+                    m_instShadow[i] = m_instPending[i];
+                    m_instDirty[i] = 0;
+                }
+                for (int i: m_sprdFlushList)
+                {
+                    m_sprdShadow[i] = m_sprdPending[i];
+                    m_historyFlush[i] = m_historyChanged[i];
+                    if (m_historyChanged[i]) m_historyShadow[i] = m_historyPending[i];
+                    m_historyChanged[i] = 0;
+                    m_sprdDirty[i] = 0;
+                }
+                m_journalSeqShadow = m_journalSeqPending;
+            }
+            if (m_instFlushList.empty() && m_sprdFlushList.empty()) return m_lastFlushOk;
+
+            long long t0 = nowNanos();
+            // history first: a crash before the state file lands repeats the day roll, which finds the day already stored
+            for (int i: m_sprdFlushList)
+            {
+                if (m_historyFlush[i] && !writeHistory(i)) m_failures.fetch_add(1, std::memory_order_relaxed);
+                m_historyFlush[i] = 0;
+            }
+            if (m_snapshot.isOpen())
+            {
+                for (int i: m_instFlushList) m_snapshot.putInst(i, m_instShadow[i]);
+                for (int i: m_sprdFlushList) m_snapshot.putSpread(i, m_sprdShadow[i]);
+                m_snapshot.putJournalSeq(m_journalSeqShadow);
+                if (!m_snapshot.publish()) m_failures.fetch_add(1, std::memory_order_relaxed);
+            }
+            if (!m_built)
+            {
+                build();
+            }
+            else
+            {
+                for (int i: m_instFlushList) patchInst(i);
+                for (int i: m_sprdFlushList) patchSpread(i);
+            }
+            if (m_journalSeqShadow > 0) m_doc["journal_seq"] = m_journalSeqShadow;
+            m_instFlushList.clear();
+            m_sprdFlushList.clear();
+            bool ok = writeFile();
+            long long ns = nowNanos() - t0;
+            if (ok) m_writes.fetch_add(1, std::memory_order_relaxed);
+            else m_failures.fetch_add(1, std::memory_order_relaxed);
+            if (ns > m_maxWriteNs.load(std::memory_order_relaxed)) m_maxWriteNs.store(ns, std::memory_order_relaxed);
+            m_lastFlushOk = ok;
+            return ok;
+        }
+    };
+
+    // Per-call cost of the per-tick spread kernels on synthetic 2/3/4-leg fixtures
+    class CKernelBench
+    {
+    private:
+        IMercStrategy *m_pStrategy;
+        const CStratsEnvAE *m_pEnv;
+        CFuzzySort *m_pFuzzySorter;
+        unsigned m_seed;
+        volatile int m_sink;
+
+        struct CFixture
+        {
+            std::vector<CFutureExtentionAE *> m_pLegs;
+            std::vector<CSignalAE *> m_pLegSignals;
+            std::vector<std::vector<CMarketDataExtend> > m_frames;
+            std::vector<CMarketDataExtend *> m_pLiveMDs;
+            CSpreadExtentionAE *m_pSpread;
+            CSpreadSignal *m_pSignal;
+            int m_timeStamp;
+            void applyFrame(int i)
+            {
+                const int k = i % int(m_frames.size());
+                for (int j=0;j<m_pLegs.size();j++) m_pLegs[j]->m_pMD = &m_frames[k][j];
+            }
+        };
+
+        unsigned nextRand() { m_seed = m_seed * 1103515245u + 12345u; return (m_seed >> 16) & 0x7fff; }
+
+        int findSessionTS(CFutureExtentionAE *pLeg)
+        {
+            if (pLeg->m_pSectionList == NULL) return 0;
+            for (int ts=0; ts<24*3600*1000; ts+=60*1000)
+            {
+                if (pLeg->m_pSectionList->isIn(ts)) return ts + 30*1000;
+            }
+            return 0;
+        }
+
+        // pSrcSpread: clone its coefficients, signal and grid parameters instead of the canned 2/3/4-leg combinations
+        bool buildFixture(CFixture &fx, const std::vector<CFutureExtentionAE *> &pSrcLegs, int frameCount, const CSpreadExtentionAE *pSrcSpread=NULL)
+        {
+            static const double COEFS[5][4] = {{0}, {1}, {1,-1}, {1,-1,1}, {1,-1,-1,1}};
+            const int legCount = pSrcLegs.size();
+            if (legCount < 1 || (pSrcSpread == NULL && legCount > 4)) return false;
+            std::vector<double> coefs;
+            std::vector<double> exeCoefs;
+            if (pSrcSpread != NULL)
+            {
+                coefs = pSrcSpread->m_coefs;
+                exeCoefs = pSrcSpread->m_exeCoefs;
+            }
+            else
+            {
+                coefs.assign(COEFS[legCount], COEFS[legCount]+legCount);
+                exeCoefs = coefs;
+            }
+            for (auto pSrc: pSrcLegs)
+            {
+                CSignalAE *pSig = new CSignalAE();
+                memset(pSig, 0, sizeof(*pSig));
+                strcpySafe(pSig->m_instrumentID, pSrc->ID());
+                CFutureExtentionAE *pLeg = new CFutureExtentionAE(pSrc->id(), m_pStrategy, m_pEnv, pSrc->pInstrument(), pSig);
+                fx.m_pLegSignals.push_back(pSig);
+                fx.m_pLegs.push_back(pLeg);
+                fx.m_pLiveMDs.push_back(pLeg->m_pMD);
+            }
+
+            // random walk around pre-settle with realistic queue sizes
+            fx.m_frames.resize(frameCount);
+            std::vector<double> mids;
+            for (auto pLeg: fx.m_pLegs) mids.push_back(pLeg->m_pMD->m_preSettlePrice > 0 ? pLeg->m_pMD->m_preSettlePrice : 100.0);
+            for (int k=0;k<frameCount;k++)
+            {
+                for (int j=0;j<fx.m_pLegs.size();j++)
+                {
+                    CMarketDataExtend *pMD = fx.m_pLiveMDs[j];
+                    double tick = pMD->m_tick > 0 ? pMD->m_tick : 0.01;
+                    mids[j] += (int(nextRand() % 3) - 1) * tick;
+                    double bp = roundPrice(mids[j], tick);
+                    double ap = bp + tick * (1 + (nextRand() % 8 == 0 ? 1 : 0));
+                    double lp = (nextRand() % 2) ? bp : ap;
+                    pMD->updateQuote(1 + nextRand() % 50, 1 + nextRand() % 50, lp, bp, ap, pMD->m_LV + int(nextRand() % 20));
+                    fx.m_frames[k].push_back(*pMD);
+                }
+            }
+
+            fx.m_pSignal = new CSpreadSignal();
+            fx.m_pSpread = new CSpreadExtentionAE(-1, m_pStrategy, m_pEnv, m_pFuzzySorter);
+            // initComb appends to the name: mark fixture log lines so they are not read as live spreads
+            fx.m_pSpread->m_sprdNm = pSrcSpread != NULL ? "~warm" : "~bench";
+            fx.m_pSpread->initComb(fx.m_pLegs, coefs, exeCoefs);
+            if (pSrcSpread != NULL)
+            {
+                *fx.m_pSignal = *pSrcSpread->m_pSignal;
+            }
+            else
+            {
+                fx.m_pSignal->m_stepSize = 1;
+                fx.m_pSignal->m_sprdMaxLot = 10;
+            }
+            fx.m_pSignal->m_sprdNm = fx.m_pSpread->m_sprdNm;
+            fx.m_pSpread->finishComb(fx.m_pSignal);
+            fx.m_pSpread->m_sendRiskOrder = [](const CInstrument *, int, double, int) { return false; };
+            fx.m_timeStamp = findSessionTS(fx.m_pLegs.at(0));
+            if (pSrcSpread != NULL)
+            {
+                copyGridParams(fx.m_pSpread, pSrcSpread);
+                return true;
+            }
+
+            double spreadMid = 0.0;
+            for (int j=0;j<fx.m_pLegs.size();j++) spreadMid += coefs[j] * fx.m_frames[0][j].defaultPrice();
+            double tick = fx.m_pSpread->m_tick > 0 ? fx.m_pSpread->m_tick : 0.01;
+            fx.m_pSpread->m_exitInterval = 2 * tick;
+            fx.m_pSpread->m_minEntryInterval = tick;
+            fx.m_pSpread->m_arbitrageLower = spreadMid - 20 * tick;
+            fx.m_pSpread->m_arbitrageUpper = spreadMid + 20 * tick;
+            return true;
+        }
+
+        static void copyGridParams(CSpreadExtentionAE *pDst, const CSpreadExtentionAE *pSrc)
+        {
+            pDst->m_exitInterval = pSrc->m_exitInterval;
+            pDst->m_minEntryInterval = pSrc->m_minEntryInterval;
+            pDst->m_minDynamic = pSrc->m_minDynamic;
+            pDst->m_maxDynamic = pSrc->m_maxDynamic;
+            pDst->m_widenThreshold = pSrc->m_widenThreshold;
+            pDst->m_narrowThreshold = pSrc->m_narrowThreshold;
+            pDst->m_widenStep = pSrc->m_widenStep;
+            pDst->m_minOps = pSrc->m_minOps;
+            pDst->m_reduceRatio = pSrc->m_reduceRatio;
+            pDst->m_maxLeverage = pSrc->m_maxLeverage;
+            pDst->m_maxGridLevels = pSrc->m_maxGridLevels;
+            pDst->m_arbitrageLower = pSrc->m_arbitrageLower;
+            pDst->m_arbitrageUpper = pSrc->m_arbitrageUpper;
+            pDst->m_riskLower = pSrc->m_riskLower;
+            pDst->m_riskUpper = pSrc->m_riskUpper;
+        }
+
+        void freeFixture(CFixture &fx)
+        {
+            if (fx.m_pSpread != NULL) { delete fx.m_pSpread->m_pSpreadExec; delete fx.m_pSpread; }
+            delete fx.m_pSignal;
+            for (int j=0;j<fx.m_pLegs.size();j++) { delete fx.m_pLiveMDs[j]; delete fx.m_pLegs[j]; delete fx.m_pLegSignals[j]; }
+        }
+
+        template<class F> double timeKernel(CFixture &fx, int iterations, F kernel)
+        {
+            long long t0 = nowNanos();
+            for (int i=0;i<iterations;i++) { fx.applyFrame(i); kernel(i); }
+            long long t1 = nowNanos();
+            return double(t1 - t0) / iterations;
+        }
+
+        void report(int legCount, const char *kernel, double ns, double baseNs)
+        {
+            g_pMercLog->log("[benchKernels],%s,legs,%d,kernel,%s,ns,%.1f", m_pEnv->m_strategyName, legCount, kernel, std::max(0.0, ns - baseNs));
+        }
+
+        void runFixture(CFixture &fx, int iterations)
+        {
+            const int legCount = fx.m_pLegs.size();
+            CSpreadExtentionAE *pSpread = fx.m_pSpread;
+            CSpreadExec *pExec = pSpread->m_pSpreadExec;
+            const int ts = fx.m_timeStamp;
+            bool toSyncData = false;
+
+            double baseNs = timeKernel(fx, iterations, [&](int) { m_sink = m_sink + 1; });
+            report(legCount, "frameBaseline", baseNs, 0.0);
+
+            report(legCount, "updatePrice", timeKernel(fx, iterations, [&](int) { pSpread->updatePrice(ts); }), baseNs);
+            report(legCount, "updtBuySell", timeKernel(fx, iterations, [&](int i) {
+                pSpread->m_pSignal->m_pos = (i % 5) - 2;
+                pSpread->updtBuySell(pSpread->m_buy, pSpread->m_sell);
+            }), baseNs);
+            report(legCount, "updateSignal", timeKernel(fx, iterations, [&](int i) {
+                pSpread->m_pSignal->m_pos = (i % 5) - 2;
+                m_sink = m_sink + pSpread->updateSignal(toSyncData, false);
+            }), baseNs);
+            pSpread->m_pSignal->m_pos = 0;
+            report(legCount, "isReadyToTrade", timeKernel(fx, iterations, [&](int) { m_sink = m_sink + pSpread->isReadyToTrade(); }), baseNs);
+            report(legCount, "isSafeToBuy", timeKernel(fx, iterations, [&](int) { m_sink = m_sink + pSpread->isSafeToBuy(); }), baseNs);
+
+            CMarketDataExtend md = fx.m_frames[0][0];
+            const std::vector<std::vector<CMarketDataExtend> > &frames = fx.m_frames;
+            report(legCount, "mdUpdate", timeKernel(fx, iterations, [&](int i) {
+                const CMarketDataExtend &f = frames[i % frames.size()][0];
+                md.updateQuote(f.m_BQ, f.m_AQ, f.m_LP, f.m_BP, f.m_AP, f.m_LV);
+            }), baseNs);
+            report(legCount, "checkTradeReady", timeKernel(fx, iterations, [&](int) { md.checkTradeReady(); }), baseNs);
+
+            pExec->start(legCount, 0);
+            for (int j=0;j<legCount;j++)
+            {
+                pExec->m_trdVlms[j] = pExec->m_expVlms[j];
+                pExec->m_avgPrices[j] = fx.m_frames[0][j].m_LP;
+            }
+            report(legCount, "calcSpreadTrdVolume", timeKernel(fx, iterations, [&](int) { m_sink = m_sink + pExec->calcSpreadTrdVolume(); }), baseNs);
+            pExec->stop();
+        }
+
+        // One pass of the per-tick decision path per frame, the same sequence triggerSpread runs minus the order send
+        // and the status publishing tail of trySignal (a fixture must not create host status objects of its own)
+        void warmFixture(CFixture &fx, int frames)
+        {
+            CSpreadExtentionAE *pSpread = fx.m_pSpread;
+            CSpreadExec *pExec = pSpread->m_pSpreadExec;
+            const int ts = fx.m_timeStamp;
+            bool toSyncData = false;
+            for (int i=0;i<frames;i++)
+            {
+                fx.applyFrame(i);
+                pSpread->updatePrice(ts);
+                if (pSpread->m_selfConstrain == 0) pSpread->checkRiskBoundaryBreak(pSpread->m_spAvg, ts);
+                int action = pSpread->timedUpdateSignal(toSyncData, false);
+                if (action > 0) m_sink = m_sink + pSpread->isSafeToBuy();
+                else if (action < 0) m_sink = m_sink + pSpread->isSafeToSell();
+
+                // no grid crossing on most frames, alternate a one lot entry so the exec side runs every frame too
+                if (action == 0) action = (i & 1) ? 1 : -1;
+                int tryLegID = m_pEnv->m_tryLegID > -1 ? m_pEnv->m_tryLegID : pSpread->chooseLeg(action);
+                pSpread->notifyExecStarted(action);
+                pExec->start(action, tryLegID);
+                pExec->prepareTryOrder();
+                m_sink = m_sink + pExec->m_tryOrderVolume;
+                pExec->stop();
+            }
+        }
+
+    public:
+        CKernelBench(IMercStrategy *pStrategy, const CStratsEnvAE *pEnv, CFuzzySort *pFuzzySorter)
+            : m_pStrategy(pStrategy), m_pEnv(pEnv), m_pFuzzySorter(pFuzzySorter), m_seed(20251209u), m_sink(0) {}
+
+        void run(const std::map<int, CFutureExtentionAE *> &pFutures, int iterations)
+        {
+            std::vector<CFutureExtentionAE *> pSrcLegs;
+            for (auto& it : pFutures) pSrcLegs.push_back(it.second);
+            for (int legCount=2; legCount<=4; legCount++)
+            {
+                if (pSrcLegs.size() < legCount)
+                {
+                    g_pMercLog->log("[benchKernels],%s,legs,%d,SKIPPED,insts,%lu", m_pEnv->m_strategyName, legCount, pSrcLegs.size());
+                    continue;
+                }
+                CFixture fx;
+                fx.m_pSpread = NULL;
+                fx.m_pSignal = NULL;
+                std::vector<CFutureExtentionAE *> pLegs(pSrcLegs.begin(), pSrcLegs.begin() + legCount);
+                if (buildFixture(fx, pLegs, 64))
+                {
+                    runFixture(fx, iterations);
+                }
+                for (int j=0;j<fx.m_pLegs.size();j++) fx.m_pLegs[j]->m_pMD = fx.m_pLiveMDs[j];
+                freeFixture(fx);
+            }
+        }
+        // Pre-market warmup: every tradable spread is cloned onto private legs and driven through the decision path
+        // on synthetic quotes; live legs, signals and positions are not touched. Returns the spreads warmed.
+        int warmup(const std::map<int, CSpreadExtentionAE *> &pSpreads, int frames)
+        {
+            int warmed = 0;
+            for (auto& it : pSpreads)
+            {
+                CFixture fx;
+                fx.m_pSpread = NULL;
+                fx.m_pSignal = NULL;
+                if (buildFixture(fx, it.second->m_pLegs, std::min(frames, 64), it.second))
+                {
+                    warmFixture(fx, frames);
+                    warmed++;
+                }
+                for (int j=0;j<fx.m_pLegs.size();j++) fx.m_pLegs[j]->m_pMD = fx.m_pLiveMDs[j];
+                freeFixture(fx);
+            }
+            return warmed;
+        }
+    };
     CStratsEnvAE m_env;
     CAccountManager *m_pAccountManager;
     CFuzzySort *m_pFuzzySorter;
@@ -3696,7 +6494,17 @@ private:
     std::map<int, CFutureExtentionAE* > m_pFutures;
     std::map<int, CSpreadExtentionAE* > m_pSpreads;
     std::map<int, CSpreadExtentionAE* > m_pTrdSprds;
-    std::map<int, const CMercStrategyOrderItem* > m_orderMap;
+    // dense views for the callbacks: futures by slot in subscription order, instRef -> slot, spreads by id
+    std::vector<CFutureExtentionAE *> m_futureSlots;
+    std::vector<int> m_slotByRef;
+    std::vector<CSpreadExtentionAE *> m_spreadSlots;
+    std::vector<std::vector<CSpreadExtentionAE *> > m_legSpreads;     // by future slot: tradable spreads it is a leg of
+    unsigned long long m_snapCount;
+    unsigned long long m_evalCount;
+    unsigned long long m_skipCount;
+    unsigned long long m_gateCount;
+    unsigned long long m_lateCount;
+    COrderTable m_orderTable;
     std::map<std::string, int> m_sprdNmPosMap;
     
     bool m_strategyReady;
@@ -3712,10 +6520,53 @@ private:
     int m_tradeVolume;
 
     int m_mdTS;
+    int m_sentOrderCount;
+
+    CLatencyHist m_tickLat;
+    CLatencyHist m_tickOrderLat;
+    long long m_benchFirstNs;
+    long long m_benchLastNs;
+
+    unsigned long long m_mdArrivalTsc;
+    unsigned long long m_lastSendTsc;
+    CStageLatency m_latency;
+
+    CAllocStats m_mdAllocs;
+    CAllocStats m_trdAllocs;
+
+    CFlightRecorder m_recorder;
+    CStatePersister m_persister;
+    CJournal m_journal;
+    CShmMirror m_mirror;
+    CDeferredWork m_deferred;
+    std::string m_stateName;            // strategy whose data file, journal and mirror this instance owns
+    bool m_standby;
+    CJournal::CTail m_walTail;
+    const char *m_pPrimary;             // the primary's mirror, for its heartbeat
+    size_t m_primarySize;
+    CStateLock m_stateLock;             // held while this instance trades the state; a standby waits for it
+    int m_primaryPid;                   // last holder of the state lock seen by a standby, 0 before any
+    long long m_lockCheckNs;
+    long long m_standbyNextNs;
+    unsigned long long m_standbyApplied;
+    CExecCheckpoint m_execCheckpoint;
+    CExecCheckpoint::CExecRecord m_execRecord;
+    std::vector<CExecCheckpoint::CLegRecord> m_execLegs;
+    std::unordered_map<int, CExecCheckpoint::CRestoredOrder> m_restoredOrders;   // by order ref
+    bool m_resumeExpired;                        // ResumeWaitMs passed: orders still restored are alerted every period
+    unsigned long long m_recordDropped;
+    CFlightReplay *m_pReplay;
+    volatile int m_replayTS;
+    CSimExchange *m_pSim;
+    unsigned m_randSeed;
 
     int m_triggerStart;
-    std::map<int, int> m_instTriggerMap;
-    std::map<int, int> m_sortedSpreads;
+    int m_sweptEnd;                                     // m_sortedSpreads evaluated so far on this snapshot
+    std::vector<int> m_triggerEnds;                     // by future slot: end of its run in m_sortedSpreads
+    std::vector<CSpreadExtentionAE *> m_sortedSpreads;
+    std::vector<int> m_slowestSlots;                    // updateInstTriggerMap scratch
+    std::vector<int> m_triggerNext;
+    unsigned m_triggerVersion;                          // sorter ranking the trigger order was built from
 
 public:        
     char m_buffer[100];
@@ -3731,16 +6582,107 @@ public:
         m_env.init(this);
         m_env.refreshParameterStatus();
         createAccountManager();
-        m_env.m_dataFn = m_env.m_shmNmPrefix + std::string(m_env.m_strategyName) + ".json";
-        m_pFuzzySorter=new CFuzzySort(m_env.m_needFuzzySort);
-        m_pSignalManager=new CSignalManagerAE(m_env.m_dataFn.c_str());
+        // a standby loads and follows the primary's state, and owns it after a takeover
+        m_standby = m_env.m_standbyOf[0] != '\0' && m_env.m_replayFile[0] == '\0';
+        m_stateName = m_standby ? m_env.m_standbyOf : m_env.m_strategyName;
+        m_pPrimary = NULL;
+        m_primarySize = 0;
+        m_primaryPid = 0;
+        m_lockCheckNs = 0;
+        m_standbyNextNs = 0;
+        m_standbyApplied = 0;
+        m_resumeExpired = false;
+        if (m_standby && m_env.m_journal <= 0)
+        {
+            g_pMercLog->log("%s,exit: StandbyOf %s needs Journal",m_env.m_strategyName,m_env.m_standbyOf);
+            exit(1);
+        }
+        // exec records are stored on every fill; positions must be as durable or restored fills are never caught up
+        if (m_env.m_execCheckpoint > 0 && m_env.m_journal <= 0 && m_env.m_replayFile[0] == '\0')
+        {
+            g_pMercLog->log("%s,exit: ExecCheckpoint needs Journal",m_env.m_strategyName);
+            exit(1);
+        }
+        m_env.m_dataFn = m_env.m_shmNmPrefix + m_stateName + ".json";
+        // one instance trades a journaled state: a standby takes it over once the lock is free, a second
+        // primary would write the same files and send the same orders
+        if (!m_standby && m_env.m_journal > 0 && m_env.m_isBacktest <= 0 && m_env.m_replayFile[0] == '\0')
+        {
+            takeStateLock();
+        }
+        m_pFuzzySorter=new CFuzzySort(m_env.m_needFuzzySort, m_env.m_fuzzyHalfLifeMs);
+        m_pSignalManager=new CSignalManagerAE(m_env.m_dataFn.c_str(), m_env.m_stateSnapshot > 0);
         m_pSpreadManager=new CSpreadSignalManager(m_env.m_dataFn.c_str(), &m_env);
         m_pForceTaskManager=new CForceTaskManager(0,&m_env,m_env.m_maxWorker);
         m_strategyReady=m_needOnBar=false;
         m_totalMargin=0.0;
-        m_triggerStart = 0;
+        m_triggerStart = m_sweptEnd = 0;
+        m_triggerVersion = 0;
+        m_snapCount = m_evalCount = m_skipCount = m_gateCount = m_lateCount = 0;
         m_sendCount=m_failedCount=m_cancelCount=m_tradeCount=m_sendVolume=m_cancelVolume=m_tradeVolume=0;
+        m_sentOrderCount=0;
+        m_tickLat.clear(); m_tickOrderLat.clear();
+        m_benchFirstNs=m_benchLastNs=0;
+        m_mdArrivalTsc=m_lastSendTsc=0;
+        m_latency.clear();
+        if (TSC || m_env.m_cpuCost > 0)
+        {
+            CTscClock::calibrate();
+            g_pMercLog->log("initStrategy,tscNsPerCycle,%g", CTscClock::nsPerCycle());
+        }
         m_pRiskStatus0=m_pRiskStatus1=NULL;
+        m_recordDropped=0;
+        m_pReplay=NULL;
+        m_replayTS=0;
+        m_pSim=NULL;
+        m_randSeed=0;
+        if (m_env.m_replayFile[0] != '\0')
+        {
+            m_pReplay = new CFlightReplay();
+            if (!m_pReplay->load(m_env.m_replayFile, m_env.m_replaySession))
+            {
+                g_pMercLog->log("%s,exit: replay file %s session %d not loaded",m_env.m_strategyName,m_env.m_replayFile,m_env.m_replaySession);
+                exit(1);
+            }
+            // state is loaded from the live data file, replayed state goes next to the recording
+            m_env.m_dataFn = std::string(m_env.m_replayFile) + ".json";
+            g_pMercLog->log("initStrategy,replay,%s,session,%d,tradingDay,%d,events,%d,ready,%d", m_env.m_replayFile, m_env.m_replaySession,
+                m_pReplay->header().m_tradingDay, m_pReplay->size(), m_pReplay->readyIndex());
+        }
+        else if (m_env.m_simExchange > 0)
+        {
+            m_pSim = new CSimExchange(m_env.m_simAckMs, m_env.m_simFillMs, m_env.m_simFillSplit, m_env.m_simRejectPct, unsigned(m_env.m_simSeed));
+            g_pMercLog->log("initStrategy,simExchange,ackMs,%d,fillMs,%d,fillSplit,%d,rejectPct,%d,seed,%d",
+                m_env.m_simAckMs, m_env.m_simFillMs, m_env.m_simFillSplit, m_env.m_simRejectPct, m_env.m_simSeed);
+        }
+        if (m_pReplay == NULL && m_env.m_journal > 0)
+        {
+            // redo what happened after the last checkpoint, then keep appending to the same file
+            std::string walFn = m_env.m_dataFn + ".wal";
+            int applied = 0;
+            unsigned long long lastSeq = CJournal::replay(walFn.c_str(), m_pSpreadManager->m_journalSeq,
+                [this](const CJournal::CRecord &r) { applyJournal(r); }, applied);
+            if (m_standby)
+            {
+                // the primary still appends to it: follow, do not open for writing
+                bool following = m_walTail.open(walFn.c_str(), lastSeq);
+                g_pMercLog->log("initStrategy,standby,%s,journal,%s,checkpointSeq,%llu,applied,%d,following,%d", m_env.m_standbyOf, walFn.c_str(),
+                    m_pSpreadManager->m_journalSeq, applied, following);
+            }
+            else if (!m_journal.open(walFn.c_str(), lastSeq))
+            {
+                g_pMercLog->log("%s,exit: journal %s not opened",m_env.m_strategyName,walFn.c_str());
+                exit(1);
+            }
+            else g_pMercLog->log("initStrategy,journal,%s,checkpointSeq,%llu,applied,%d,seq,%llu", walFn.c_str(), m_pSpreadManager->m_journalSeq, applied, m_journal.seq());
+        }
+        if (m_pReplay == NULL && m_env.m_recordEvents > 0)
+        {
+            char recFn[512];
+            snprintf(recFn, sizeof(recFn), "%s%s.%d.ezfr", m_env.m_shmNmPrefix, m_env.m_strategyName, getTradingDay());
+            bool opened = m_recorder.open(recFn, m_env.m_recordRing, getTradingDay(), m_env.m_strategyName);
+            g_pMercLog->log("initStrategy,flightRecorder,%s,ring,%d,opened,%d", recFn, m_env.m_recordRing, opened);
+        }
         g_pMercLog->log("initStrategy,done");
         return true;
     }
@@ -3762,53 +6704,96 @@ public:
     }
     virtual void strategyReady(void)
     {
+        long rss0 = rssKB();
+        long long t0 = nowNanos();
         createFile();
         startSubscribe();
+        long long t1 = nowNanos();
         createSpreads();
+        long long t2 = nowNanos();
         controlPositionLimit();
         m_pCurTimeStamp = getCurTimeStampPtr();
         m_pTradeControl = new CTradeControl(this,&m_env);
         m_pTradeControl->init();
+        long long t3 = nowNanos();
         updateInstTriggerMap();
+        long long t4 = nowNanos();
         updateBiasSlf();
         updateConstrain();
         refreshRiskStatus();
+        long long t5 = nowNanos();
+        g_pMercLog->log("[benchStartup],%s,instruments,%d,spreads,%d,tradable,%d,startSubscribe,%g,createSpreads,%g,tradeControl,%g,updateInstTriggerMap,%g,risk,%g,totalMs,%g,rssKB,%ld,rssDeltaKB,%ld",
+            m_env.m_strategyName, int(m_pFutures.size()), int(m_pSpreads.size()), int(m_pTrdSprds.size()),
+            (t1-t0)*1e-6, (t2-t1)*1e-6, (t3-t2)*1e-6, (t4-t3)*1e-6, (t5-t4)*1e-6, (t5-t0)*1e-6, rssKB(), rssKB()-rss0);
         if (m_env.m_isBacktest>0 && m_env.m_cancelRate>0)
         {
-            srand(time(0));
+            m_randSeed = (unsigned)time(0);
+            srand(m_randSeed);
+        }
+        if (m_env.m_benchKernels > 0)
+        {
+            CKernelBench bench(this, &m_env, m_pFuzzySorter);
+            bench.run(m_pFutures, m_env.m_benchKernels);
         }
         m_strategyReady=true;
-        g_pMercLog->log("strategyReady,done");
+        recordReady();
+        if (!m_standby) restoreExecs();
+        g_pMercLog->log("strategyReady,done,standby,%d", m_standby);
+        if (m_pReplay != NULL)
+        {
+            runReplay();
+        }
     }
+    CFutureExtentionAE *futureByRef(int instRef) const
+    {
+        if (unsigned(instRef) >= m_slotByRef.size() || m_slotByRef[instRef] < 0) return NULL;
+        return m_futureSlots[m_slotByRef[instRef]];
+    }
+    CSpreadExtentionAE *spreadByID(int id) const
+    {
+        return unsigned(id) < m_spreadSlots.size() ? m_spreadSlots[id] : NULL;
+    }
+    // Groups the tradable spreads by their slowest leg, groups in the sorter's rank order: a quote triggers
+    // the spreads up to the end of its instrument's group. O(spreads x legs + instruments), no allocation
+    // after the first call
     void updateInstTriggerMap()
     {
-        int *sortedFutures = m_pFuzzySorter->sortByScore();
-        int idx = 0;
-        for (int i=0;i<m_pFuzzySorter->size();i++)
+        int n = int(m_futureSlots.size());
+        m_slowestSlots.clear();
+        m_triggerNext.assign(n, 0);
+        for (auto& it : m_pTrdSprds)
         {
-            int ref = sortedFutures[i];
-            for (auto& it : m_pTrdSprds)
+            CFutureExtentionAE *pSlw = it.second->m_pLegs.at(0);
+            for (auto pLeg: it.second->m_pLegs)
             {
-                int slwLeg = it.second->m_pLegs.at(0)->m_pInstrument->getInstrumentRef();
-                for (auto pLeg: it.second->m_pLegs)
-                {
-                    int legRef = pLeg->m_pInstrument->getInstrumentRef();
-                    if (m_pFuzzySorter->isFaster(legRef, slwLeg)<0)
-                        slwLeg = legRef;
-                }
-
-                if (ref == slwLeg)
-                {
-                    m_sortedSpreads[idx] = it.first;
-                    idx++;
-                }
+                if (m_pFuzzySorter->isFaster(pLeg->m_pInstrument->getInstrumentRef(), pSlw->m_pInstrument->getInstrumentRef())<0)
+                    pSlw = pLeg;
             }
-            m_instTriggerMap[ref] = idx;
+            m_slowestSlots.push_back(pSlw->m_slot);
+            m_triggerNext[pSlw->m_slot]++;
         }
-    }
-    void refreshRiskStatus()
-    {
-        if (m_pRiskStatus0==NULL)
+        int end = 0;
+        for (int i=0;i<m_pFuzzySorter->size();i++)
+        {
+            int slot = futureByRef(m_pFuzzySorter->rankedRef(i))->m_slot;
+            int count = m_triggerNext[slot];
+            m_triggerNext[slot] = end;
+            end += count;
+            m_triggerEnds[slot] = end;
+        }
+        m_sortedSpreads.resize(end);
+        int k = 0;
+        for (auto& it : m_pTrdSprds)
+        {
+            int pos = m_triggerNext[m_slowestSlots[k++]]++;
+            m_sortedSpreads[pos] = it.second;
+            it.second->m_triggerPos = pos;
+        }
+        m_triggerVersion = m_pFuzzySorter->version();
+    }
+    void refreshRiskStatus()
+    {
+        if (m_pRiskStatus0==NULL)
         {
             m_pRiskStatus0=createStrategyStatus(4);
         }
@@ -3886,121 +6871,123 @@ public:
         }
     }
 
-    void syncData(bool prt=false)
+    // Snapshot every instrument and spread for the state file; cold paths only, ticks use syncSpread.
+    // wait: write the file before returning instead of leaving it to the persister thread.
+    // The snapshot is a journal checkpoint: it covers every record up to the current sequence
+    bool syncData(bool wait=false)
     {
-        json outJ = json::parse(R"(
+        for (auto& it : m_pSpreads) publishSpread(it.second);
+        bool ok = m_persister.markAll(m_journal.seq());
+        if (wait && m_persister.isAsync())
         {
-            "ois": {},
-            "lps": {},
-            "awps": {},
-            "sprd_aps": {},
-            "sprd_bps": {},
-            "sprd_aqs": {},
-            "sprd_bqs": {},
-            "trd_sprds": [],
-            "sprds": [],
-            "step_sizes": {},
-            "theo_bids": {},
-            "theo_asks": {},
-            "sprd_max_lots": {},
-            "ref_mids": {},
-            "inst_poss": {},
-            "sprd_poss": {},
-            "mrgns": {},
-            "atps": {},
-            "di_pnls": {},
-            "dn_pnls": {},
-            "pnls": {},
+            ok = m_persister.flush();
         }
-        )");
-
-        for (auto& pInst: m_pFutures)
+        return ok;
+    }
+    // With the journal on, fills and grid transitions are already durable as records, the state
+    // file only follows at checkpoints; force: manual commands that the journal does not record
+    void syncSpread(CSpreadExtentionAE *pSpread, bool force=false)
+    {
+        publishSpread(pSpread);
+        if (m_journal.isOpen() && !force) return;
+        if (m_env.m_deferWork > 0 && !force) m_deferred.postSpread(pSpread, CDeferredWork::DS_Sync, *m_pCurTimeStamp);
+        else m_persister.markSpread(pSpread);
+    }
+    void defer(unsigned flags)
+    {
+        if (m_env.m_deferWork > 0) m_deferred.post(flags, *m_pCurTimeStamp);
+        else runDeferred(flags);
+    }
+    void runDeferred(unsigned flags)
+    {
+        if (flags & CDeferredWork::DW_Risk) refreshRiskStatus();
+        if (flags & CDeferredWork::DW_PeriodLog)
         {
-            std::string instKey = std::string(pInst.second->ID()) + "." + pInst.second->exchangeID();
-
-            outJ["ois"][instKey] = pInst.second->preOI();
-            outJ["lps"][instKey] = pInst.second->LP();
-            outJ["awps"][instKey] = pInst.second->m_pSignal->m_theoLst;
-            outJ["inst_poss"][instKey] = pInst.second->m_pSignal->m_pos;
+            for (auto& it : m_pTrdSprds) logTrds(typeid(this).name(), "Period", "Both", it.second, true, 0, 0, 0, 0);
         }
-
-        std::vector<std::string> trdSprds;
-        std::vector<std::string> spreads;
-        for (auto& it: m_pSpreads)
+        if (flags & CDeferredWork::DW_SyncData) syncData();
+    }
+    void runDeferredSpread(CSpreadExtentionAE *pSpread, unsigned what)
+    {
+        if (what & CDeferredWork::DS_Signal) pSpread->refreshSignalStatus();
+        if (what & CDeferredWork::DS_Exec) pSpread->refreshExecStatus();
+        if (what & CDeferredWork::DS_Sync) m_persister.markSpread(pSpread);
+    }
+    // idle: the host reported free time; otherwise a bound on how long posted work may wait
+    void drainDeferred(bool idle)
+    {
+        m_deferred.drain(idle, [this](unsigned flags) { runDeferred(flags); },
+            [this](CSpreadExtentionAE *pSpread, unsigned what) { runDeferredSpread(pSpread, what); });
+    }
+    void logDeferred()
+    {
+        if (m_env.m_deferWork <= 0) return;
+        g_pMercLog->log("[deferred],%s,posts,%llu,runs,%llu,drains,%llu,idleDrains,%llu,maxDrainUs,%g", m_env.m_strategyName,
+            m_deferred.m_posts, m_deferred.m_runs, m_deferred.m_drains, m_deferred.m_idleDrains, m_deferred.m_maxDrainNs * 1e-3);
+    }
+    // Session end: once the checkpoint is on disk the journal tail is redundant
+    void checkpoint(void)
+    {
+        bool ok = syncData(true);
+        if (m_journal.isOpen())
         {
-            spreads.push_back(it.second->m_sprdNm);
+            bool truncated = ok && m_journal.truncate();
+            g_pMercLog->log("[journal],%s,checkpoint,seq,%llu,records,%llu,failures,%llu,truncated,%d", m_env.m_strategyName,
+                m_journal.seq(), m_journal.records(), m_journal.failures(), truncated);
         }
-        for (auto& it: m_pTrdSprds)
+    }
+    void journalInstPos(CFutureExtentionAE *pInst)
+    {
+        CJournal::CRecord r;
+        CJournal::init(r, CJournal::RT_InstPos, getCurTimeStamp(), "");
+        snprintf(r.m_key, sizeof(r.m_key), "%s.%s", pInst->ID(), pInst->exchangeID());
+        r.m_i[0] = pInst->m_pSignal->m_pos;
+        m_journal.append(r);
+    }
+    // Redo one journal record onto the loaded state; records carry absolute values, not deltas
+    void applyJournal(const CJournal::CRecord &r)
+    {
+        if (r.m_type == CJournal::RT_InstPos)
         {
-            trdSprds.push_back(it.second->m_sprdNm);
+            std::vector<std::string> instNExchg;
+            split(r.m_key, instNExchg, ".");
+            m_pSignalManager->getSignal(instNExchg.at(0).c_str())->m_pos = r.m_i[0];
+            return;
         }
-
-        for (auto& pSprd: m_pSpreads)
-        {
-            std::string sprdNm = pSprd.second->m_sprdNm;
-
-            outJ["sprd_poss"][sprdNm] = pSprd.second->m_pSignal->m_pos;
-            outJ["mrgns"][sprdNm] = pSprd.second->m_ttlMrgn;
-            outJ["ref_mids"][sprdNm] = pSprd.second->m_pSignal->m_refMid;
-            outJ["sprd_max_lots"][sprdNm] = pSprd.second->m_pSignal->m_sprdMaxLot;
-            outJ["step_sizes"][sprdNm] = pSprd.second->m_pSignal->m_stepSize;
-            outJ["awps"][sprdNm] = pSprd.second->m_pSignal->m_awp;
-            outJ["sprd_aps"][sprdNm] = pSprd.second->m_pSignal->m_sprdAP;
-            outJ["sprd_bps"][sprdNm] = pSprd.second->m_pSignal->m_sprdBP;
-            outJ["sprd_aqs"][sprdNm] = pSprd.second->m_pSignal->m_sprdAQ;
-            outJ["sprd_bqs"][sprdNm] = pSprd.second->m_pSignal->m_sprdBQ;
-            outJ["theo_bids"][sprdNm] = pSprd.second->m_buy;
-            outJ["theo_asks"][sprdNm] = pSprd.second->m_sell;
-
-            for (auto& pSprd1: m_pSpreads)
-            {
-                if (pSprd.second->m_coefs.size() != 2 || pSprd1.second->m_coefs.size() != 2) continue;
-                if (pSprd.second->m_sprdNm == pSprd1.second->m_sprdNm) continue;
-            }
-
-            outJ["atps"][sprdNm] = pSprd.second->m_pSignal->m_atp;
-            outJ["di_pnls"][sprdNm] = pSprd.second->m_pSignal->m_diPnl;
-            outJ["dn_pnls"][sprdNm] = pSprd.second->m_pSignal->m_dnPnl;
-            outJ["pnls"][sprdNm] = pSprd.second->m_pSignal->m_pnl;
-            
-            // Persist dynamic grid state
-            outJ["dynamic_factor_long"][sprdNm] = pSprd.second->m_pSignal->m_dynamicFactorLong;
-            outJ["dynamic_factor_short"][sprdNm] = pSprd.second->m_pSignal->m_dynamicFactorShort;
-            outJ["num_opens_long"][sprdNm] = pSprd.second->m_pSignal->m_numOpensLong;
-            outJ["num_opens_short"][sprdNm] = pSprd.second->m_pSignal->m_numOpensShort;
-            outJ["profitable_closes_long"][sprdNm] = pSprd.second->m_pSignal->m_profitableClosesLong;
-            outJ["profitable_closes_short"][sprdNm] = pSprd.second->m_pSignal->m_profitableClosesShort;
-            
-            // Persist risk management state
-            outJ["in_risk_mode"][sprdNm] = pSprd.second->m_pSignal->m_inRiskMode;
-            outJ["reduced_leg"][sprdNm] = pSprd.second->m_pSignal->m_reducedLeg;
-            outJ["reduced_amount"][sprdNm] = pSprd.second->m_pSignal->m_reducedAmount;
-            outJ["reduced_direction"][sprdNm] = pSprd.second->m_pSignal->m_reducedDirection;
-            outJ["arbitrage_pos"][sprdNm] = pSprd.second->m_pSignal->m_arbitragePos;
-            outJ["risk_pos"][sprdNm] = pSprd.second->m_pSignal->m_riskPos;
-            
-            // Persist daily high/low history
-            json dailyHighLowsArray = json::array();
-            for (const auto& dayData : pSprd.second->m_pSignal->m_dailyHighLows)
-            {
-                json dayObj;
-                dayObj["day"] = dayData.tradingDay;
-                dayObj["high"] = dayData.dailyHigh;
-                dayObj["low"] = dayData.dailyLow;
-                dailyHighLowsArray.push_back(dayObj);
-            }
-            outJ["daily_high_lows"][sprdNm] = dailyHighLowsArray;
-            outJ["current_day"][sprdNm] = pSprd.second->m_pSignal->m_currentDay;
-            outJ["current_day_high"][sprdNm] = pSprd.second->m_pSignal->m_currentDayHigh;
-            outJ["current_day_low"][sprdNm] = pSprd.second->m_pSignal->m_currentDayLow;
+        CSpreadSignal *pSig = m_pSpreadManager->getSignal(std::string(r.m_key));
+        switch (r.m_type)
+        {
+        case CJournal::RT_Exec:
+            pSig->m_pos = r.m_i[3];
+            pSig->m_numOpensLong = r.m_i[4];
+            pSig->m_numOpensShort = r.m_i[5];
+            pSig->m_profitableClosesLong = r.m_i[6];
+            pSig->m_profitableClosesShort = r.m_i[7];
+            pSig->m_atp = r.m_d[2];
+            pSig->m_dnPnl = r.m_d[3];
+            pSig->m_diPnl = r.m_d[4];
+            pSig->m_pnl = r.m_d[5];
+            break;
+        case CJournal::RT_DynFactor:
+            pSig->m_dynamicFactorLong = r.m_d[0];
+            pSig->m_dynamicFactorShort = r.m_d[1];
+            break;
+        case CJournal::RT_Risk:
+            pSig->m_reducedLeg = r.m_tag;
+            pSig->m_inRiskMode = r.m_i[0];
+            pSig->m_breakDirection = r.m_i[1];
+            pSig->m_reducedDirection = r.m_i[2];
+            pSig->m_arbitragePos = r.m_i[3];
+            pSig->m_riskPos = r.m_i[4];
+            pSig->m_reducedAmount = r.m_d[1];
+            break;
         }
-        outJ["trd_sprds"] = trdSprds;
-        outJ["sprds"] = spreads;
-
-        std::ofstream o(m_env.m_dataFn);
-        o << std::setw(4) << outJ << std::endl;
-        if (prt)
-            g_pMercLog->log("[SYNC_DATA]%s", outJ.dump().c_str());
+    }
+    void logPersister()
+    {
+        g_pMercLog->log("[persist],%s,%s,writes,%llu,failures,%llu,lastKB,%llu,maxWriteMs,%g,historyWrites,%llu", m_env.m_strategyName, m_env.m_dataFn.c_str(),
+            m_persister.m_writes.load(), m_persister.m_failures.load(), m_persister.m_lastBytes.load() / 1024, m_persister.m_maxWriteNs.load() * 1e-6,
+            m_persister.m_historyWrites.load());
     }
 
     void loadInsts(std::vector<const CInstrument *> &instruments)
@@ -4154,10 +7141,22 @@ public:
                 CFutureExtentionAE *pFuture = new CFutureExtentionAE(instRef,this,&m_env,pInst,pSignal);
                 pFuture->checkStaticError();
                 m_pFutures[instRef] = pFuture;
+                pFuture->m_slot = int(m_futureSlots.size());
+                m_futureSlots.push_back(pFuture);
                 /* int futMonth = dt2Mth(pFuture->m_pMD->m_expirationDate); */
                 /* g_pMercLog->log("%s,startSubscribe,INST,%s,futMonth,%d,preOI,%d",m_env.m_strategyName,instrumentID, futMonth, pFuture->preOI()); */
             }
         }
+        int maxRef = m_pFutures.empty() ? -1 : m_pFutures.rbegin()->first;
+        if (!m_pFutures.empty() && (m_pFutures.begin()->first < 0 || maxRef >= (1 << 24)))
+        {
+            g_pMercLog->log("%s|exit: instrument refs %d..%d do not fit a dense table",m_env.m_strategyName,m_pFutures.begin()->first,maxRef);
+            exit(1);
+        }
+        m_slotByRef.assign(maxRef + 1, -1);
+        for (auto pFuture: m_futureSlots) m_slotByRef[pFuture->m_pInstrument->getInstrumentRef()] = pFuture->m_slot;
+        m_triggerEnds.assign(m_futureSlots.size(), 0);
+        m_pFuzzySorter->finishSubscribe();
         m_pSignalManager->freeSignal(m_nameMap);
         g_pMercLog->log("%s,finish subscribe,%d,%s,prod %s,insts %d",
                         m_env.m_strategyName, m_env.m_pStrategy->getTradingDay(), getTimeString(m_buffer, m_env.m_pStrategy->getCurTimeStamp(), true),m_env.m_productName,int(m_pFutures.size()));
@@ -4170,8 +7169,35 @@ public:
         {
             createSpreadsByManSprds();
         }
+        selectTradable();
+
+        freeSpreadSignal();
+        g_pMercLog->log("%s,created spreads,count %d,tradable %d",m_env.m_strategyName,int(m_pSpreads.size()),int(m_pTrdSprds.size()));
+
+        updateBiasSlf();
+
+        bool toSyncData = false;
+        for (auto& it : m_pTrdSprds)
+        {
+            m_pCurTimeStamp = getCurTimeStampPtr();
+            it.second->trySignal(0, *m_pCurTimeStamp, toSyncData);
+        }
+        if (m_env.m_deferWork > 0)
+        {
+            m_deferred.reserve(int(m_pSpreads.size()));
+            for (auto& it : m_pSpreads) it.second->m_pDeferred = &m_deferred;
+        }
+        // a standby writes nothing until it takes over: the files and the mirror are the primary's
+        if (!m_standby) startPersistence();
+    }
+    // tradable: spreads with a position or no self constraint, from the positions their signals hold now
+    void selectTradable()
+    {
+        m_pTrdSprds.clear();
         for (auto& it : m_pSpreads)
         {
+            it.second->refreshPos();
+            it.second->internalConstrain();
             it.second->preTradeConstrain();
             if (it.second->m_pos!=0 || it.second->m_selfConstrain==0)
             {
@@ -4184,20 +7210,184 @@ public:
             g_pMercLog->log("[createSpreads],m_pSpreads,%s,pos,%d,slfConstrain,%d", it.second->m_sprdNm.c_str(), it.second->m_pos, it.second->m_selfConstrain);
         for (auto& it : m_pTrdSprds)
             g_pMercLog->log("[createSpreads],m_pTrdSprds,%s", it.second->m_sprdNm.c_str());
-
-        freeSpreadSignal();
-        g_pMercLog->log("%s,created spreads,count %d,tradable %d",m_env.m_strategyName,int(m_pSpreads.size()),int(m_pTrdSprds.size()));
-
-        updateBiasSlf();
-
-        bool toSyncData = false;
+        m_legSpreads.assign(m_futureSlots.size(), std::vector<CSpreadExtentionAE *>());
         for (auto& it : m_pTrdSprds)
         {
-            m_pCurTimeStamp = getCurTimeStampPtr();
-            it.second->trySignal(0, *m_pCurTimeStamp, toSyncData);
+            for (auto pLeg: it.second->m_pLegs)
+            {
+                std::vector<CSpreadExtentionAE *> &spreads = m_legSpreads[pLeg->m_slot];
+                if (spreads.empty() || spreads.back() != it.second) spreads.push_back(it.second);
+            }
         }
-        if (toSyncData)
-            syncData();
+    }
+    void startPersistence()
+    {
+        for (auto& it : m_pSpreads) it.second->m_pJournal = m_journal.isOpen() ? &m_journal : NULL;
+        m_persister.start(m_env.m_dataFn, m_env.m_persistMs, m_env.m_stateSnapshot > 0, m_journal.seq(), m_pFutures, m_pSpreads, m_pTrdSprds);
+        g_pMercLog->log("[persist],%s,%s,intervalMs,%d,snapshot,%d", m_env.m_strategyName, m_env.m_dataFn.c_str(), m_env.m_persistMs, m_env.m_stateSnapshot);
+        openMirror();
+    }
+    // POSIX names take no further slash
+    std::string mirrorName(const std::string &stateName)
+    {
+        std::string name = "/" + std::string(m_env.m_shmNmPrefix) + stateName + ".ezdg";
+        std::replace(name.begin()+1, name.end(), '/', '_');
+        return name;
+    }
+    void openMirror()
+    {
+        if (m_env.m_shmMirror <= 0 || m_pReplay != NULL) return;
+        std::string name = mirrorName(m_stateName);
+        std::vector<std::string> sprdNms;
+        std::vector<bool> tradable;
+        for (auto& it : m_pSpreads)
+        {
+            it.second->m_mirrorSlot = int(sprdNms.size());
+            sprdNms.push_back(it.second->m_sprdNm);
+            tradable.push_back(m_pTrdSprds.find(it.first) != m_pTrdSprds.end());
+        }
+        bool opened = m_mirror.open(name, m_env.m_strategyName, getTradingDay(), sprdNms, tradable);
+        g_pMercLog->log("[mirror],%s,%s,spreads,%d,opened,%d,errno,%d", m_env.m_strategyName, name.c_str(), int(sprdNms.size()), opened, opened ? 0 : errno);
+        if (!opened) return;
+        m_pCurTimeStamp = getCurTimeStampPtr();
+        for (auto& it : m_pSpreads) publishSpread(it.second);
+    }
+    // Trading thread: a few dozen stores into the segment, no syscall
+    void publishSpread(CSpreadExtentionAE *pSpread)
+    {
+        if (!m_mirror.isOpen() || pSpread->m_mirrorSlot < 0) return;
+        const CSpreadSignal *pSig = pSpread->m_pSignal;
+        CShmMirror::CSpreadRecord *pRec = m_mirror.begin(pSpread->m_mirrorSlot);
+        pRec->m_pos = pSig->m_pos;
+        pRec->m_timeStamp = *m_pCurTimeStamp;
+        pRec->m_processing = pSpread->m_pSpreadExec->isProcessing();
+        pRec->m_updateNs = nowNanos();
+        pRec->m_buy = pSpread->m_buy;
+        pRec->m_sell = pSpread->m_sell;
+        pRec->m_refMid = pSpread->m_refMid;
+        pRec->m_spBP = pSpread->m_spBP;
+        pRec->m_spAP = pSpread->m_spAP;
+        pRec->m_entryIntervalLong = pSig->m_entryIntervalLong;
+        pRec->m_entryIntervalShort = pSig->m_entryIntervalShort;
+        pRec->m_exitInterval = pSpread->m_exitInterval;
+        pRec->m_dynamicFactorLong = pSig->m_dynamicFactorLong;
+        pRec->m_dynamicFactorShort = pSig->m_dynamicFactorShort;
+        pRec->m_inRiskMode = pSig->m_inRiskMode;
+        pRec->m_reducedDirection = pSig->m_reducedDirection;
+        pRec->m_arbitragePos = pSig->m_arbitragePos;
+        pRec->m_riskPos = pSig->m_riskPos;
+        pRec->m_reducedAmount = pSig->m_reducedAmount;
+        pRec->m_atp = pSig->m_atp;
+        pRec->m_diPnl = pSig->m_diPnl;
+        pRec->m_dnPnl = pSig->m_dnPnl;
+        pRec->m_pnl = pSig->m_pnl;
+        m_mirror.end(pRec);
+        m_mirror.beat(pRec->m_updateNs);
+    }
+
+    // Standby: apply the primary's new journal records and take over order entry once its heartbeat
+    // stops. Called from the idle loop and the quote path, at most once a millisecond
+    std::string stateLockName()
+    {
+        return m_env.m_dataFn + ".lock";
+    }
+    // primary only: exits when another process holds the lock
+    void takeStateLock()
+    {
+        if (m_stateLock.tryLock(stateLockName().c_str())) return;
+        int err = errno;
+        int pid = m_stateLock.holder(stateLockName().c_str());
+        if (pid > 0)
+        {
+            g_pMercLog->log("%s,exit: %s held by pid %d",m_env.m_strategyName,stateLockName().c_str(),pid);
+            exit(1);
+        }
+        // no other holder seen: the file or the lock call failed. Trade without it; a standby never takes over
+        m_stateLock.close();
+        g_pMercLog->log("%s,STATE LOCK NOT TAKEN,%s,errno,%d,%s,standby takeover off",m_env.m_strategyName,stateLockName().c_str(),err,strerror(err));
+    }
+    void pollStandby()
+    {
+        long long now = nowNanos();
+        if (now < m_standbyNextNs) return;
+        m_standbyNextNs = now + 1000000;
+        if (!m_walTail.isOpen()) m_walTail.open((m_env.m_dataFn + ".wal").c_str(), m_pSpreadManager->m_journalSeq);
+        m_standbyApplied += m_walTail.poll([this](const CJournal::CRecord &r) { applyJournal(r); });
+        // the mirror only carries the heartbeat for the period line; the lock decides
+        if (m_pPrimary == NULL)
+        {
+            m_pPrimary = CShmMirror::attach(mirrorName(m_env.m_standbyOf), m_primarySize);
+            if (m_pPrimary != NULL)
+                g_pMercLog->log("[standby],%s,attached,%s,pid,%d", m_env.m_strategyName, m_env.m_standbyOf, CShmMirror::header(m_pPrimary)->m_pid);
+        }
+        int pid = m_stateLock.holder(stateLockName().c_str());
+        if (pid != 0)
+        {
+            if (pid > 0 && pid != m_primaryPid)
+            {
+                g_pMercLog->log("[standby],%s,primary,%s,pid,%d,previous,%d", m_env.m_strategyName, m_env.m_standbyOf, pid, m_primaryPid);
+                m_primaryPid = pid;
+                // a restarted primary recreates its segment under the same name: attach the new one next poll
+                CShmMirror::detach(m_pPrimary, m_primarySize);
+                m_pPrimary = NULL;
+            }
+            return;
+        }
+        // free: the primary's process is gone, or no primary ran yet and there is nothing to take over
+        if (m_primaryPid == 0) return;
+        if (!m_stateLock.tryLock(stateLockName().c_str())) return;
+        takeOver();
+    }
+    // The state lock is ours: the primary is gone. Re-derive everything the standby left at its startup
+    // values from the state the journal brought forward, then trade
+    void takeOver()
+    {
+        long long t0 = nowNanos();
+        long long gapNs = m_pPrimary != NULL ? t0 - CShmMirror::header(m_pPrimary)->m_heartbeatNs : -1;
+        m_standbyApplied += m_walTail.poll([this](const CJournal::CRecord &r) { applyJournal(r); });
+        std::string walFn = m_env.m_dataFn + ".wal";
+        if (!m_journal.open(walFn.c_str(), m_walTail.seq()))
+        {
+            g_pMercLog->log("%s,exit: journal %s not opened",m_env.m_strategyName,walFn.c_str());
+            exit(1);
+        }
+        m_walTail.close();
+        CShmMirror::detach(m_pPrimary, m_primarySize);
+        m_pPrimary = NULL;
+        m_standby = false;
+        // positions and the tradable set were taken when the standby started; the primary moved on since
+        selectTradable();
+        updateInstTriggerMap();
+        m_triggerStart = m_sweptEnd = 0;
+        startPersistence();
+        controlPositionLimit();
+        updateBiasSlf();
+        updateConstrain();
+        refreshRiskStatus();
+        markSpreadsChanged();
+        syncData();
+        restoreExecs();
+        g_pMercLog->log("[standby],%s,takeover,%s,pid,%d,heartbeatGapMs,%g,applied,%llu,seq,%llu,tradable,%d,takeoverMs,%g", m_env.m_strategyName,
+            m_env.m_standbyOf, m_primaryPid, gapNs * 1e-6, m_standbyApplied, m_journal.seq(), int(m_pTrdSprds.size()), (nowNanos() - t0) * 1e-6);
+    }
+    void logStandby()
+    {
+        long long gapNs = m_pPrimary != NULL ? nowNanos() - CShmMirror::header(m_pPrimary)->m_heartbeatNs : -1;
+        g_pMercLog->log("[standby],%s,following,%s,pid,%d,mirror,%d,heartbeatGapMs,%g,stalled,%d,applied,%llu,seq,%llu", m_env.m_strategyName,
+            m_env.m_standbyOf, m_primaryPid, m_pPrimary != NULL, gapNs * 1e-6, gapNs > m_env.m_failoverMs * 1000000LL, m_standbyApplied, m_walTail.seq());
+        if (m_primaryPid == 0) g_pMercLog->log("[standby],%s,NO PRIMARY,%s,holds no lock on %s,takeover off until one does", m_env.m_strategyName, m_env.m_standbyOf, stateLockName().c_str());
+    }
+    // The lock file was removed or replaced under a running primary: a standby could lock the new one
+    void checkStateLock()
+    {
+        long long now = nowNanos();
+        if (!m_stateLock.isHeld() || now < m_lockCheckNs) return;
+        m_lockCheckNs = now + 100000000;
+        if (m_stateLock.isValid() || m_env.m_enableTrade == 0) return;
+        m_env.m_enableTrade = 0;
+        g_pMercLog->log("%s,LOST state lock %s, trading halted",m_env.m_strategyName,stateLockName().c_str());
+        updateConstrain();
+        refreshRiskStatus();
     }
 
     void createSpreadsByManSprds()
@@ -4266,6 +7456,7 @@ public:
             int id = m_pSpreads.size();
             CSpreadExtentionAE *pSpread = new CSpreadExtentionAE(id, this, &m_env, m_pFuzzySorter);
             pSpread->initComb(pLegs, coefs, exeCoefs);
+            pSpread->m_sendRiskOrder = [this](const CInstrument *pInstrument, int direction, double price, int volume) { return sendRiskOrder(pInstrument, direction, price, volume); };
 
             bool inXst = find(xstSprds.begin(), xstSprds.end(), manSprdNm) != xstSprds.end();
             bool inMan = find(m_env.m_manSprds.begin(), m_env.m_manSprds.end(), manSprdNm) != m_env.m_manSprds.end();
@@ -4370,6 +7561,7 @@ public:
             pSpread->finishComb(pSignal);
 
             m_pSpreads[id] = pSpread;
+            m_spreadSlots.push_back(pSpread);
         }
     }
     void freeSpreadSignal()
@@ -4449,76 +7641,450 @@ public:
         m_pTradeControl->addConstrain(constrain);
     }
     virtual void notifyMarketData(const CMarketData *pMarketData,int tag)
+    {
+        if (m_pReplay != NULL) return;
+#if ALLOC_COUNT
+        unsigned long long allocBefore = allocCount();
+#endif
+        if (m_recorder.isOpen()) recordMarketData(pMarketData, tag);
+        if (m_env.m_benchLatency > 0 && m_strategyReady)
+        {
+            int sentBefore = m_sentOrderCount;
+            long long t0 = nowNanos();
+            internalNotifyMarketData(pMarketData, tag);
+            long long t1 = nowNanos();
+            benchTick(t0, t1, m_sentOrderCount != sentBefore);
+        }
+        else
+        {
+            internalNotifyMarketData(pMarketData, tag);
+        }
+#if ALLOC_COUNT
+        if (m_strategyReady) m_mdAllocs.add(allocCount() - allocBefore);
+#endif
+    }
+    void recordMarketData(const CMarketData *pMarketData, int tag)
+    {
+        CFlightRecorder::CEvent *pEvent = m_recorder.claim(CFlightRecorder::EV_MarketData, getCurTimeStamp());
+        if (pEvent == NULL) return;
+        pEvent->m_i[0] = tag;
+        pEvent->m_i[1] = pMarketData->getUpdateTimeStamp();
+        pEvent->m_i[2] = pMarketData->getBidVolume();
+        pEvent->m_i[3] = pMarketData->getAskVolume();
+        pEvent->m_i[4] = pMarketData->getVolume();
+        pEvent->m_d[0] = pMarketData->getLastPrice();
+        pEvent->m_d[1] = pMarketData->getBidPrice();
+        pEvent->m_d[2] = pMarketData->getAskPrice();
+        m_recorder.commit();
+    }
+    void recordOrder(const COrderSlot *pSlot, bool isFirstTime)
+    {
+        CFlightRecorder::CEvent *pEvent = m_recorder.claim(CFlightRecorder::EV_Order, getCurTimeStamp());
+        if (pEvent == NULL) return;
+        pEvent->m_flag = isFirstTime ? CFlightRecorder::FL_FirstTime : 0;
+        if (pSlot->m_finished) pEvent->m_flag |= CFlightRecorder::FL_Finished;
+        if (pSlot->m_rejected) pEvent->m_flag |= CFlightRecorder::FL_Rejected;
+        pEvent->m_i[0] = pSlot->m_orderID;
+        pEvent->m_i[1] = pSlot->m_orderType;
+        pEvent->m_i[2] = pSlot->m_orderID;
+        pEvent->m_i[3] = pSlot->m_tradeVlm;
+        pEvent->m_i[4] = pSlot->m_direction;
+        m_recorder.commit();
+    }
+    void recordForeignOrder(const CMercStrategyOrderItem *pOrderItem, bool isFirstTime)
+    {
+        CFlightRecorder::CEvent *pEvent = m_recorder.claim(CFlightRecorder::EV_Order, getCurTimeStamp());
+        if (pEvent == NULL) return;
+        const COrder *pOrder = pOrderItem->m_pOrder;
+        pEvent->m_flag = isFirstTime ? CFlightRecorder::FL_FirstTime : 0;
+        pEvent->m_i[0] = pOrderItem->m_userInt1;
+        pEvent->m_i[1] = ORDER_UNTRACKED;
+        if (pOrder != NULL)
+        {
+            if (pOrder->isFinished()) pEvent->m_flag |= CFlightRecorder::FL_Finished;
+            if (pOrder->isRejected()) pEvent->m_flag |= CFlightRecorder::FL_Rejected;
+            pEvent->m_i[2] = pOrder->getOrderRef();
+            pEvent->m_i[3] = pOrder->getTradeVolume();
+            pEvent->m_i[4] = pOrder->getDirection();
+        }
+        m_recorder.commit();
+    }
+    void recordTrade(const COrderSlot *pSlot, int orderID, int instRef, int direction, int volume, double price)
+    {
+        CFlightRecorder::CEvent *pEvent = m_recorder.claim(CFlightRecorder::EV_Trade, getCurTimeStamp());
+        if (pEvent == NULL) return;
+        pEvent->m_i[0] = orderID;
+        pEvent->m_i[1] = pSlot != NULL ? pSlot->m_orderType : ORDER_UNTRACKED;
+        pEvent->m_i[2] = instRef;
+        pEvent->m_i[3] = direction;
+        pEvent->m_i[4] = volume;
+        if (pSlot != NULL)
+        {
+            // order state as seen by checkOrderFinished right after this fill
+            if (pSlot->m_finished) pEvent->m_flag |= CFlightRecorder::FL_Finished;
+            if (pSlot->m_rejected) pEvent->m_flag |= CFlightRecorder::FL_Rejected;
+            pEvent->m_i[5] = pSlot->m_tradeVlm;
+        }
+        pEvent->m_d[0] = price;
+        m_recorder.commit();
+    }
+    void recordSend(const CInstrument *pInstrument, int orderID, int type, int direction, double price, int volume, int reason)
+    {
+        CFlightRecorder::CEvent *pEvent = m_recorder.claim(CFlightRecorder::EV_Send, getCurTimeStamp());
+        if (pEvent == NULL) return;
+        pEvent->m_i[0] = orderID;
+        pEvent->m_i[1] = pInstrument->getInstrumentRef();
+        pEvent->m_i[2] = type;
+        pEvent->m_i[3] = direction;
+        pEvent->m_i[4] = volume;
+        pEvent->m_i[5] = reason;
+        pEvent->m_d[0] = price;
+        m_recorder.commit();
+    }
+    void recordEvent(int type, int i0, int i1=0, int i2=0, double d0=0.0)
+    {
+        CFlightRecorder::CEvent *pEvent = m_recorder.claim(type, getCurTimeStamp());
+        if (pEvent == NULL) return;
+        pEvent->m_i[0] = i0;
+        pEvent->m_i[1] = i1;
+        pEvent->m_i[2] = i2;
+        pEvent->m_d[0] = d0;
+        m_recorder.commit();
+    }
+    void recordReady()
+    {
+        if (m_recorder.isOpen()) recordEvent(CFlightRecorder::EV_Ready, int(m_pFutures.size()), int(m_pSpreads.size()), int(m_pTrdSprds.size()), double(m_randSeed));
+    }
+    void logRecorder(bool force=false)
+    {
+        if (!m_recorder.isOpen() || (!force && m_recorder.dropped() == m_recordDropped)) return;
+        g_pMercLog->log("[flightRecorder],%s,events,%llu,dropped,%llu", m_env.m_strategyName, m_recorder.recorded(), m_recorder.dropped());
+        m_recordDropped = m_recorder.dropped();
+    }
+    // Feeds the recorded session after its strategyReady marker back through the internal entry
+    // points on the recorded clock. Sends and cancels are diverted and matched against the recording
+    void runReplay()
+    {
+        CFlightReplay &replay = *m_pReplay;
+        const CFlightReplay::CEvent &ready = replay.at(replay.readyIndex());
+        if (ready.m_i[0] != int(m_pFutures.size()) || ready.m_i[1] != int(m_pSpreads.size()) || ready.m_i[2] != int(m_pTrdSprds.size()))
+        {
+            g_pMercLog->log("[replay],%s,readyMismatch,futures,%d,%d,spreads,%d,%d,tradable,%d,%d", m_env.m_strategyName,
+                ready.m_i[0], int(m_pFutures.size()), ready.m_i[1], int(m_pSpreads.size()), ready.m_i[2], int(m_pTrdSprds.size()));
+        }
+        if (ready.m_d[0] != 0.0)
+        {
+            srand((unsigned)ready.m_d[0]);
+        }
+        m_pCurTimeStamp = &m_replayTS;
+        int inputs = 0;
+        long long t0 = nowNanos();
+        for (int i=replay.readyIndex()+1; i<replay.size(); i++)
+        {
+            if (!replay.feed(i)) continue;
+            const CFlightReplay::CEvent &event = replay.at(i);
+            m_replayTS = event.m_curTS;
+            replayEvent(event);
+            inputs++;
+        }
+        long long t1 = nowNanos();
+        m_pCurTimeStamp = getCurTimeStampPtr();
+
+        int missingSends = replay.remaining(CFlightRecorder::EV_Send);
+        int missingCancels = replay.remaining(CFlightRecorder::EV_Cancel);
+        bool identical = replay.m_mismatched == 0 && replay.m_extra == 0 && missingSends == 0 && missingCancels == 0;
+        double recordedMs = (replay.at(replay.size()-1).m_ns - ready.m_ns) * 1e-6;
+        double replayMs = (t1 - t0) * 1e-6;
+        g_pMercLog->log("[replay],%s,done,inputs,%d,matched,%llu,mismatched,%llu,extra,%llu,missingSends,%d,missingCancels,%d,identical,%d,replayMs,%g,recordedMs,%g,speedup,%g",
+            m_env.m_strategyName, inputs, replay.m_matched, replay.m_mismatched, replay.m_extra, missingSends, missingCancels, identical,
+            replayMs, recordedMs, replayMs > 0 ? recordedMs / replayMs : 0.0);
+        logBenchLatency("Replay");
+        drainDeferred(false);
+        syncData(true);
+    }
+    void replayEvent(const CFlightReplay::CEvent &event)
+    {
+        switch (event.m_type)
+        {
+        case CFlightRecorder::EV_MarketData:
+        {
+            int sentBefore = m_sentOrderCount;
+            long long t0 = nowNanos();
+            internalNotifyQuote(event.m_i[0], event.m_i[1], event.m_i[2], event.m_i[3], event.m_d[0], event.m_d[1], event.m_d[2], event.m_i[4]);
+            benchTick(t0, nowNanos(), m_sentOrderCount != sentBefore);
+            break;
+        }
+        case CFlightRecorder::EV_Order:
+        {
+            COrderSlot *pSlot = event.m_i[1] != ORDER_UNTRACKED ? m_orderTable.get(event.m_i[0]) : NULL;
+            if (pSlot == NULL) break;
+            pSlot->m_finished = (event.m_flag & CFlightRecorder::FL_Finished) != 0;
+            pSlot->m_rejected = (event.m_flag & CFlightRecorder::FL_Rejected) != 0;
+            pSlot->m_tradeVlm = event.m_i[3];
+            pSlot->m_direction = event.m_i[4];
+            internalNotifyOrder(pSlot, (event.m_flag & CFlightRecorder::FL_FirstTime) != 0);
+            break;
+        }
+        case CFlightRecorder::EV_Trade:
+        {
+            COrderSlot *pSlot = event.m_i[1] != ORDER_UNTRACKED ? m_orderTable.get(event.m_i[0]) : NULL;
+            if (pSlot != NULL)
+            {
+                pSlot->m_finished = (event.m_flag & CFlightRecorder::FL_Finished) != 0;
+                pSlot->m_rejected = (event.m_flag & CFlightRecorder::FL_Rejected) != 0;
+                pSlot->m_tradeVlm = event.m_i[5];
+                pSlot->m_direction = event.m_i[3];
+            }
+            internalNotifyTrade(pSlot, event.m_i[2], event.m_i[3], event.m_i[4], event.m_d[0]);
+            break;
+        }
+        case CFlightRecorder::EV_Timer:
+        {
+            void *pUser = (event.m_i[1] == TT_ForceTaskTimeOut && event.m_i[2] >= 0) ? m_pForceTaskManager->get(event.m_i[2]) : NULL;
+            internalOnTime(event.m_i[0], event.m_i[1], pUser);
+            break;
+        }
+        case CFlightRecorder::EV_Command:
+        {
+            CMercStrategyCommand command;
+            memset(&command, 0, sizeof(command));
+            command.CommandID = event.m_i[0];
+            command.Index[0] = event.m_i[1];
+            command.IntValue[0] = event.m_i[2];
+            command.FloatValue[0] = event.m_d[0];
+            applyCommand(&command);
+            break;
+        }
+        default:
+            break;
+        }
+    }
+    // recorded orderID for a diverted send, -1 when the live send failed or the recording has no more
+    int replaySend(const CInstrument *pInstrument, int type, int direction, double price, int volume, int reason)
+    {
+        const CFlightReplay::CEvent *pEvent = m_pReplay->expect(CFlightRecorder::EV_Send);
+        int instRef = pInstrument->getInstrumentRef();
+        if (pEvent == NULL)
+        {
+            m_pReplay->m_extra++;
+            logReplayMismatch("extraSend", -1, instRef, type, direction, volume, reason, price);
+            return -1;
+        }
+        if (m_pReplay->sameStep(pEvent) && pEvent->m_i[1] == instRef && pEvent->m_i[2] == type && pEvent->m_i[3] == direction
+            && pEvent->m_i[4] == volume && pEvent->m_i[5] == reason && pEvent->m_d[0] == price)
+        {
+            m_pReplay->m_matched++;
+        }
+        else
+        {
+            m_pReplay->m_mismatched++;
+            logReplayMismatch("send", pEvent->m_curTS, pEvent->m_i[1], pEvent->m_i[2], pEvent->m_i[3], pEvent->m_i[4], pEvent->m_i[5], pEvent->m_d[0]);
+            logReplayMismatch("sendReplayed", *m_pCurTimeStamp, instRef, type, direction, volume, reason, price);
+        }
+        return pEvent->m_i[0];
+    }
+    void replayCancel(const COrderSlot *pSlot)
+    {
+        const CFlightReplay::CEvent *pEvent = m_pReplay->expect(CFlightRecorder::EV_Cancel);
+        if (pEvent != NULL && m_pReplay->sameStep(pEvent) && pEvent->m_i[0] == pSlot->m_orderID)
+        {
+            m_pReplay->m_matched++;
+        }
+        else
+        {
+            if (pEvent == NULL) m_pReplay->m_extra++;
+            else m_pReplay->m_mismatched++;
+            logReplayMismatch("cancel", *m_pCurTimeStamp, pSlot->m_orderID, pSlot->m_orderType, 0, 0, 0, 0.0);
+        }
+    }
+    void logReplayMismatch(const char *what, int ts, int i0, int i1, int i2, int i3, int i4, double d0)
+    {
+        // the first divergence is what matters, later ones mostly follow from it
+        if (m_pReplay->m_mismatched + m_pReplay->m_extra > 20) return;
+        g_pMercLog->log("[replay],%s,%s,ts,%d,%d,%d,%d,%d,%d,%g", m_env.m_strategyName, what, ts, i0, i1, i2, i3, i4, d0);
+    }
+    void benchTick(long long t0, long long t1, bool hasOrder)
+    {
+        if (m_benchFirstNs == 0) m_benchFirstNs = t0;
+        m_benchLastNs = t1;
+        m_tickLat.add(t1 - t0);
+        if (hasOrder) m_tickOrderLat.add(t1 - t0);
+    }
+    void logBenchLatency(const char *stage)
+    {
+        if (m_env.m_benchLatency <= 0 || m_tickLat.count() == 0) return;
+        double busySec = m_tickLat.sum() * 1e-9;
+        double wallSec = (m_benchLastNs - m_benchFirstNs) * 1e-9;
+        g_pMercLog->log("[benchLatency],%s,%s,ticks,%llu,p50,%lld,p99,%lld,p999,%lld,max,%lld,mean,%g,busyTps,%g,wallTps,%g,rssKB,%ld",
+            m_env.m_strategyName, stage, m_tickLat.count(), m_tickLat.percentile(0.5), m_tickLat.percentile(0.99), m_tickLat.percentile(0.999),
+            m_tickLat.max(), m_tickLat.mean(), busySec > 0 ? m_tickLat.count() / busySec : 0.0, wallSec > 0 ? m_tickLat.count() / wallSec : 0.0, rssKB());
+        g_pMercLog->log("[benchLatency],%s,%s,orderTicks,%llu,p50,%lld,p99,%lld,p999,%lld,max,%lld,mean,%g",
+            m_env.m_strategyName, stage, m_tickOrderLat.count(), m_tickOrderLat.percentile(0.5), m_tickOrderLat.percentile(0.99),
+            m_tickOrderLat.percentile(0.999), m_tickOrderLat.max(), m_tickOrderLat.mean());
+    }
+    void internalNotifyMarketData(const CMarketData *pMarketData,int tag)
+    {
+        internalNotifyQuote(tag, pMarketData->getUpdateTimeStamp(), pMarketData->getBidVolume(), pMarketData->getAskVolume(),
+            pMarketData->getLastPrice(), pMarketData->getBidPrice(), pMarketData->getAskPrice(), pMarketData->getVolume());
+    }
+    void internalNotifyQuote(int tag, int updateTS, int bq, int aq, double lp, double bp, double ap, int lv)
     {
         if (m_pTradeControl->m_onDayEnd || !m_strategyReady)
         {
             return;
         }
+#if TSC
+        m_mdArrivalTsc = readTsc();
+#endif
+        if (m_pSim != NULL) m_pSim->onQuote(tag, bp, bq, ap, aq, *m_pCurTimeStamp);
         int constrain = m_pTradeControl->getTradeConstrain();
-        CFutureExtentionAE *pFuture = m_pFutures[tag];
-        bool toSyncData = false;
+        CFutureExtentionAE *pFuture = futureByRef(tag);
+        if (m_standby)
+        {
+            // prices and scores stay current for the takeover; no decisions until then
+            pFuture->updatePrice(bq, aq, lp, bp, ap, lv);
+            m_mdTS = updateTS;
+            m_pFuzzySorter->updateOne(tag, *m_pCurTimeStamp, m_mdTS);
+            pollStandby();
+            return;
+        }
         if (constrain < 4)
         {
-            pFuture->updatePrice(pMarketData);
+            pFuture->updatePrice(bq, aq, lp, bp, ap, lv);
+            for (auto pSpread: m_legSpreads[pFuture->m_slot]) pSpread->m_legsChanged = true;
             triggerForceOrder(pFuture);
 
             int ts = *m_pCurTimeStamp;
-            m_mdTS = pMarketData->getUpdateTimeStamp();
+            m_mdTS = updateTS;
             bool isNewSnap = m_pFuzzySorter->updateOne(tag,ts,m_mdTS)>0;
+            // the ranking moves tick by tick; the trigger order follows it between bursts
+            if (isNewSnap && m_pFuzzySorter->version() != m_triggerVersion) updateInstTriggerMap();
             bool isSafeTS = (pFuture->inSession(m_mdTS) && pFuture->inSession(m_mdTS+15000));
-            toSyncData = triggerSpread(tag,ts,constrain,isNewSnap,isSafeTS);
-
-            if (toSyncData)
-                syncData();
+            triggerSpread(pFuture->m_slot,ts,constrain,isNewSnap,isSafeTS);
         }
         else if (m_pTradeControl->m_onDaySettle && !pFuture->hasOrder())
         {
             dailySettle(tag);
         }
         m_needOnBar=true;
+        pumpSimExchange();
+        if (m_deferred.due(*m_pCurTimeStamp, m_env.m_deferMaxMs)) drainDeferred(false);
     }
-    int triggerSpread(int tag,int ts,int constrain,bool newSnap,bool safeTS)
+    // delivers the simulated exchange's due acks, fills, cancels and rejects
+    void pumpSimExchange()
+    {
+        if (m_pSim == NULL) return;
+        CSimExchange::CReport report;
+        while (m_pSim->poll(*m_pCurTimeStamp, report))
+        {
+            COrderSlot *pSlot = m_orderTable.get(report.m_orderID);
+            if (pSlot == NULL) continue;
+            pSlot->m_finished = report.m_finished;
+            pSlot->m_rejected = report.m_rejected;
+            pSlot->m_tradeVlm = report.m_tradeVolume;
+            if (report.m_volume > 0)
+            {
+                if (m_recorder.isOpen()) recordTrade(pSlot, pSlot->m_orderID, report.m_instRef, report.m_direction, report.m_volume, report.m_price);
+                internalNotifyTrade(pSlot, report.m_instRef, report.m_direction, report.m_volume, report.m_price);
+            }
+            else
+            {
+                if (m_recorder.isOpen()) recordOrder(pSlot, report.m_firstTime);
+                internalNotifyOrder(pSlot, report.m_firstTime);
+            }
+        }
+    }
+    // slot: the quoted future's. A snapshot sweeps m_sortedSpreads once: a quote evaluates the spreads
+    // whose slowest leg ranks up to its own, legs that rank earlier have had their turn to quote. Spreads
+    // already swept on this snapshot are evaluated again only when one of their legs quoted since, and a
+    // leg quoting out of rank re-evaluates the swept spreads it is a leg of, on its new quote
+    void triggerSpread(int slot,int ts,int constrain,bool newSnap,bool safeTS)
     {
-        bool toSyncData = false;
-
         if (newSnap)
         {
-            m_triggerStart = 0;
+            m_triggerStart = m_sweptEnd = 0;
+            m_snapCount++;
         }
-        int triggerEnd = m_instTriggerMap[tag];
+        int triggerEnd = m_triggerEnds[slot];
         for (int i=m_triggerStart;i<triggerEnd;i++)
         {
-            CSpreadExtentionAE *pSpread =  m_pTrdSprds[m_sortedSpreads[i]];
-            CSpreadExec *pExec = pSpread->m_pSpreadExec;
-            if (!pExec->isProcessing() && safeTS)
+            CSpreadExtentionAE *pSpread = m_sortedSpreads[i];
+            if (!pSpread->m_legsChanged && (i < m_sweptEnd || m_env.m_dirtyTrigger > 0))
             {
-                int action = pSpread->trySignal(constrain, ts, toSyncData);
-                if (action != 0)
-                {
-                    int tryLegID = m_env.m_tryLegID > -1? m_env.m_tryLegID: pSpread->chooseLeg(action);
-                    pSpread->notifyExecStarted(action);
-                    pExec->start(action, tryLegID);
-                    sendTryOrder(pExec);
-
-                    syncData();
-                }
+                if (i >= m_sweptEnd) m_skipCount++;
+                continue;
+            }
+            evaluateSpread(pSpread,ts,constrain,safeTS);
+        }
+        for (auto pSpread: m_legSpreads[slot])
+        {
+            int pos = pSpread->m_triggerPos;
+            if ((pos < m_triggerStart || pos >= triggerEnd) && pos < m_sweptEnd && pSpread->m_legsChanged)
+            {
+                if (evaluateSpread(pSpread,ts,constrain,safeTS)) m_lateCount++;
             }
         }
         m_triggerStart = triggerEnd;
-
-        return toSyncData;
+        m_sweptEnd = std::max(m_sweptEnd, triggerEnd);
+    }
+    // returns true when trySignal ran
+    bool evaluateSpread(CSpreadExtentionAE *pSpread,int ts,int constrain,bool safeTS)
+    {
+        CSpreadExec *pExec = pSpread->m_pSpreadExec;
+        if (m_env.m_tickGate > 0 && pSpread->farFromGrid(ts))
+        {
+            pSpread->m_legsChanged = false;
+            m_gateCount++;
+            return false;
+        }
+        if (pExec->isProcessing() || !safeTS) return false;
+        pSpread->m_legsChanged = false;
+        m_evalCount++;
+        bool toSyncData = false;
+        int action = pSpread->trySignal(constrain, ts, toSyncData);
+        if (m_env.m_tickGate > 0)
+        {
+            if (action == 0) pSpread->armGate(constrain);
+            else pSpread->m_gateArmed = false;
+        }
+#if TSC
+        unsigned long long decisionTsc = readTsc();
+        long long mdToDecision = CTscClock::toNanos(decisionTsc - m_mdArrivalTsc);
+        pExec->m_latency.m_mdToDecision.add(mdToDecision);
+        m_latency.m_mdToDecision.add(mdToDecision);
+        pExec->m_decisionTsc = (action != 0) ? decisionTsc : 0;
+#endif
+        if (action != 0)
+        {
+            int tryLegID = m_env.m_tryLegID > -1? m_env.m_tryLegID: pSpread->chooseLeg(action);
+            pSpread->notifyExecStarted(action);
+            pExec->start(action, tryLegID);
+            sendTryOrder(pExec);
+            toSyncData = true;
+        }
+        // after the order went out: observers are not on the decision path
+        if (toSyncData)
+        {
+            syncSpread(pSpread);
+        }
+        else
+        {
+            publishSpread(pSpread);
+        }
+        return true;
     }
     void triggerForceOrder(CFutureExtentionAE *pFuture)
     {
-        for (auto& it : pFuture->m_pForceTasks)
+        for (int workerID=0; workerID<int(pFuture->m_forceTaskIDs.size()); workerID++)
         {
-            CForceTask *pTask = m_pForceTaskManager->get(it.first);
+            if (pFuture->m_forceTaskIDs[workerID] < 0) continue;
+            CForceTask *pTask = m_pForceTaskManager->get(workerID);
             if (pTask!=NULL && pTask->hasTask() && pTask->m_pLeg->m_pInstrument->getInstrumentRef()==pFuture->m_pInstrument->getInstrumentRef())
             {
                 pTask->notifyMD();
                 if (pTask->needResendOrder())
                 {
-                    CSpreadExec *pExec = m_pTrdSprds[pTask->spreadID()]->m_pSpreadExec;
+                    CSpreadExec *pExec = m_spreadSlots[pTask->spreadID()]->m_pSpreadExec;
                     if(!sendForceOrder(pExec, pTask))
                     {
                         return;
@@ -4527,29 +8093,56 @@ public:
             }
         }
     }
-    const CMercStrategyOrderItem *sendOrder(const CInstrument *pInstrument,int type,int direction,double price,int volume, int reason)
+    COrderSlot *sendOrder(const CInstrument *pInstrument,int type,int direction,double price,int volume, int reason)
     {
-        CInputOrder inputOrder;
-        inputOrder.setOrderType(type);
-        inputOrder.setDirection(direction);
-        inputOrder.setPrice(price);
-        inputOrder.setOrderVolume(volume);
-        const CMercStrategyOrderItem *pOrderItem=controledInsertOrder(&inputOrder,pInstrument,m_pAccountManager,m_env.m_offsetStrategy);
-        if (pOrderItem != NULL)
+        const CMercStrategyOrderItem *pOrderItem = NULL;
+        int orderID = -1;
+        // an order that went out must be tracked: refuse to send rather than lose its reports
+        if (m_orderTable.full())
+        {
+            g_pMercLog->log("%s,orderTable full,order not sent,[%s],%d@%g,direction,%d,size,%d", m_env.m_strategyName, pInstrument->getInstrumentID(), volume, price, direction, m_orderTable.size());
+            return NULL;
+        }
+        if (m_pReplay != NULL)
+        {
+            orderID = replaySend(pInstrument, type, direction, price, volume, reason);
+        }
+        else if (m_pSim != NULL)
         {
-            int orderID = inputOrder.getOrderRef();
-            pOrderItem->m_userInt1 = orderID;
-            pOrderItem->m_userLongLong1 = 0;
-            m_orderMap[orderID] = pOrderItem;
+            orderID = m_pSim->submit(pInstrument->getInstrumentRef(), type, direction, price, volume, *m_pCurTimeStamp);
+        }
+        else
+        {
+            CInputOrder inputOrder;
+            inputOrder.setOrderType(type);
+            inputOrder.setDirection(direction);
+            inputOrder.setPrice(price);
+            inputOrder.setOrderVolume(volume);
+            pOrderItem=controledInsertOrder(&inputOrder,pInstrument,m_pAccountManager,m_env.m_offsetStrategy);
+            if (pOrderItem != NULL) orderID = inputOrder.getOrderRef();
+        }
+#if TSC
+        m_lastSendTsc = readTsc();
+#endif
+        if (m_recorder.isOpen()) recordSend(pInstrument, orderID, type, direction, price, volume, reason);
+        if (orderID >= 0)
+        {
+            if (pOrderItem != NULL) pOrderItem->m_userInt1 = orderID;
+            // a free slot was checked before the send
+            COrderSlot *pSlot = m_orderTable.put(orderID);
+            pSlot->m_pItem = pOrderItem;
+            pSlot->m_orderType = ORDER_UNTRACKED;
+            pSlot->m_direction = direction;
+            m_sentOrderCount++;
 #if ODR_REASON
-            // reason: 0-tryorder 1-forceorder 2-others
+            // reason: 0-tryorder 1-forceorder 2-others 3-risk
             g_pMercLog->log("SENDORDER_SUCCEED,TradingDay,%d,MarketDataTimeStamp,%d,InstrumentID,%s,reason,%d,volume,%d,price,%g,direction,%d,type,%d,orderid,%d,errorno,%d", getTradingDay(), m_mdTS, pInstrument->getInstrumentID(), reason, volume, price, direction, type, orderID, getLastErrorNo());
 #endif
-            return pOrderItem;
+            return pSlot;
         }
         else
         {
-            g_pMercLog->log("orderSendFailed|%d_%s,[%s],%d@%g,direction,%d,type,%d", getTradingDay(), getTimeString(m_buffer, getCurTimeStamp(), true), pInstrument->getInstrumentID(), volume, price, direction, type);
+            g_pMercLog->log("orderSendFailed|%d_%s,[%s],%d@%g,direction,%d,type,%d", getTradingDay(), getTimeString(m_buffer, *m_pCurTimeStamp, true), pInstrument->getInstrumentID(), volume, price, direction, type);
             return NULL;
         }
     }
@@ -4561,12 +8154,23 @@ public:
         double price = pExec->m_tryOrderPrice;
         int volume = pExec->m_tryOrderVolume;
         int reason = 0;
-        const CMercStrategyOrderItem *pOrderItem = sendOrder(pExec->pTryInstrument(),type,direction,price,volume, reason);
-        if (pOrderItem!=NULL)
+        COrderSlot *pSlot = sendOrder(pExec->pTryInstrument(),type,direction,price,volume, reason);
+        if (pSlot!=NULL)
         {
-            pOrderItem->m_pUser = pExec;
-            pOrderItem->m_userInt2 = -1;
-            pExec->tryOrderSent(pOrderItem->m_userInt1);
+            pSlot->m_pExec = pExec;
+            pSlot->m_orderType = -1;
+            pExec->tryOrderSent(pSlot->m_orderID);
+#if TSC
+            pExec->m_tryOrderSentTsc = m_lastSendTsc;
+            if (pExec->m_decisionTsc != 0)
+            {
+                long long tickToOrder = CTscClock::toNanos(m_lastSendTsc - m_mdArrivalTsc);
+                pExec->m_latency.m_tickToOrder.add(tickToOrder);
+                m_latency.m_tickToOrder.add(tickToOrder);
+                pExec->m_decisionTsc = 0;
+            }
+#endif
+            checkpointExec(pExec);
         }
         else
         {
@@ -4589,12 +8193,16 @@ public:
         }
 
         int reason = 1;
-        const CMercStrategyOrderItem *pOrderItem = sendOrder(pExec->pForceInstrument(legID), type, direction, price, volume, reason);
-        if (volume != 0 && pOrderItem!=NULL)
-        {
-            pOrderItem->m_pUser = pExec;
-            pOrderItem->m_userInt2 = pTask->taskID();
-            pTask->notifyOrderSent(pOrderItem->m_userInt1);
+        COrderSlot *pSlot = sendOrder(pExec->pForceInstrument(legID), type, direction, price, volume, reason);
+        if (volume != 0 && pSlot!=NULL)
+        {
+            pSlot->m_pExec = pExec;
+            pSlot->m_orderType = pTask->taskID();
+            pTask->notifyOrderSent(pSlot->m_orderID);
+#if TSC
+            pTask->m_orderSentTsc = m_lastSendTsc;
+#endif
+            checkpointExec(pExec);
             return true;
         }
         else
@@ -4605,115 +8213,233 @@ public:
             return false;
         }
     }
-    virtual void notifyOrder(const CMercStrategyOrderItem *pOrderItem,bool isFirstTime)
+    bool sendRiskOrder(const CInstrument *pInstrument, int direction, double price, int volume)
+    {
+        int reason = 3;
+        COrderSlot *pSlot = sendOrder(pInstrument, ODT_Limit, direction, price, volume, reason);
+        if (pSlot != NULL)
+        {
+            pSlot->m_orderType = -3;
+        }
+        return pSlot != NULL;
+    }
+    unsigned long long orderSentTsc(const COrderSlot *pSlot)
+    {
+        CSpreadExec *pExec = pSlot->m_pExec;
+        int orderType = pSlot->m_orderType;
+        if (pExec == NULL || orderType < -1) return 0;
+        if (orderType == -1) return pExec->m_tryOrderSentTsc;
+        CForceTask *pTask = pExec->getTask(orderType);
+        return pTask != NULL ? pTask->m_orderSentTsc : 0;
+    }
+    void probeOrderLatency(const COrderSlot *pSlot, bool isAck)
     {
+        unsigned long long sentTsc = orderSentTsc(pSlot);
+        if (sentTsc == 0) return;
+        long long ns = CTscClock::since(sentTsc);
+        CSpreadExec *pExec = pSlot->m_pExec;
+        CLatencyHist &spreadHist = isAck ? pExec->m_latency.m_orderToAck : pExec->m_latency.m_orderToFill;
+        CLatencyHist &totalHist = isAck ? m_latency.m_orderToAck : m_latency.m_orderToFill;
+        spreadHist.add(ns);
+        totalHist.add(ns);
+    }
+    // slot of an order this instance sent, refreshed from the host order; NULL for foreign orders
+    COrderSlot *hostSlot(const CMercStrategyOrderItem *pOrderItem)
+    {
+        COrderSlot *pSlot = m_orderTable.get(pOrderItem->m_userInt1);
         const COrder *pOrder = pOrderItem->m_pOrder;
-        if (!pOrder->isFinished())
+        if (pSlot == NULL || pSlot->m_pItem != pOrderItem || pOrder == NULL)
+        {
+            return NULL;
+        }
+        pSlot->m_finished = pOrder->isFinished();
+        pSlot->m_rejected = pOrder->isRejected();
+        pSlot->m_tradeVlm = pOrder->getTradeVolume();
+        pSlot->m_direction = pOrder->getDirection();
+        return pSlot;
+    }
+    virtual void notifyOrder(const CMercStrategyOrderItem *pOrderItem,bool isFirstTime)
+    {
+        if (m_pReplay != NULL) return;
+        COrderSlot *pSlot = hostSlot(pOrderItem);
+        if (pSlot == NULL && !m_restoredOrders.empty()) pSlot = adoptSlot(pOrderItem);
+        if (m_recorder.isOpen())
+        {
+            if (pSlot != NULL) recordOrder(pSlot, isFirstTime);
+            else recordForeignOrder(pOrderItem, isFirstTime);
+        }
+        if (pSlot != NULL && pSlot->m_restored)
+        {
+            int orderID = pSlot->m_orderID;
+            catchUpRestored(pSlot, pOrderItem->m_pOrder->getPrice());
+            pSlot = m_orderTable.get(orderID);
+            if (pSlot == NULL) return;
+        }
+        if (pSlot != NULL)
+        {
+            internalNotifyOrder(pSlot, isFirstTime);
+        }
+        else if (pOrderItem->m_pOrder != NULL && !pOrderItem->m_pOrder->isFinished())
+        {
+            setAutoCancel(pOrderItem, isFirstTime, m_env.m_clearOrderWaitTime);
+        }
+    }
+    void internalNotifyOrder(COrderSlot *pSlot, bool isFirstTime)
+    {
+#if TSC
+        if (isFirstTime) probeOrderLatency(pSlot, true);
+#endif
+        CSpreadExec *pExec = pSlot->m_pExec;
+        if (!pSlot->m_finished)
         {
-            int orderType = pOrderItem->m_userInt2;
+            int orderType = pSlot->m_orderType;
             if (orderType == -1)
             {
-                setAutoCancel(pOrderItem, isFirstTime, m_env.m_tryOrderWaitTime);
+                armAutoCancel(pSlot, isFirstTime, m_env.m_tryOrderWaitTime);
             }
-            else if (orderType >= 0)
+            else if (orderType >= 0 || orderType == ORDER_RESTORED)
             {
-                setAutoCancel(pOrderItem, isFirstTime, m_env.m_forceOrderWaitTime);
+                armAutoCancel(pSlot, isFirstTime, m_env.m_forceOrderWaitTime);
             }
-            else //(orderType == -2)
+            else //(orderType == -2 || orderType == -3)
             {
-                setAutoCancel(pOrderItem, isFirstTime, m_env.m_clearOrderWaitTime);
+                armAutoCancel(pSlot, isFirstTime, m_env.m_clearOrderWaitTime);
             }
         }
         else
         {
-            checkOrderFinished(pOrderItem);
+            checkOrderFinished(pSlot);
         }
+        if (pExec != NULL) checkpointExec(pExec);
     }
-    void checkOrderFinished(const CMercStrategyOrderItem *pOrderItem)
+    void armAutoCancel(const COrderSlot *pSlot, bool isFirstTime, int waitTime)
     {
-        const COrder *pOrder = pOrderItem->m_pOrder;
-        if (pOrder!=NULL && m_orderMap.find(pOrder->getOrderRef()) != m_orderMap.end())
+        // replayed orders get their cancels from the recorded order updates
+        if (pSlot->m_pItem != NULL)
+        {
+            setAutoCancel(pSlot->m_pItem, isFirstTime, waitTime);
+        }
+        else if (m_pSim != NULL)
+        {
+            m_pSim->autoCancel(pSlot->m_orderID, isFirstTime, waitTime, *m_pCurTimeStamp);
+        }
+    }
+    void checkOrderFinished(COrderSlot *pSlot)
+    {
+        if (!pSlot->m_finished || pSlot->m_filledVlm != pSlot->m_tradeVlm)
+        {
+            return;
+        }
+        CSpreadExec *pExec = pSlot->m_pExec;
+        int orderID = pSlot->m_orderID;
+        int orderType = pSlot->m_orderType;
+        bool rejected = pSlot->m_rejected;
+        int trdVlm = (pSlot->m_direction == D_Sell) ? -pSlot->m_tradeVlm : pSlot->m_tradeVlm;
+        // released before any resend, erase may move other slots
+        unsubscribeOrder(orderID);
+        if (orderType >= 0)
+        {
+            finishForceOrder(pExec, orderType, rejected, trdVlm);
+        }
+        else if (orderType == ORDER_RESTORED)
+        {
+            finishRestoredOrder(pExec, orderID);
+        }
+        else if (orderType == -2 && pExec != NULL)
         {
-            if (pOrder->isFinished() && pOrderItem->m_userLongLong1 == pOrder->getTradeVolume())
+            pExec->clearOrderFinished(orderID);
+        }
+        else if (orderType == -1)
+        {
+            pExec->tryOrderFinished();
+            int tryLegPendingVlm = pExec->pendingVlm(pExec->m_tryLegID);
+            if (tryLegPendingVlm != 0)
             {
-                CSpreadExec *pExec = (CSpreadExec *)pOrderItem->m_pUser;
-                int orderType = pOrderItem->m_userInt2;
-                if (orderType >= 0)
-                {
-                    finishForceOrder(pExec, orderType, pOrder);
-                }
-                else if (orderType == -1)
-                {
-                    pExec->tryOrderFinished();
-                    int tryLegPendingVlm = pExec->pendingVlm(pExec->m_tryLegID);
-                    if (tryLegPendingVlm != 0)
-                    {
-                        sendTryOrder(pExec);
-                        return;
-                    }
+                sendTryOrder(pExec);
+                return;
+            }
 
-                    if (pExec->tryStop())
-                    {
-                        finishSpreadExec(pExec);
-                    }
-                }
-                unsubscribeOrder(pOrder->getOrderRef());
+            if (pExec->tryStop())
+            {
+                finishSpreadExec(pExec);
             }
         }
     }
     virtual void notifyTrade(const CMercStrategyOrderItem *pOrderItem, const CTrade *pTrade)
     {
-        int vlm = pTrade->getVolume();
-        pOrderItem->m_userLongLong1 += vlm;
-
-        CSpreadExec *pExec = (CSpreadExec *)pOrderItem->m_pUser;
-        int orderType = pOrderItem->m_userInt2;
-        const CInstrument *pInst = pTrade->getInstrument();
-        int instRef = pInst->getInstrumentRef();
-        int trdVlm = (pTrade->getDirection() == D_Sell) ? -vlm : vlm;
-        double price = pTrade->getPrice();
-        if (orderType == -1)
+        if (m_pReplay != NULL) return;
+#if ALLOC_COUNT
+        unsigned long long allocBefore = allocCount();
+#endif
+        COrderSlot *pSlot = hostSlot(pOrderItem);
+        if (pSlot == NULL && !m_restoredOrders.empty()) pSlot = adoptSlot(pOrderItem);
+        int instRef = pTrade->getInstrument()->getInstrumentRef();
+        if (m_recorder.isOpen()) recordTrade(pSlot, pOrderItem->m_userInt1, instRef, pTrade->getDirection(), pTrade->getVolume(), pTrade->getPrice());
+        // an adopted order counts what its traded volume says; this fill is in it now or in the next order report
+        if (pSlot != NULL && pSlot->m_restored) catchUpRestored(pSlot, pTrade->getPrice());
+        else internalNotifyTrade(pSlot, instRef, pTrade->getDirection(), pTrade->getVolume(), pTrade->getPrice());
+#if ALLOC_COUNT
+        if (m_strategyReady) m_trdAllocs.add(allocCount() - allocBefore);
+#endif
+    }
+    void internalNotifyTrade(COrderSlot *pSlot, int instRef, int direction, int vlm, double price)
+    {
+        int trdVlm = (direction == D_Sell) ? -vlm : vlm;
+        CSpreadExec *pCheckpointExec = pSlot != NULL ? pSlot->m_pExec : NULL;
+        if (pSlot != NULL)
         {
-            pExec->tryOrderTraded(trdVlm, price);
-            for (int i=0; i<pExec->m_pLegs.size(); i++)
+#if TSC
+            if (pSlot->m_filledVlm == 0) probeOrderLatency(pSlot, false);
+#endif
+            pSlot->m_filledVlm += vlm;
+            int orderID = pSlot->m_orderID;
+            CSpreadExec *pExec = pSlot->m_pExec;
+            int orderType = pSlot->m_orderType;
+            if (orderType == -1)
             {
-                if (i == pExec->m_tryLegID)
-                    continue;
-                startForceTask(pExec, i);
+                pExec->tryOrderTraded(trdVlm, price);
+                for (int i=0; i<pExec->m_pLegs.size(); i++)
+                {
+                    if (i == pExec->m_tryLegID)
+                        continue;
+                    startForceTask(pExec, i);
+                }
             }
+            else if (orderType >= 0 || orderType == ORDER_RESTORED)
+            {
+                int legID = pExec->getLegId(instRef);
+                if (legID >= 0) pExec->forceOrderTraded(legID, trdVlm, price);
+            }
+            else if (orderType == -2)
+            {
+                pExec->reduceRemainPositions(instRef,trdVlm);
+            }
+            // looked up again, the force orders sent above may have moved it
+            pSlot = m_orderTable.get(orderID);
+            if (pSlot != NULL) checkOrderFinished(pSlot);
         }
-        else if (orderType >= 0)
-        {
-            int legID = pExec->getLegId(instRef);
-            pExec->forceOrderTraded(legID, trdVlm, price);
-        }
-        else //orderType == -2
+
+        CFutureExtentionAE *pFuture = futureByRef(instRef);
+        if (pFuture != NULL)
         {
-            pExec->reduceRemainPositions(instRef,trdVlm);
+            pFuture->notifyOpenTrade(trdVlm,price);
+            if (m_journal.isOpen()) journalInstPos(pFuture);
         }
-        checkOrderFinished(pOrderItem);
-        
-        CFutureExtentionAE *pFuture = m_pFutures[instRef];
-        pFuture->notifyOpenTrade(trdVlm,price);
+        if (pCheckpointExec != NULL) checkpointExec(pCheckpointExec);
     }
-    void finishForceOrder(CSpreadExec *pExec, int taskID, const COrder *pOrder)
+    void finishForceOrder(CSpreadExec *pExec, int taskID, bool rejected, int trdVlm)
     {
         CForceTask *pTask = pExec->getTask(taskID);
         if (pTask == NULL)
         {
             return;
         }
-        if (pOrder->isRejected())
+        if (rejected)
         {
             pTask->notifyOrderFailed();
         }
         else
         {
-            int trdVlm=pOrder->getTradeVolume();
-            if (pOrder->getDirection() == D_Sell)
-            {
-                trdVlm = -trdVlm;
-            }
             pTask->notifyOrderFinish(trdVlm);
             if (pTask->needResendOrder())
             {
@@ -4726,15 +8452,11 @@ public:
             finishForceTask(pExec,pTask);
         }
     }
-    void unsubscribeOrder(int orderID)
-    {
-        if (m_orderMap.find(orderID) != m_orderMap.end())
-        {
-            m_orderMap.erase(orderID);
-        }
-    }
+    void unsubscribeOrder(int orderID) { m_orderTable.erase(orderID); }
     void startForceTask(CSpreadExec *pExec, int legID)
     {
+        // the restored order is still hedging this leg
+        if (pExec->m_restoredOrderIDs[legID] >= 0) return;
         int pendingVlm = pExec->pendingVlm(legID);
 
         int pendingTaskID = pExec->pendingTask(legID);
@@ -4747,7 +8469,8 @@ public:
             pExec->subscribeTask(pTask, legID);
             pLeg->subscribeTask(pTask->workerID(),pTask->taskID());
             int stopTS = *m_pCurTimeStamp + m_env.m_forceTaskWaitTime;
-            setTimer(stopTS,TT_ForceTaskTimeOut,pTask);
+            // replay feeds the recorded timeouts instead
+            if (m_pReplay == NULL) setTimer(stopTS,TT_ForceTaskTimeOut,pTask);
             pTask->notifyTimerSet(stopTS);
         }
     }
@@ -4761,6 +8484,7 @@ public:
             finishSpreadExec(pExec);
         }
         startPendingTask();
+        checkpointExec(pExec);
     }
     void startPendingTask()
     {
@@ -4788,16 +8512,12 @@ public:
         {
             double spreadTrdPrice = pExec->m_spreadAvgPrice;
             double spreadExePrice = pExec->m_sprdExeAvgPr;
-            CSpreadExtentionAE *pSpread = m_pSpreads[pExec->spreadID()];
+            CSpreadExtentionAE *pSpread = m_spreadSlots[pExec->spreadID()];
             pSpread->notifyExecFinished(spreadTrdVolume,spreadTrdPrice,*m_pCurTimeStamp, spreadExePrice);
 
-            std::string flw;
-            char flwInfo[2000];
             char memo[1000];
-            sprintf(memo, "leg0-bp-ap-%g-%g|leg1-bp-ap-%g-%g|mid-%g-bp-ap-%g-%g|mkt-bp-ap-%g-%g", pSpread->m_pLegs.at(0)->BP(), pSpread->m_pLegs.at(0)->AP(), pSpread->m_pLegs.at(1)->BP(), pSpread->m_pLegs.at(1)->AP(), pSpread->m_refMid, pSpread->m_buy, pSpread->m_sell, pSpread->m_spBP, pSpread->m_spAP);
-            sprintf(flwInfo, ",SPRDTRD,dt,%d,tm,%s,trddt,%d,strat,%s,sprd,%s,sprdpr,%g,direct,%d,price,%g,vlm,%d,tgt,%g,memo,%s", today(), getTimeString(m_buffer, m_env.m_pStrategy->getCurTimeStamp(), true), m_env.m_pStrategy->getTradingDay(), m_env.m_pStrategy->getStrategyName(), pSpread->m_sprdNm.c_str(), spreadTrdPrice, spreadTrdVolume>0? 1: -1, spreadExePrice, spreadTrdVolume, pExec->m_sprdTgtPr, memo);
-            flw.append(flwInfo);
-            m_pTrdFlw->log(flw.c_str()); 
+            snprintf(memo, sizeof(memo), "leg0-bp-ap-%g-%g|leg1-bp-ap-%g-%g|mid-%g-bp-ap-%g-%g|mkt-bp-ap-%g-%g", pSpread->m_pLegs.at(0)->BP(), pSpread->m_pLegs.at(0)->AP(), pSpread->m_pLegs.at(1)->BP(), pSpread->m_pLegs.at(1)->AP(), pSpread->m_refMid, pSpread->m_buy, pSpread->m_sell, pSpread->m_spBP, pSpread->m_spAP);
+            m_pTrdFlw->log(",SPRDTRD,dt,%d,tm,%s,trddt,%d,strat,%s,sprd,%s,sprdpr,%g,direct,%d,price,%g,vlm,%d,tgt,%g,memo,%s", today(), getTimeString(m_buffer, m_env.m_pStrategy->getCurTimeStamp(), true), m_env.m_pStrategy->getTradingDay(), m_env.m_pStrategy->getStrategyName(), pSpread->m_sprdNm.c_str(), spreadTrdPrice, spreadTrdVolume>0? 1: -1, spreadExePrice, spreadTrdVolume, pExec->m_sprdTgtPr, memo);
 
             m_pTrdFlw->log(",SPRDPOS,dt,%d,tm,%s,trddt,%d,strat,%s,sprd,%s,pos,%d,stts,%s,mid,%g", today(), getTimeString(m_buffer, m_env.m_pStrategy->getCurTimeStamp(), true), m_env.m_pStrategy->getTradingDay(), m_env.m_pStrategy->getStrategyName(), pSpread->m_sprdNm.c_str(), pSpread->m_pSignal->m_pos, "MOD", pSpread->m_refMid);
 
@@ -4823,8 +8543,157 @@ public:
 
         updateBiasSlf();
         updateConstrain();
-        refreshRiskStatus();
-        syncData();
+        defer(CDeferredWork::DW_Risk);
+        m_spreadSlots[pExec->spreadID()]->m_legsChanged = true;
+        m_spreadSlots[pExec->spreadID()]->m_gateArmed = false;
+        syncSpread(m_spreadSlots[pExec->spreadID()]);
+        checkpointExec(pExec);
+    }
+    void checkpointExec(CSpreadExec *pExec)
+    {
+        if (!m_execCheckpoint.isOpen() || pExec->m_checkpointSlot < 0) return;
+        CExecCheckpoint::CExecRecord &r = m_execRecord;
+        pExec->save(r, m_execLegs.data());
+        r.m_tryOrder.m_filledVlm = appliedVlm(r.m_tryOrder.m_orderID);
+        for (int i=0; i<r.m_legCount; i++) m_execLegs[i].m_order.m_filledVlm = appliedVlm(m_execLegs[i].m_order.m_orderID);
+        m_execCheckpoint.store(pExec->m_checkpointSlot, r, m_execLegs.data());
+    }
+    // volume of an order already applied to its exec: from its slot, or from the checkpoint until it is adopted
+    int appliedVlm(int orderID)
+    {
+        if (orderID < 0) return 0;
+        const COrderSlot *pSlot = m_orderTable.get(orderID);
+        if (pSlot != NULL) return pSlot->m_filledVlm;
+        auto it = m_restoredOrders.find(orderID);
+        return it != m_restoredOrders.end() ? it->second.m_filledVlm : 0;
+    }
+    // Warm restart: put back the executions the last run left in flight, wait for their orders to be
+    // reported again and hedge whatever is still owed
+    void restoreExecs()
+    {
+        if (m_pReplay != NULL || m_env.m_execCheckpoint <= 0) return;
+        std::string fileName = m_env.m_dataFn + ".exec";
+        std::vector<CExecCheckpoint::CSavedExec> records;
+        int torn = CExecCheckpoint::load(fileName.c_str(), getTradingDay(), records);
+        std::unordered_map<std::string, CSpreadExec *> execs;
+        int legSlots = 1;
+        for (auto& it : m_pTrdSprds)
+        {
+            CSpreadExec *pExec = it.second->m_pSpreadExec;
+            pExec->m_checkpointSlot = int(execs.size());
+            execs[it.second->m_sprdNm] = pExec;
+            legSlots = std::max(legSlots, int(pExec->m_pLegs.size()));
+        }
+        m_execLegs.assign(legSlots, CExecCheckpoint::CLegRecord());
+        if (!m_execCheckpoint.create(fileName, getTradingDay(), int(execs.size()), legSlots))
+        {
+            g_pMercLog->log("[execRestore],%s,%s,create failed,checkpoint off", m_env.m_strategyName, fileName.c_str());
+            return;
+        }
+        std::vector<CSpreadExec *> restored;
+        for (auto& saved : records)
+        {
+            const CExecCheckpoint::CExecRecord &r = saved.m_exec;
+            auto it = execs.find(r.m_sprdNm);
+            if (it == execs.end() || r.m_legCount != int(it->second->m_pLegs.size())) continue;
+            CSpreadExec *pExec = it->second;
+            pExec->restore(r, saved.m_legs.data());
+            if (pExec->m_tryOrderID >= 0) m_restoredOrders[pExec->m_tryOrderID] = {pExec, CExecCheckpoint::K_Try, r.m_tryOrder.m_filledVlm};
+            for (int i=0; i<r.m_legCount; i++)
+            {
+                int orderID = pExec->m_restoredOrderIDs[i] >= 0 ? pExec->m_restoredOrderIDs[i] : pExec->m_clearOrderIDs[i];
+                if (orderID >= 0) m_restoredOrders[orderID] = {pExec, saved.m_legs[i].m_order.m_kind, saved.m_legs[i].m_order.m_filledVlm};
+            }
+            if (pExec->isProcessing() || !pExec->m_remainPositions.empty()) restored.push_back(pExec);
+            g_pMercLog->log("[execRestore],%s,%s,processing,%d,expVlm,%d,tryLeg,%d,tryTrdVlm,%d,tryOrder,%d,remain,%d",
+                m_env.m_strategyName, r.m_sprdNm, r.m_processing, r.m_spreadExpVlm, r.m_tryLegID, r.m_tryTrdVlm, r.m_tryOrder.m_orderID, int(pExec->m_remainPositions.size()));
+        }
+        for (auto& it : execs) checkpointExec(it.second);
+        bool published = m_execCheckpoint.publish();
+        g_pMercLog->log("[execRestore],%s,%s,records,%d,torn,%d,restored,%d,orders,%d,published,%d", m_env.m_strategyName, fileName.c_str(),
+            int(records.size()), torn, int(restored.size()), int(m_restoredOrders.size()), published);
+        if (!m_restoredOrders.empty()) setTimer(*m_pCurTimeStamp + m_env.m_resumeWaitMs, TT_ResumeExec, NULL);
+        for (auto pExec: restored) resumeExec(pExec);
+    }
+    // Hedge what a restored exec still owes on the legs that have no order working
+    void resumeExec(CSpreadExec *pExec)
+    {
+        if (!pExec->isProcessing()) return;
+        for (int i=0; i<pExec->m_pLegs.size(); i++)
+        {
+            if (i == pExec->m_tryLegID) continue;
+            if (pExec->pendingVlm(i) != 0) startForceTask(pExec, i);
+        }
+        if (pExec->m_tryOrderID < 0)
+        {
+            if (pExec->pendingVlm(pExec->m_tryLegID) != 0) sendTryOrder(pExec);
+            else if (pExec->tryStop()) finishSpreadExec(pExec);
+        }
+        checkpointExec(pExec);
+    }
+    // Orders of a restored exec come back as foreign orders; take them over by order ref
+    COrderSlot *adoptSlot(const CMercStrategyOrderItem *pOrderItem)
+    {
+        const COrder *pOrder = pOrderItem->m_pOrder;
+        if (pOrder == NULL) return NULL;
+        int orderID = pOrder->getOrderRef();
+        auto it = m_restoredOrders.find(orderID);
+        if (it == m_restoredOrders.end()) return NULL;
+        CExecCheckpoint::CRestoredOrder restored = it->second;
+        m_restoredOrders.erase(it);
+        COrderSlot *pSlot = m_orderTable.put(orderID);
+        if (pSlot == NULL) return NULL;
+        pOrderItem->m_userInt1 = orderID;
+        pSlot->m_pItem = pOrderItem;
+        pSlot->m_pExec = restored.m_pExec;
+        pSlot->m_orderType = restored.m_kind == CExecCheckpoint::K_Try ? -1 : (restored.m_kind == CExecCheckpoint::K_Clear ? -2 : ORDER_RESTORED);
+        pSlot->m_filledVlm = restored.m_filledVlm;
+        pSlot->m_restored = true;
+        g_pMercLog->log("[execRestore],%s,adopted,%s,orderID,%d,type,%d,applied,%d,traded,%d", m_env.m_strategyName, restored.m_pExec->m_sprdNm.c_str(),
+            orderID, pSlot->m_orderType, restored.m_filledVlm, pOrder->getTradeVolume());
+        return hostSlot(pOrderItem);
+    }
+    // applies what the adopted order traded beyond the checkpointed volume
+    void catchUpRestored(COrderSlot *pSlot, double price)
+    {
+        const COrder *pOrder = pSlot->m_pItem->m_pOrder;
+        int missed = pOrder->getTradeVolume() - pSlot->m_filledVlm;
+        if (missed > 0) internalNotifyTrade(pSlot, pOrder->getInstrument()->getInstrumentRef(), pOrder->getDirection(), missed, price);
+    }
+    void finishRestoredOrder(CSpreadExec *pExec, int orderID)
+    {
+        int legID = pExec->restoredOrderFinished(orderID);
+        if (legID >= 0 && pExec->pendingVlm(legID) != 0) startForceTask(pExec, legID);
+        if (pExec->tryStop()) finishSpreadExec(pExec);
+    }
+    // An order not reported again within ResumeWaitMs may still be working at the exchange, and the host
+    // can neither cancel nor query it by ref: its leg stays blocked until it is reported or released by command
+    void onResumeTimeOut()
+    {
+        m_resumeExpired = true;
+        for (auto& it : m_restoredOrders)
+        {
+            g_pMercLog->log("[execRestore],%s,UNREPORTED,%s,orderID,%d,kind,%d,leg blocked until reported or released",
+                m_env.m_strategyName, it.second.m_pExec->m_sprdNm.c_str(), it.first, it.second.m_kind);
+        }
+    }
+    // Operator confirmed the order is gone: forget it and hedge its leg afresh. orderID -1 releases all
+    int releaseRestored(int orderID)
+    {
+        std::vector<CSpreadExec *> pExecs;
+        for (auto it = m_restoredOrders.begin(); it != m_restoredOrders.end();)
+        {
+            if (orderID >= 0 && it->first != orderID) { ++it; continue; }
+            CSpreadExec *pExec = it->second.m_pExec;
+            if (it->second.m_kind == CExecCheckpoint::K_Try) pExec->tryOrderFinished();
+            else if (it->second.m_kind == CExecCheckpoint::K_Force) pExec->restoredOrderFinished(it->first);
+            else pExec->clearOrderFinished(it->first);
+            if (std::find(pExecs.begin(), pExecs.end(), pExec) == pExecs.end()) pExecs.push_back(pExec);
+            g_pMercLog->log("[execRestore],%s,released,%s,orderID,%d,kind,%d", m_env.m_strategyName, pExec->m_sprdNm.c_str(), it->first, it->second.m_kind);
+            it = m_restoredOrders.erase(it);
+        }
+        for (auto pExec: pExecs) resumeExec(pExec);
+        return int(pExecs.size());
     }
     void clearRemainPositions()
     {
@@ -4835,9 +8704,9 @@ public:
             {
                 int id = it2.first;
                 int pos = it2.second;
-                CFutureExtentionAE *pFuture = m_pFutures[id];
+                CFutureExtentionAE *pFuture = futureByRef(id);
                 g_pMercLog->log("%s|%s|%s,clearRemainPositions,remain_pos,%d,hasOrder,%d",m_env.m_strategyName,m_pTradeControl->timeString(), pFuture->ID(), pos, pFuture->hasOrder());
-                if (pos != 0 && !pFuture->hasOrder())
+                if (pos != 0 && !pFuture->hasOrder() && !pExec->clearOrderWorking(id))
                 {
                     int type = (m_env.m_clearOrderWaitTime>=0 ) ? ODT_Limit : ODT_FAK;
                     int direction = (-pos>0) ? D_Buy : D_Sell;
@@ -4858,11 +8727,13 @@ public:
                     if (hasCounterVolume)
                     {
                         int reason = 2;
-                        const CMercStrategyOrderItem *pOrderItem = sendOrder(pFuture->pInstrument(),type,direction,price,abs(pos), reason);
-                        if (pOrderItem!=NULL)
+                        COrderSlot *pSlot = sendOrder(pFuture->pInstrument(),type,direction,price,abs(pos), reason);
+                        if (pSlot!=NULL)
                         {
-                            pOrderItem->m_pUser = pExec;
-                            pOrderItem->m_userInt2 = -2;
+                            pSlot->m_pExec = pExec;
+                            pSlot->m_orderType = -2;
+                            pExec->clearOrderSent(id, pSlot->m_orderID);
+                            checkpointExec(pExec);
                             g_pMercLog->log("%s,clearRemainPosition order sent",m_env.m_strategyName);
                         }
                         else
@@ -4877,9 +8748,31 @@ public:
 
     virtual void onTime(int timeStamp, int type, void *pUser)
     {
+        if (m_pReplay != NULL) return;
+        if (m_recorder.isOpen())
+        {
+            int workerID = (type == TT_ForceTaskTimeOut && pUser != NULL) ? ((CForceTask *)pUser)->workerID() : -1;
+            recordEvent(CFlightRecorder::EV_Timer, timeStamp, type, workerID);
+        }
+        internalOnTime(timeStamp, type, pUser);
+        pumpSimExchange();
+    }
+    void internalOnTime(int timeStamp, int type, void *pUser)
+    {
+        // timers see the state as if nothing had been deferred
+        drainDeferred(false);
         m_pTradeControl->internalOnTime(timeStamp,type);
+        markSpreadsChanged();
+        if (m_standby)
+        {
+            if (type == TT_Period) logStandby();
+            return;
+        }
         switch(type)
         {
+        case TT_PreTrade:
+            onPreTrade();
+            break;
         case TT_OnlyClose:
             onOnlyClose();
             break;
@@ -4894,18 +8787,19 @@ public:
             break;
         case TT_Period:
             onPeriod();
+            logBenchLatency("Period");
 
             if (m_env.m_logTrdFlw != 0)
             {
-                for (auto& it : m_pTrdSprds)
-                {
-                    logTrds(typeid(this).name(), "Period", "Both", it.second, true, 0, 0, 0, 0);
-                }
+                defer(CDeferredWork::DW_PeriodLog);
             }
             break;
         case TT_ForceTaskTimeOut:
             onForceTaskTimeOut(timeStamp,pUser);
             break;
+        case TT_ResumeExec:
+            onResumeTimeOut();
+            break;
         default:
             break;
         }
@@ -4918,41 +8812,118 @@ public:
             if (pTask->hasOrder())
             {
                 int orderID = pTask->orderID();
-                if (m_orderMap.find(orderID)!=m_orderMap.end())
+                COrderSlot *pSlot = m_orderTable.get(orderID);
+                if (pSlot!=NULL)
                 {
-                    cancelOrderItem(m_orderMap[orderID]);
+                    cancelOrderItem(pSlot);
                 }
             }
             else
             {
-                int spreadID = pTask->spreadID();
-                if (m_pSpreads.find(spreadID) != m_pSpreads.end())
+                CSpreadExtentionAE *pSpread = spreadByID(pTask->spreadID());
+                if (pSpread != NULL)
                 {
-                    CSpreadExtentionAE *pSpread = m_pSpreads[spreadID];
                     CSpreadExec *pExec = pSpread->m_pSpreadExec;
                     finishForceTask(pExec,pTask);
                 }
             }
         }
     }
-    void cancelOrderItem(const CMercStrategyOrderItem *pOrderItem)
+    void cancelOrderItem(const COrderSlot *pSlot)
     {
-        const COrder *pOrder = pOrderItem->m_pOrder;
-        if (pOrder!=NULL && !pOrder->isFinished())
+        if (!pSlot->m_finished)
         {
-            cancelOrder(pOrderItem);
+            if (m_recorder.isOpen()) recordEvent(CFlightRecorder::EV_Cancel, pSlot->m_orderID, pSlot->m_orderType);
+            if (pSlot->m_pItem != NULL)
+            {
+                cancelOrder(pSlot->m_pItem);
+            }
+            else if (m_pReplay != NULL)
+            {
+                replayCancel(pSlot);
+            }
+            else if (m_pSim != NULL)
+            {
+                m_pSim->cancel(pSlot->m_orderID, *m_pCurTimeStamp);
+            }
         }
     }
     void cancelAll()
     {
-        for (auto& it : m_orderMap)
+        for (int i=0; i<ORDER_SLOTS; i++)
         {
-            cancelOrderItem(it.second);
+            const COrderSlot *pSlot = m_orderTable.at(i);
+            if (pSlot != NULL) cancelOrderItem(pSlot);
         }
     }
 
+    void logStageLatency(const char *name, const CStageLatency &lat)
+    {
+        const CLatencyHist *hists[4] = {&lat.m_mdToDecision, &lat.m_tickToOrder, &lat.m_orderToAck, &lat.m_orderToFill};
+        const char *stages[4] = {"mdToDecision", "tickToOrder", "orderToAck", "orderToFill"};
+        for (int i=0;i<4;i++)
+        {
+            const CLatencyHist &h = *hists[i];
+            if (h.count() == 0) continue;
+            g_pMercLog->log("[tscLatency],%s,%s,%s,n,%llu,p50,%lld,p99,%lld,p999,%lld,max,%lld",
+                m_env.m_strategyName, name, stages[i], h.count(), h.percentile(0.5), h.percentile(0.99), h.percentile(0.999), h.max());
+        }
+    }
+    void logAllocStats(const char *name, CAllocStats &stats)
+    {
+        if (stats.m_calls == 0) return;
+        g_pMercLog->log("[allocCount],%s,%s,calls,%llu,allocCalls,%llu,allocs,%llu,maxPerCall,%llu",
+            m_env.m_strategyName, name, stats.m_calls, stats.m_allocCalls, stats.m_allocs, stats.m_max);
+        stats.clear();
+    }
+    void logSpreadCosts()
+    {
+        unsigned long long totalCycles = 0;
+        for (auto& it : m_pTrdSprds) { totalCycles += it.second->m_cost.m_trySignal.m_cycles; }
+        for (auto& it : m_pTrdSprds)
+        {
+            CSpreadExtentionAE *pSpread = it.second;
+            const CSpreadCost &cost = pSpread->m_cost;
+            if (cost.m_trySignal.m_calls > 0)
+            {
+                g_pMercLog->log("[cpuCost],%s,%s,trySignal,%llu,%lld,updateSignal,%llu,%lld,riskCheck,%llu,%lld,avgNs,%g,share,%g",
+                    m_env.m_strategyName, pSpread->m_sprdNm.c_str(), cost.m_trySignal.m_calls, cost.m_trySignal.nanos(),
+                    cost.m_updateSignal.m_calls, cost.m_updateSignal.nanos(), cost.m_riskCheck.m_calls, cost.m_riskCheck.nanos(),
+                    cost.m_trySignal.avgNanos(), totalCycles > 0 ? 100.0 * cost.m_trySignal.m_cycles / totalCycles : 0.0);
+            }
+            pSpread->refreshCostStatus(totalCycles);
+            pSpread->m_cost.clear();
+        }
+        g_pMercLog->log("[cpuCost],%s,ALL,trySignalNs,%lld,spreads,%d", m_env.m_strategyName, CTscClock::toNanos(totalCycles), int(m_pTrdSprds.size()));
+    }
+    void logSimExchange()
+    {
+        if (m_pSim == NULL) return;
+        g_pMercLog->log("[simExchange],%s,orders,%llu,fills,%llu,fillVolume,%llu,cancels,%llu,rejects,%llu,resting,%d,maxResting,%d,orderTable,%d",
+            m_env.m_strategyName, m_pSim->m_orders, m_pSim->m_fills, m_pSim->m_fillVolume, m_pSim->m_cancels, m_pSim->m_rejects,
+            m_pSim->resting(), m_pSim->m_maxResting, m_orderTable.size());
+    }
     void onPeriod()
     {
+        logRecorder();
+        logSimExchange();
+        logPersister();
+        logDeferred();
+        g_pMercLog->log("[trigger],%s,snapshots,%llu,evaluated,%llu,skipped,%llu,gated,%llu,late,%llu", m_env.m_strategyName, m_snapCount, m_evalCount, m_skipCount, m_gateCount, m_lateCount);
+        if (m_resumeExpired && !m_restoredOrders.empty()) onResumeTimeOut();
+#if ALLOC_COUNT
+        logAllocStats("notifyMarketData", m_mdAllocs);
+        logAllocStats("notifyTrade", m_trdAllocs);
+#endif
+#if TSC
+        logStageLatency("ALL", m_latency);
+        for (auto& it : m_pTrdSprds)
+        {
+            logStageLatency(it.second->m_sprdNm.c_str(), it.second->m_pSpreadExec->m_latency);
+            it.second->refreshLatencyStatus();
+        }
+#endif
+        if (m_env.m_cpuCost > 0) logSpreadCosts();
         if (m_needOnBar && m_pTradeControl->inSession(*m_pCurTimeStamp-1000))
         {
             for (auto& it : m_pFutures)
@@ -4973,22 +8944,17 @@ public:
 
             updateBiasSlf();
             updateConstrain();
-            refreshRiskStatus();
+            defer(CDeferredWork::DW_Risk);
             if(m_pTradeControl->getTradeConstrain()<4)
             {
                 clearRemainPositions();
                 /* g_pMercLog->log("%s|%s,onPeriod,pTradeControl->getTradeConstrain,%d<4,clearRemainPositions",m_env.m_strategyName,m_pTradeControl->timeString(), m_pTradeControl->getTradeConstrain()); */
             }
 
-            if (m_env.m_needFuzzySort>0)
-            {
-                updateInstTriggerMap();
-            }
-
             m_needOnBar = false;
             //g_pMercLog->log("%s|%s|onBar",m_env.m_strategyName,m_pTradeControl->timeString());
             
-            syncData();
+            defer(CDeferredWork::DW_SyncData);
         }
     }
 
@@ -5043,6 +9009,32 @@ mrgnU,%g, StratMrgn,%g,AcctAvlb,%g,AcctMinAvlb,%g",
         m_pTrdLog->log(logStr.c_str());
     }
 
+    // Warm caches, branch predictors and page tables before DayTrade: run the decision path of every
+    // tradable spread on cloned legs with sends suppressed, pre-fault reserved buffers, touch status objects
+    void onPreTrade()
+    {
+        if (m_env.m_warmupFrames <= 0) return;
+        long long t0 = nowNanos();
+        long rss0 = rssKB();
+        CKernelBench bench(this, &m_env, m_pFuzzySorter);
+        int warmed = bench.warmup(m_pTrdSprds, m_env.m_warmupFrames);
+        long long t1 = nowNanos();
+
+        size_t prefaulted = 0;
+        for (auto& it : m_pTrdSprds)
+        {
+            CSpreadExtentionAE *pSpread = it.second;
+            prefaulted += prefaultTail(pSpread->m_pSignal->m_openPositions, COpenPosition(0.0, 0, 0.0));
+            prefaulted += prefaultTail(pSpread->m_pSignal->m_openLegPrices);
+            pSpread->refreshAllStatus();
+        }
+        if (m_pSim != NULL) prefaulted += m_pSim->prefault();
+        refreshRiskStatus();
+        m_env.refreshParameterStatus();
+        long long t2 = nowNanos();
+        g_pMercLog->log("[warmup],%s,spreads,%d,frames,%d,decisionMs,%g,prefaultKB,%lu,statusMs,%g,rssDeltaKB,%ld",
+            m_env.m_strategyName, warmed, m_env.m_warmupFrames, (t1-t0)*1e-6, (unsigned long)(prefaulted/1024), (t2-t1)*1e-6, rssKB()-rss0);
+    }
     void onOnlyClose()
     {
         for(auto& it : m_pTrdSprds)
@@ -5065,7 +9057,7 @@ mrgnU,%g, StratMrgn,%g,AcctAvlb,%g,AcctMinAvlb,%g",
     }
     void dailySettle(int id)
     {
-        CFutureExtentionAE *pFuture = m_pFutures[id];
+        CFutureExtentionAE *pFuture = futureByRef(id);
         if (!pFuture->isSettled())
         {
             pFuture->settle();
@@ -5081,7 +9073,11 @@ mrgnU,%g, StratMrgn,%g,AcctAvlb,%g,AcctMinAvlb,%g",
 
             m_pTrdFlw->log(",SPRDPOS,dt,%d,tm,%s,trddt,%d,strat,%s,sprd,%s,pos,%d,stts,%s", today(), getTimeString(m_buffer, m_env.m_pStrategy->getCurTimeStamp(), true), m_env.m_pStrategy->getTradingDay(), m_env.m_pStrategy->getStrategyName(), it.second->m_sprdNm.c_str(), it.second->m_pSignal->m_pos, "EOD");
         }
-        syncData();
+        logBenchLatency("EOD");
+        logRecorder(true);
+        logSimExchange();
+        checkpoint();
+        logPersister();
     }
     void onNtEnd()
     {
@@ -5092,22 +9088,51 @@ mrgnU,%g, StratMrgn,%g,AcctAvlb,%g,AcctMinAvlb,%g",
 
             m_pTrdFlw->log(",SPRDPOS,dt,%d,tm,%s,trddt,%d,strat,%s,sprd,%s,pos,%d,stts,%s", today(), getTimeString(m_buffer, m_env.m_pStrategy->getCurTimeStamp(), true), m_env.m_pStrategy->getTradingDay(), m_env.m_pStrategy->getStrategyName(), it.second->m_sprdNm.c_str(), it.second->m_pSignal->m_pos, "EON");
         }
-        syncData();
+        logBenchLatency("EON");
+        logRecorder(true);
+        logSimExchange();
+        checkpoint();
+        logPersister();
     }
     virtual void notifyTradeSegment(int timeStamp)
     {
+        if (m_strategyReady) drainDeferred(true);
     }
     virtual void notifyFreeTime(void)
     {
+        if (!m_strategyReady) return;
+        pumpSimExchange();
+        drainDeferred(true);
+        if (m_standby) pollStandby();
+        else
+        {
+            if (m_mirror.isOpen()) m_mirror.beat(nowNanos());
+            checkStateLock();
+        }
     }
     virtual const char *handleCommand(const CMercStrategyCommand *pCommand)
+    {
+        if (m_recorder.isOpen()) recordEvent(CFlightRecorder::EV_Command, pCommand->CommandID, pCommand->Index[0], pCommand->IntValue[0], pCommand->FloatValue[0]);
+        return applyCommand(pCommand);
+    }
+    const char *applyCommand(const CMercStrategyCommand *pCommand)
     {
         const char *msg=internalHandleCommand(pCommand);
         m_env.refreshParameterStatus();
         updateConstrain();
         refreshRiskStatus();
+        markSpreadsChanged();
         return msg;
     }
+    // constraints, parameters or session state moved: every spread is due an evaluation on its next trigger
+    void markSpreadsChanged()
+    {
+        for (auto& it : m_pTrdSprds)
+        {
+            it.second->m_legsChanged = true;
+            it.second->m_gateArmed = false;
+        }
+    }
 
     const char *internalHandleCommand(const CMercStrategyCommand *pCommand)
     {
@@ -5141,6 +9166,8 @@ mrgnU,%g, StratMrgn,%g,AcctAvlb,%g,AcctMinAvlb,%g",
             return changeOffsetStrategy(pCommand);
         case 13:
             return refreshStatus();
+        case 14:
+            return releaseRestoredOrder(pCommand);
         default:
             return "未知命令";
         }
@@ -5169,7 +9196,7 @@ mrgnU,%g, StratMrgn,%g,AcctAvlb,%g,AcctMinAvlb,%g",
             pSprd->updtBuySell(pSprd->m_buy, pSprd->m_sell);
             g_pMercLog->log("%s,handleCommand,chgRefMid %g->%g", m_env.m_strategyName, oldVal, pSprd->m_refMid);
             refreshStatus();
-            syncData();
+            syncSpread(pSprd, true);
         }
         return NULL;
     }
@@ -5189,7 +9216,7 @@ mrgnU,%g, StratMrgn,%g,AcctAvlb,%g,AcctMinAvlb,%g",
 
             g_pMercLog->log("%s,handleCommand,chgSprdMaxLot %g->%g", m_env.m_strategyName, oldVal, newVal);
             refreshStatus();
-            syncData();
+            syncSpread(pSprd, true);
         }
         return NULL;
     }
@@ -5209,10 +9236,18 @@ mrgnU,%g, StratMrgn,%g,AcctAvlb,%g,AcctMinAvlb,%g",
 
             g_pMercLog->log("%s,handleCommand,chgSprdStpSz %g->%g", m_env.m_strategyName, oldVal, newVal);
             refreshStatus();
-            syncData();
+            syncSpread(pSprd, true);
         }
         return NULL;
     }
+    const char *releaseRestoredOrder(const CMercStrategyCommand *pCommand)
+    {
+        int orderID = pCommand->IntValue[0];
+        int released = releaseRestored(orderID);
+        g_pMercLog->log("%s,handleCommand,releaseRestoredOrder,orderID,%d,execs,%d", m_env.m_strategyName, orderID, released);
+        if (released == 0) return "No such restored order";
+        return NULL;
+    }
     const char *changeEnableTrade(const CMercStrategyCommand *pCommand)
     {
         g_pMercLog->log("%s,handleCommand,enableTrade %d->%d",
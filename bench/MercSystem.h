@@ -0,0 +1,320 @@
+// Stand-in for the Merc host API, enough to build and replay a strategy outside the host.
+// Only the calls EZDG makes are provided; the host side lives in ReplayHost.cpp.
+#pragma once
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#define PERSISTENT_MARKET_DATA 1
+
+namespace MERC {
+
+enum { ODT_Limit=0, ODT_FAK=1 };
+enum { D_Buy=0, D_Sell=1 };
+enum { TT_User=100 };
+
+class CLog
+{
+public:
+    FILE *m_fp;
+    CLog(FILE *fp=stdout): m_fp(fp) {}
+    void log(const char *format, ...);
+};
+extern CLog *g_pMercLog;
+
+class CLogFile
+{
+public:
+    FILE *m_fp;
+    CLogFile(FILE *fp=NULL): m_fp(fp) {}
+    void log(const char *format, ...);
+};
+
+class CXMLNode
+{
+public:
+    std::string m_name;
+    std::vector<std::pair<std::string, std::string> > m_props;
+    std::vector<CXMLNode *> m_sons;
+    ~CXMLNode() { for (auto pSon: m_sons) delete pSon; }
+    const char *getProperty(const char *name, const char *defaultValue=NULL) const;
+    int getIntProperty(const char *name, int defaultValue=0) const;
+    double getDoubleProperty(const char *name, double defaultValue=0.0) const;
+    // "HH:MM:SS[.mmm]" as milliseconds of the day
+    int getTimeStampProperty(const char *name, int defaultValue=0) const;
+    const CXMLNode *getSonByName(const char *name) const;
+    int getSonCount() const { return int(m_sons.size()); }
+    const CXMLNode *getSon(int id) const { return (id >= 0 && id < int(m_sons.size())) ? m_sons[id] : NULL; }
+};
+
+// trading sections in milliseconds of the day, inclusive
+class CTimeSectionList
+{
+public:
+    mutable std::vector<std::pair<int, int> > m_sections;
+    bool isIn(int timeStamp) const;
+    void intersect(const CTimeSectionList *pOther) const;
+    const char *show(char *buffer) const;
+};
+
+class CProduct
+{
+public:
+    std::string m_productID;
+    std::string m_exchangeID;
+    int m_productRef;
+    CTimeSectionList m_sessions;
+    int getProductRef() const { return m_productRef; }
+    const char *getProductID() const { return m_productID.c_str(); }
+    const char *getExchangeID() const { return m_exchangeID.c_str(); }
+};
+
+class CInstrument
+{
+public:
+    std::string m_instrumentID;
+    const CProduct *m_pProduct;
+    int m_instrumentRef;
+    double m_tick;
+    double m_multiple;
+    double m_upperLimitPrice;
+    double m_lowerLimitPrice;
+    double m_preClosePrice;
+    double m_preSettlementPrice;
+    int m_preOpenInterest;
+    int m_expireDate;
+    double getTick() const { return m_tick; }
+    double getMultiple() const { return m_multiple; }
+    double getUpperLimitPrice() const { return m_upperLimitPrice; }
+    double getLowerLimitPrice() const { return m_lowerLimitPrice; }
+    int getExpireDate() const { return m_expireDate; }
+    double getPreClosePrice() const { return m_preClosePrice; }
+    double getPreSettlementPrice() const { return m_preSettlementPrice; }
+    int getPreOpenInterest() const { return m_preOpenInterest; }
+    const char *getExchangeID() const { return m_pProduct->getExchangeID(); }
+    const char *getInstrumentID() const { return m_instrumentID.c_str(); }
+    const char *getProductID() const { return m_pProduct->getProductID(); }
+    const CProduct *getProduct() const { return m_pProduct; }
+    int getInstrumentRef() const { return m_instrumentRef; }
+};
+
+// one persistent object per instrument, overwritten by every snapshot
+class CMarketData
+{
+public:
+    const CInstrument *m_pInstrument;
+    int m_updateTimeStamp;
+    double m_lastPrice;
+    int m_volume;
+    double m_bidPrice;
+    int m_bidVolume;
+    double m_askPrice;
+    int m_askVolume;
+    int getBidVolume() const { return m_bidVolume; }
+    int getAskVolume() const { return m_askVolume; }
+    double getLastPrice() const { return m_lastPrice; }
+    double getBidPrice() const { return m_bidPrice; }
+    double getAskPrice() const { return m_askPrice; }
+    int getVolume() const { return m_volume; }
+    int getUpdateTimeStamp() const { return m_updateTimeStamp; }
+    const CInstrument *getInstrument() const { return m_pInstrument; }
+};
+
+class CFuzzyFloat
+{
+public:
+    double m_value;
+    CFuzzyFloat(double value): m_value(value) {}
+    static bool near(double a, double b) { return fabs(a - b) <= 1e-8 * std::max(1.0, std::max(fabs(a), fabs(b))); }
+    bool operator==(const CFuzzyFloat &o) const { return near(m_value, o.m_value); }
+    bool operator!=(const CFuzzyFloat &o) const { return !near(m_value, o.m_value); }
+    bool operator<=(const CFuzzyFloat &o) const { return m_value < o.m_value || near(m_value, o.m_value); }
+    bool operator>=(const CFuzzyFloat &o) const { return m_value > o.m_value || near(m_value, o.m_value); }
+    bool operator<(const CFuzzyFloat &o) const { return !(*this >= o); }
+    bool operator>(const CFuzzyFloat &o) const { return !(*this <= o); }
+};
+
+class CMercStrategyStatus
+{
+public:
+    int Index[4];
+    int IntValue[8];
+    double FloatValue[8];
+};
+
+class CMercStrategyFlow
+{
+public:
+    int Index[4];
+    int IntValue[8];
+    double FloatValue[8];
+};
+
+class CMercStrategyPosition
+{
+public:
+    int m_position;
+    int m_workingOrders;
+    bool hasOrder() const { return m_workingOrders > 0; }
+};
+
+class CInputOrder
+{
+public:
+    int m_orderType;
+    int m_direction;
+    double m_price;
+    int m_volume;
+    int m_orderRef;
+    CInputOrder(): m_orderType(ODT_Limit), m_direction(D_Buy), m_price(0.0), m_volume(0), m_orderRef(-1) {}
+    void setOrderType(int orderType) { m_orderType = orderType; }
+    void setDirection(int direction) { m_direction = direction; }
+    void setPrice(double price) { m_price = price; }
+    void setOrderVolume(int volume) { m_volume = volume; }
+    int getOrderRef() const { return m_orderRef; }
+};
+
+class COrder
+{
+public:
+    const CInstrument *m_pInstrument;
+    int m_orderRef;
+    int m_orderType;
+    int m_direction;
+    double m_price;
+    int m_volume;
+    int m_tradeVolume;
+    bool m_finished;
+    bool m_rejected;
+    bool isFinished() const { return m_finished; }
+    bool isRejected() const { return m_rejected; }
+    int getTradeVolume() const { return m_tradeVolume; }
+    int getDirection() const { return m_direction; }
+    int getOrderRef() const { return m_orderRef; }
+    int getVolume() const { return m_volume; }
+    double getPrice() const { return m_price; }
+    const CInstrument *getInstrument() const { return m_pInstrument; }
+};
+
+class CTrade
+{
+public:
+    const CInstrument *m_pInstrument;
+    int m_orderRef;
+    int m_direction;
+    double m_price;
+    int m_volume;
+    int getVolume() const { return m_volume; }
+    int getDirection() const { return m_direction; }
+    double getPrice() const { return m_price; }
+    int getOrderRef() const { return m_orderRef; }
+    const CInstrument *getInstrument() const { return m_pInstrument; }
+};
+
+class CMercStrategyOrderItem
+{
+public:
+    const COrder *m_pOrder;
+    mutable void *m_pUser;
+    mutable int m_userInt1;
+    mutable int m_userInt2;
+    mutable long long m_userLongLong1;
+};
+
+class CMercStrategyCommand
+{
+public:
+    int CommandID;
+    int Index[4];
+    int IntValue[4];
+    double FloatValue[4];
+};
+
+class CAccountManager
+{
+public:
+    std::string m_accountID;
+    double m_available;
+};
+
+class CCSVFile
+{
+public:
+    FILE *m_fp;
+    std::vector<std::string> m_header;
+    std::vector<std::string> m_fields;
+    bool getLine();
+    const char *getFieldByName(const char *name);
+    void destroy();
+};
+
+const char *getTimeString(char *buffer, int timeStamp, bool useMillisec=true);
+void strcpySafe(char *target, const char *source);
+int addTradingDay(int day, int count);
+int calTradingDayDiff(int from, int to);
+int calDayDiff(int from, int to);
+
+class IMercStrategy
+{
+public:
+    virtual ~IMercStrategy() {}
+    virtual bool initStrategy(void)=0;
+    virtual void strategyReady(void) {}
+    virtual void notifyMarketData(const CMarketData *pMarketData, int tag) {}
+    virtual void notifyOrder(const CMercStrategyOrderItem *pOrderItem, bool isFirstTime) {}
+    virtual void notifyTrade(const CMercStrategyOrderItem *pOrderItem, const CTrade *pTrade) {}
+    virtual void onTime(int timeStamp, int type, void *pUser) {}
+    virtual void notifyTradeSegment(int timeStamp) {}
+    virtual void notifyFreeTime(void) {}
+    virtual const char *handleCommand(const CMercStrategyCommand *pCommand) { return NULL; }
+
+    void useHistoryPosition();
+    const CXMLNode *getStrategyDesc();
+    int getTradingDay();
+    int getCurTimeStamp();
+    const volatile int *getCurTimeStampPtr();
+    const char *getStrategyName();
+    CMercStrategyStatus *createStrategyStatus(int type, int index0=0, int index1=0);
+    void refreshStrategyStatus(CMercStrategyStatus *pStatus);
+    CMercStrategyFlow *createStrategyFlow(int type, int index0=0, int index1=0);
+    void appendStrategyFlow(CMercStrategyFlow *pFlow);
+    const CProduct *getProduct(const char *productID);
+    const CTimeSectionList *getTradingSession(const CProduct *pProduct);
+    void setTimer(int timeStamp, int type, void *pUser);
+    const CMercStrategyPosition *getStrategyPosition(const CInstrument *pInstrument);
+    int getExpirationDayCount(const CInstrument *pInstrument);
+    double getMarginPerLot(const CInstrument *pInstrument);
+    double getOpenCommissionPerLot(const CInstrument *pInstrument);
+    double getCloseCommissionPerLot(const CInstrument *pInstrument);
+    double getCloseTodayCommissionPerLot(const CInstrument *pInstrument);
+    const CMercStrategyOrderItem *controledInsertOrder(CInputOrder *pInputOrder, const CInstrument *pInstrument, CAccountManager *pAccountManager, int offsetStrategy);
+    CAccountManager *getAccountManager();
+    CAccountManager *getAccountManager(const char *accountID);
+    CAccountManager *getAccountManagerByPos(int pos);
+    CLogFile *makeLogFile(const char *fileName);
+    const CInstrument *getInstrument(const char *instrumentID);
+    void getInstrumentsByProduct(const char *productID, std::vector<const CInstrument *> &instruments);
+    CCSVFile *readCSV(const char *fileName);
+    bool subscribe(const char *instrumentID, int tag);
+    void setProductPositionLimit(const char *productID, int maxLong, int maxShort);
+    double getNetAvailable(CAccountManager *pAccountManager);
+    void cancelOrder(const CMercStrategyOrderItem *pOrderItem);
+    void setAutoCancel(const CMercStrategyOrderItem *pOrderItem, bool autoCancel, int waitMillisec);
+    int getLastErrorNo();
+    int today();
+};
+
+typedef IMercStrategy *(*CreateMercStrategy)();
+
+}
+
+#define BeginMercStrategy(name) class name : public MERC::IMercStrategy
+#define EndMercStrategy(name, version) \
+    extern "C" MERC::IMercStrategy *createMercStrategy() { return new name(); } \
+    extern "C" const char *mercStrategyVersion() { return version; }
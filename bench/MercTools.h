@@ -0,0 +1,2 @@
+// Stand-in for the Merc host tools header: EZDG uses nothing from it.
+#pragma once
@@ -0,0 +1,689 @@
+#include "ReplayHost.h"
+#include <cstdarg>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <sstream>
+
+namespace MERC {
+
+CLog *g_pMercLog = NULL;
+CReplayHost *g_pReplayHost = NULL;
+
+void CLog::log(const char *format, ...)
+{
+    if (m_fp == NULL) return;
+    va_list args;
+    va_start(args, format);
+    vfprintf(m_fp, format, args);
+    va_end(args);
+    fputc('\n', m_fp);
+}
+
+void CLogFile::log(const char *format, ...)
+{
+    if (m_fp == NULL) return;
+    va_list args;
+    va_start(args, format);
+    vfprintf(m_fp, format, args);
+    va_end(args);
+    fputc('\n', m_fp);
+}
+
+static int parseTimeStamp(const char *value)
+{
+    int h = 0, m = 0, s = 0, ms = 0;
+    if (strchr(value, ':') == NULL) return atoi(value);
+    if (sscanf(value, "%d:%d:%d.%d", &h, &m, &s, &ms) < 3) return -1;
+    return ((h * 60 + m) * 60 + s) * 1000 + ms;
+}
+
+const char *CXMLNode::getProperty(const char *name, const char *defaultValue) const
+{
+    for (auto &prop: m_props)
+    {
+        if (prop.first == name) return prop.second.c_str();
+    }
+    return defaultValue;
+}
+
+int CXMLNode::getIntProperty(const char *name, int defaultValue) const
+{
+    const char *value = getProperty(name);
+    return value != NULL ? atoi(value) : defaultValue;
+}
+
+double CXMLNode::getDoubleProperty(const char *name, double defaultValue) const
+{
+    const char *value = getProperty(name);
+    return value != NULL ? atof(value) : defaultValue;
+}
+
+int CXMLNode::getTimeStampProperty(const char *name, int defaultValue) const
+{
+    const char *value = getProperty(name);
+    return value != NULL ? parseTimeStamp(value) : defaultValue;
+}
+
+const CXMLNode *CXMLNode::getSonByName(const char *name) const
+{
+    for (auto pSon: m_sons)
+    {
+        if (pSon->m_name == name) return pSon;
+    }
+    return NULL;
+}
+
+bool CTimeSectionList::isIn(int timeStamp) const
+{
+    for (auto &section: m_sections)
+    {
+        if (timeStamp >= section.first && timeStamp <= section.second) return true;
+    }
+    return false;
+}
+
+void CTimeSectionList::intersect(const CTimeSectionList *pOther) const
+{
+    if (pOther == NULL) return;
+    std::vector<std::pair<int, int> > sections;
+    for (auto &a: m_sections)
+    {
+        for (auto &b: pOther->m_sections)
+        {
+            int start = std::max(a.first, b.first);
+            int end = std::min(a.second, b.second);
+            if (start <= end) sections.push_back(std::make_pair(start, end));
+        }
+    }
+    m_sections.swap(sections);
+}
+
+const char *CTimeSectionList::show(char *buffer) const
+{
+    char start[16], end[16];
+    buffer[0] = '\0';
+    for (auto &section: m_sections)
+    {
+        sprintf(buffer + strlen(buffer), "%s[%s-%s]", buffer[0] != '\0' ? "," : "", getTimeString(start, section.first, false), getTimeString(end, section.second, false));
+    }
+    return buffer;
+}
+
+static void splitCSV(char *line, std::vector<std::string> &fields)
+{
+    fields.clear();
+    size_t len = strlen(line);
+    while (len > 0 && (line[len-1] == '\n' || line[len-1] == '\r')) line[--len] = '\0';
+    char *start = line;
+    for (char *p = line; ; p++)
+    {
+        if (*p == ',' || *p == '\0')
+        {
+            bool end = *p == '\0';
+            *p = '\0';
+            fields.push_back(start);
+            if (end) break;
+            start = p + 1;
+        }
+    }
+}
+
+bool CCSVFile::getLine()
+{
+    char line[4096];
+    if (m_fp == NULL || fgets(line, sizeof(line), m_fp) == NULL) return false;
+    splitCSV(line, m_fields);
+    return true;
+}
+
+const char *CCSVFile::getFieldByName(const char *name)
+{
+    for (size_t i = 0; i < m_header.size() && i < m_fields.size(); i++)
+    {
+        if (m_header[i] == name) return m_fields[i].c_str();
+    }
+    return NULL;
+}
+
+void CCSVFile::destroy()
+{
+    if (m_fp != NULL) fclose(m_fp);
+    delete this;
+}
+
+static CCSVFile *openCSV(const char *fileName)
+{
+    FILE *fp = fopen(fileName, "r");
+    if (fp == NULL) return NULL;
+    CCSVFile *pCSV = new CCSVFile();
+    pCSV->m_fp = fp;
+    if (!pCSV->getLine())
+    {
+        pCSV->destroy();
+        return NULL;
+    }
+    pCSV->m_header = pCSV->m_fields;
+    return pCSV;
+}
+
+const char *getTimeString(char *buffer, int timeStamp, bool useMillisec)
+{
+    int s = timeStamp / 1000;
+    if (useMillisec) sprintf(buffer, "%02d:%02d:%02d.%03d", s / 3600, s / 60 % 60, s % 60, timeStamp % 1000);
+    else sprintf(buffer, "%02d:%02d:%02d", s / 3600, s / 60 % 60, s % 60);
+    return buffer;
+}
+
+void strcpySafe(char *target, const char *source)
+{
+    strcpy(target, source != NULL ? source : "");
+}
+
+// days since 1970-01-01 of a yyyymmdd date
+static int dayNumber(int date)
+{
+    int y = date / 10000, m = date / 100 % 100, d = date % 100;
+    y -= m <= 2;
+    int era = (y >= 0 ? y : y - 399) / 400;
+    int yoe = y - era * 400;
+    int doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+static int dateOf(int z)
+{
+    z += 719468;
+    int era = (z >= 0 ? z : z - 146096) / 146097;
+    int doe = z - era * 146097;
+    int yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    int doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    int mp = (5 * doy + 2) / 153;
+    int d = doy - (153 * mp + 2) / 5 + 1;
+    int m = mp < 10 ? mp + 3 : mp - 9;
+    int y = yoe + era * 400 + (m <= 2);
+    return y * 10000 + m * 100 + d;
+}
+
+// weekdays only: the stand-in has no holiday calendar
+static bool isTradingDay(int z) { int wd = (z + 4) % 7; return wd != 0 && wd != 6; }
+
+int addTradingDay(int day, int count)
+{
+    int z = dayNumber(day);
+    int step = count >= 0 ? 1 : -1;
+    for (int n = abs(count); n > 0; )
+    {
+        z += step;
+        if (isTradingDay(z)) n--;
+    }
+    return dateOf(z);
+}
+
+int calTradingDayDiff(int from, int to)
+{
+    int a = dayNumber(from), b = dayNumber(to), count = 0;
+    for (int z = a + 1; z <= b; z++) count += isTradingDay(z);
+    for (int z = b + 1; z <= a; z++) count -= isTradingDay(z);
+    return count;
+}
+
+int calDayDiff(int from, int to)
+{
+    return dayNumber(to) - dayNumber(from);
+}
+
+void IMercStrategy::useHistoryPosition() {}
+const CXMLNode *IMercStrategy::getStrategyDesc() { return g_pReplayHost->m_pStrategyDesc; }
+int IMercStrategy::getTradingDay() { return g_pReplayHost->m_tradingDay; }
+int IMercStrategy::getCurTimeStamp() { return g_pReplayHost->m_curTimeStamp; }
+const volatile int *IMercStrategy::getCurTimeStampPtr() { return &g_pReplayHost->m_curTimeStamp; }
+const char *IMercStrategy::getStrategyName() { return getStrategyDesc()->getProperty("name", "Whatever"); }
+
+CMercStrategyStatus *IMercStrategy::createStrategyStatus(int type, int index0, int index1)
+{
+    g_pReplayHost->m_statuses.emplace_back();
+    CMercStrategyStatus *pStatus = &g_pReplayHost->m_statuses.back();
+    memset(pStatus, 0, sizeof(*pStatus));
+    pStatus->Index[0] = type; pStatus->Index[1] = index0; pStatus->Index[2] = index1;
+    return pStatus;
+}
+void IMercStrategy::refreshStrategyStatus(CMercStrategyStatus *pStatus) {}
+
+CMercStrategyFlow *IMercStrategy::createStrategyFlow(int type, int index0, int index1)
+{
+    g_pReplayHost->m_flows.emplace_back();
+    CMercStrategyFlow *pFlow = &g_pReplayHost->m_flows.back();
+    memset(pFlow, 0, sizeof(*pFlow));
+    pFlow->Index[0] = type; pFlow->Index[1] = index0; pFlow->Index[2] = index1;
+    return pFlow;
+}
+void IMercStrategy::appendStrategyFlow(CMercStrategyFlow *pFlow) {}
+
+const CProduct *IMercStrategy::getProduct(const char *productID)
+{
+    auto it = g_pReplayHost->m_productByID.find(productID);
+    return it != g_pReplayHost->m_productByID.end() ? &g_pReplayHost->m_products[it->second] : NULL;
+}
+
+const CTimeSectionList *IMercStrategy::getTradingSession(const CProduct *pProduct)
+{
+    if (pProduct == NULL) return NULL;
+    // callers may intersect the list in place: hand out a copy
+    g_pReplayHost->m_sessionCopies.push_back(pProduct->m_sessions);
+    return &g_pReplayHost->m_sessionCopies.back();
+}
+
+void IMercStrategy::setTimer(int timeStamp, int type, void *pUser)
+{
+    CReplayHost::CTimer timer = { timeStamp, g_pReplayHost->m_timerSeq++, type, pUser };
+    g_pReplayHost->m_timers.push(timer);
+}
+
+const CMercStrategyPosition *IMercStrategy::getStrategyPosition(const CInstrument *pInstrument)
+{
+    return &g_pReplayHost->m_positions[pInstrument->getInstrumentRef()];
+}
+
+int IMercStrategy::getExpirationDayCount(const CInstrument *pInstrument)
+{
+    return calDayDiff(g_pReplayHost->m_tradingDay, pInstrument->getExpireDate());
+}
+
+double IMercStrategy::getMarginPerLot(const CInstrument *pInstrument)
+{
+    return pInstrument->getPreSettlementPrice() * pInstrument->getMultiple() * 0.1;
+}
+
+double IMercStrategy::getOpenCommissionPerLot(const CInstrument *pInstrument) { return 0.0; }
+double IMercStrategy::getCloseCommissionPerLot(const CInstrument *pInstrument) { return 0.0; }
+double IMercStrategy::getCloseTodayCommissionPerLot(const CInstrument *pInstrument) { return 0.0; }
+
+const CMercStrategyOrderItem *IMercStrategy::controledInsertOrder(CInputOrder *pInputOrder, const CInstrument *pInstrument, CAccountManager *pAccountManager, int offsetStrategy)
+{
+    return g_pReplayHost->insertOrder(pInputOrder, pInstrument);
+}
+
+CAccountManager *IMercStrategy::getAccountManager() { return &g_pReplayHost->m_account; }
+CAccountManager *IMercStrategy::getAccountManager(const char *accountID) { return &g_pReplayHost->m_account; }
+CAccountManager *IMercStrategy::getAccountManagerByPos(int pos) { return pos == 0 ? &g_pReplayHost->m_account : NULL; }
+
+CLogFile *IMercStrategy::makeLogFile(const char *fileName)
+{
+    g_pReplayHost->m_logFiles.emplace_back(fopen(fileName, "a"));
+    return &g_pReplayHost->m_logFiles.back();
+}
+
+const CInstrument *IMercStrategy::getInstrument(const char *instrumentID)
+{
+    auto it = g_pReplayHost->m_instrumentByID.find(instrumentID);
+    return it != g_pReplayHost->m_instrumentByID.end() ? &g_pReplayHost->m_instruments[it->second] : NULL;
+}
+
+void IMercStrategy::getInstrumentsByProduct(const char *productID, std::vector<const CInstrument *> &instruments)
+{
+    for (auto &instrument: g_pReplayHost->m_instruments)
+    {
+        if (strcmp(instrument.getProductID(), productID) == 0) instruments.push_back(&instrument);
+    }
+}
+
+CCSVFile *IMercStrategy::readCSV(const char *fileName) { return openCSV(fileName); }
+
+bool IMercStrategy::subscribe(const char *instrumentID, int tag)
+{
+    const CInstrument *pInstrument = getInstrument(instrumentID);
+    if (pInstrument == NULL || pInstrument->getInstrumentRef() != tag) return false;
+    g_pReplayHost->m_subscribed[tag] = 1;
+    return true;
+}
+
+void IMercStrategy::setProductPositionLimit(const char *productID, int maxLong, int maxShort) {}
+double IMercStrategy::getNetAvailable(CAccountManager *pAccountManager) { return pAccountManager != NULL ? pAccountManager->m_available : 0.0; }
+void IMercStrategy::cancelOrder(const CMercStrategyOrderItem *pOrderItem) { g_pReplayHost->cancelOrder(pOrderItem); }
+void IMercStrategy::setAutoCancel(const CMercStrategyOrderItem *pOrderItem, bool autoCancel, int waitMillisec) {}
+int IMercStrategy::getLastErrorNo() { return 0; }
+int IMercStrategy::today() { return g_pReplayHost->m_tradingDay; }
+
+CReplayHost::CReplayHost()
+{
+    m_pRoot = NULL;
+    m_pStrategyDesc = NULL;
+    m_timerSeq = 0;
+    m_account.m_accountID = "replay";
+    m_account.m_available = 1e12;
+    m_curTimeStamp = 0;
+    m_tradingDay = 0;
+    m_pStrategy = NULL;
+}
+
+CReplayHost::~CReplayHost()
+{
+    for (auto &logFile: m_logFiles)
+    {
+        if (logFile.m_fp != NULL) fclose(logFile.m_fp);
+    }
+    delete m_pRoot;
+}
+
+// Tolerant reader for the strategy configs: elements, quoted attributes, comments anywhere in a tag
+// (the examples annotate attributes inline). Text content is skipped.
+class CXMLReader
+{
+public:
+    const std::string &m_text;
+    size_t m_pos;
+    CXMLReader(const std::string &text): m_text(text), m_pos(0) {}
+    bool skipComment()
+    {
+        if (m_text.compare(m_pos, 4, "<!--") != 0) return false;
+        size_t end = m_text.find("-->", m_pos + 4);
+        m_pos = end == std::string::npos ? m_text.size() : end + 3;
+        return true;
+    }
+    void skipSpace()
+    {
+        while (m_pos < m_text.size())
+        {
+            if (isspace((unsigned char)m_text[m_pos])) m_pos++;
+            else if (!skipComment()) break;
+        }
+    }
+    std::string name()
+    {
+        size_t start = m_pos;
+        while (m_pos < m_text.size() && (isalnum((unsigned char)m_text[m_pos]) || strchr("_-.:", m_text[m_pos]) != NULL)) m_pos++;
+        return m_text.substr(start, m_pos - start);
+    }
+    // parses the element at '<', NULL on a syntax error
+    CXMLNode *element()
+    {
+        CXMLNode *pNode = new CXMLNode();
+        m_pos++;
+        pNode->m_name = name();
+        while (true)
+        {
+            skipSpace();
+            if (m_pos >= m_text.size()) { delete pNode; return NULL; }
+            if (m_text.compare(m_pos, 2, "/>") == 0) { m_pos += 2; return pNode; }
+            if (m_text[m_pos] == '>') { m_pos++; break; }
+            std::string key = name();
+            skipSpace();
+            if (key.empty() || m_pos >= m_text.size() || m_text[m_pos] != '=') { delete pNode; return NULL; }
+            m_pos++;
+            skipSpace();
+            char quote = m_pos < m_text.size() ? m_text[m_pos] : '\0';
+            if (quote != '"' && quote != '\'') { delete pNode; return NULL; }
+            size_t end = m_text.find(quote, m_pos + 1);
+            if (end == std::string::npos) { delete pNode; return NULL; }
+            pNode->m_props.push_back(std::make_pair(key, m_text.substr(m_pos + 1, end - m_pos - 1)));
+            m_pos = end + 1;
+        }
+        while (true)
+        {
+            size_t lt = m_text.find('<', m_pos);
+            if (lt == std::string::npos) { delete pNode; return NULL; }
+            m_pos = lt;
+            if (skipComment()) continue;
+            if (m_text.compare(m_pos, 2, "</") == 0)
+            {
+                size_t gt = m_text.find('>', m_pos);
+                m_pos = gt == std::string::npos ? m_text.size() : gt + 1;
+                return pNode;
+            }
+            CXMLNode *pSon = element();
+            if (pSon == NULL) { delete pNode; return NULL; }
+            pNode->m_sons.push_back(pSon);
+        }
+    }
+    CXMLNode *document()
+    {
+        while (true)
+        {
+            skipSpace();
+            if (m_text.compare(m_pos, 2, "<?") == 0)
+            {
+                size_t end = m_text.find("?>", m_pos);
+                m_pos = end == std::string::npos ? m_text.size() : end + 2;
+                continue;
+            }
+            break;
+        }
+        return m_pos < m_text.size() && m_text[m_pos] == '<' ? element() : NULL;
+    }
+};
+
+static const CXMLNode *findStrategy(const CXMLNode *pNode, const char *strategyName)
+{
+    if (pNode->m_name == "Strategy")
+    {
+        const char *name = pNode->getProperty("name", "");
+        if (strategyName == NULL || strcmp(name, strategyName) == 0) return pNode;
+    }
+    for (auto pSon: pNode->m_sons)
+    {
+        const CXMLNode *pFound = findStrategy(pSon, strategyName);
+        if (pFound != NULL) return pFound;
+    }
+    return NULL;
+}
+
+bool CReplayHost::loadStrategy(const char *xmlFn, const char *strategyName)
+{
+    std::ifstream in(xmlFn);
+    if (!in) { fprintf(stderr, "cannot open %s\n", xmlFn); return false; }
+    std::stringstream text;
+    text << in.rdbuf();
+    std::string content = text.str();
+    CXMLReader reader(content);
+    m_pRoot = reader.document();
+    if (m_pRoot == NULL) { fprintf(stderr, "cannot parse %s near offset %zu\n", xmlFn, reader.m_pos); return false; }
+    m_pStrategyDesc = findStrategy(m_pRoot, strategyName);
+    if (m_pStrategyDesc == NULL) { fprintf(stderr, "no strategy %s in %s\n", strategyName != NULL ? strategyName : "", xmlFn); return false; }
+    // every product trades the configured sessions, the whole day when none are given
+    const CXMLNode *pSessions = m_pStrategyDesc->getSonByName("TradeSessions");
+    for (int i = 0; pSessions != NULL && i < pSessions->getSonCount(); i++)
+    {
+        const CXMLNode *pSession = pSessions->getSon(i);
+        m_sessions.m_sections.push_back(std::make_pair(pSession->getTimeStampProperty("start", 0), pSession->getTimeStampProperty("end", 0)));
+    }
+    if (m_sessions.m_sections.empty()) m_sessions.m_sections.push_back(std::make_pair(0, 24 * 3600 * 1000 - 1));
+    return true;
+}
+
+static double fieldDouble(CCSVFile *pCSV, const char *name, double defaultValue)
+{
+    const char *value = pCSV->getFieldByName(name);
+    return value != NULL && value[0] != '\0' ? atof(value) : defaultValue;
+}
+
+bool CReplayHost::loadInstruments(const char *csvFn)
+{
+    CCSVFile *pCSV = openCSV(csvFn);
+    if (pCSV == NULL) { fprintf(stderr, "cannot open %s\n", csvFn); return false; }
+    while (pCSV->getLine())
+    {
+        const char *instrumentID = pCSV->getFieldByName("InstrumentID");
+        const char *productID = pCSV->getFieldByName("ProductID");
+        if (instrumentID == NULL || productID == NULL || instrumentID[0] == '\0') continue;
+        if (m_instrumentByID.count(instrumentID) > 0) continue;
+        auto it = m_productByID.find(productID);
+        if (it == m_productByID.end())
+        {
+            CProduct product;
+            const char *exchangeID = pCSV->getFieldByName("ExchangeID");
+            product.m_productID = productID;
+            product.m_exchangeID = exchangeID != NULL ? exchangeID : "";
+            product.m_productRef = int(m_products.size());
+            product.m_sessions = m_sessions;
+            m_products.push_back(product);
+            it = m_productByID.insert(std::make_pair(std::string(productID), product.m_productRef)).first;
+        }
+        CInstrument instrument;
+        instrument.m_instrumentID = instrumentID;
+        instrument.m_pProduct = &m_products[it->second];
+        instrument.m_instrumentRef = int(m_instruments.size());
+        instrument.m_tick = fieldDouble(pCSV, "PriceTick", 1.0);
+        instrument.m_multiple = fieldDouble(pCSV, "VolumeMultiple", 1.0);
+        instrument.m_preSettlementPrice = fieldDouble(pCSV, "PreSettlePrice", 0.0);
+        instrument.m_preClosePrice = fieldDouble(pCSV, "PreClosePrice", instrument.m_preSettlementPrice);
+        instrument.m_preOpenInterest = int(fieldDouble(pCSV, "PreOpenInterest", 0.0));
+        instrument.m_upperLimitPrice = fieldDouble(pCSV, "UpperLimitPrice", instrument.m_preSettlementPrice * 1.1);
+        instrument.m_lowerLimitPrice = fieldDouble(pCSV, "LowerLimitPrice", instrument.m_preSettlementPrice * 0.9);
+        instrument.m_expireDate = int(fieldDouble(pCSV, "ExpireDate", 0.0));
+        m_instrumentByID[instrument.m_instrumentID] = instrument.m_instrumentRef;
+        m_instruments.push_back(instrument);
+    }
+    pCSV->destroy();
+    int n = int(m_instruments.size());
+    m_marketData.assign(n, CMarketData());
+    for (int i = 0; i < n; i++)
+    {
+        memset(&m_marketData[i], 0, sizeof(CMarketData));
+        m_marketData[i].m_pInstrument = &m_instruments[i];
+    }
+    m_positions.assign(n, CMercStrategyPosition());
+    for (auto &position: m_positions) { position.m_position = 0; position.m_workingOrders = 0; }
+    m_subscribed.assign(n, 0);
+    return n > 0;
+}
+
+bool CReplayHost::loadTicks(const char *csvFn, std::vector<CTick> &ticks)
+{
+    CCSVFile *pCSV = openCSV(csvFn);
+    if (pCSV == NULL) { fprintf(stderr, "cannot open %s\n", csvFn); return false; }
+    const char *names[] = { "TradingDay", "UpdateTime", "UpdateMillisec", "InstrumentID", "LastPrice", "Volume", "BidPrice1", "BidVolume1", "AskPrice1", "AskVolume1" };
+    int cols[10];
+    for (int k = 0; k < 10; k++)
+    {
+        cols[k] = -1;
+        for (size_t i = 0; i < pCSV->m_header.size(); i++)
+        {
+            if (pCSV->m_header[i] == names[k]) cols[k] = int(i);
+        }
+        if (cols[k] < 0) { fprintf(stderr, "%s: no column %s\n", csvFn, names[k]); pCSV->destroy(); return false; }
+    }
+    int unknown = 0;
+    while (pCSV->getLine())
+    {
+        std::vector<std::string> &f = pCSV->m_fields;
+        if (f.size() < pCSV->m_header.size()) continue;
+        auto it = m_instrumentByID.find(f[cols[3]]);
+        if (it == m_instrumentByID.end()) { unknown++; continue; }
+        if (m_tradingDay == 0) m_tradingDay = atoi(f[cols[0]].c_str());
+        CTick tick;
+        tick.m_instRef = it->second;
+        tick.m_timeStamp = parseTimeStamp(f[cols[1]].c_str()) + atoi(f[cols[2]].c_str());
+        tick.m_lastPrice = atof(f[cols[4]].c_str());
+        tick.m_volume = atoi(f[cols[5]].c_str());
+        tick.m_bidPrice = atof(f[cols[6]].c_str());
+        tick.m_bidVolume = atoi(f[cols[7]].c_str());
+        tick.m_askPrice = atof(f[cols[8]].c_str());
+        tick.m_askVolume = atoi(f[cols[9]].c_str());
+        ticks.push_back(tick);
+    }
+    pCSV->destroy();
+    if (unknown > 0) fprintf(stderr, "%s: %d ticks of unknown instruments skipped\n", csvFn, unknown);
+    if (m_tradingDay == 0)
+    {
+        time_t now = time(NULL);
+        struct tm local;
+        localtime_r(&now, &local);
+        m_tradingDay = (local.tm_year + 1900) * 10000 + (local.tm_mon + 1) * 100 + local.tm_mday;
+    }
+    return true;
+}
+
+void CReplayHost::fireTimers(int timeStamp)
+{
+    while (!m_timers.empty() && m_timers.top().m_timeStamp <= timeStamp)
+    {
+        CTimer timer = m_timers.top();
+        m_timers.pop();
+        if (timer.m_timeStamp > m_curTimeStamp) m_curTimeStamp = timer.m_timeStamp;
+        m_pStrategy->onTime(timer.m_timeStamp, timer.m_type, timer.m_pUser);
+        dispatchOrders();
+    }
+}
+
+void CReplayHost::dispatchOrders()
+{
+    std::vector<std::pair<const CMercStrategyOrderItem *, bool> > pending;
+    while (!m_pendingNotify.empty())
+    {
+        pending.swap(m_pendingNotify);
+        for (auto &notify: pending)
+        {
+            COrder *pOrder = const_cast<COrder *>(notify.first->m_pOrder);
+            // no matching: a FAK order ends unfilled with its acknowledgement
+            if (pOrder->m_orderType == ODT_FAK && !pOrder->m_finished) finishOrder(pOrder);
+            m_pStrategy->notifyOrder(notify.first, notify.second);
+        }
+        pending.clear();
+    }
+}
+
+int CReplayHost::segment(int timeStamp) const
+{
+    for (size_t i = 0; i < m_sessions.m_sections.size(); i++)
+    {
+        if (timeStamp >= m_sessions.m_sections[i].first && timeStamp <= m_sessions.m_sections[i].second) return int(i);
+    }
+    return -1;
+}
+
+const CMarketData *CReplayHost::applyTick(const CTick &tick)
+{
+    CMarketData &md = m_marketData[tick.m_instRef];
+    md.m_updateTimeStamp = tick.m_timeStamp;
+    md.m_lastPrice = tick.m_lastPrice;
+    md.m_volume = tick.m_volume;
+    md.m_bidPrice = tick.m_bidPrice;
+    md.m_bidVolume = tick.m_bidVolume;
+    md.m_askPrice = tick.m_askPrice;
+    md.m_askVolume = tick.m_askVolume;
+    return &md;
+}
+
+const CMercStrategyOrderItem *CReplayHost::insertOrder(CInputOrder *pInputOrder, const CInstrument *pInstrument)
+{
+    if (pInputOrder->m_volume <= 0) return NULL;
+    COrder order;
+    order.m_pInstrument = pInstrument;
+    order.m_orderRef = int(m_orders.size()) + 1;
+    order.m_orderType = pInputOrder->m_orderType;
+    order.m_direction = pInputOrder->m_direction;
+    order.m_price = pInputOrder->m_price;
+    order.m_volume = pInputOrder->m_volume;
+    order.m_tradeVolume = 0;
+    order.m_finished = order.m_rejected = false;
+    m_orders.push_back(order);
+    CMercStrategyOrderItem item;
+    item.m_pOrder = &m_orders.back();
+    item.m_pUser = NULL;
+    item.m_userInt1 = item.m_userInt2 = 0;
+    item.m_userLongLong1 = 0;
+    m_orderItems.push_back(item);
+    m_positions[pInstrument->getInstrumentRef()].m_workingOrders++;
+    pInputOrder->m_orderRef = order.m_orderRef;
+    m_pendingNotify.push_back(std::make_pair(&m_orderItems.back(), true));
+    return &m_orderItems.back();
+}
+
+void CReplayHost::finishOrder(COrder *pOrder)
+{
+    if (pOrder->m_finished) return;
+    pOrder->m_finished = true;
+    m_positions[pOrder->m_pInstrument->getInstrumentRef()].m_workingOrders--;
+}
+
+void CReplayHost::cancelOrder(const CMercStrategyOrderItem *pOrderItem)
+{
+    COrder *pOrder = const_cast<COrder *>(pOrderItem->m_pOrder);
+    if (pOrder->m_finished) return;
+    finishOrder(pOrder);
+    m_pendingNotify.push_back(std::make_pair(pOrderItem, false));
+}
+
+}
@@ -0,0 +1,83 @@
+// Single-process stand-in for the Merc host: loads a strategy XML, an instrument table and a tick file,
+// and drives one strategy through its callbacks. Orders are acknowledged and cancelled but never filled;
+// configure SimExchange="1" for fills.
+#pragma once
+#include "MercSystem.h"
+#include <deque>
+#include <functional>
+#include <queue>
+
+namespace MERC {
+
+class CReplayHost
+{
+public:
+    struct CTick
+    {
+        int m_instRef;
+        int m_timeStamp;
+        double m_lastPrice;
+        int m_volume;
+        double m_bidPrice;
+        int m_bidVolume;
+        double m_askPrice;
+        int m_askVolume;
+    };
+    struct CTimer
+    {
+        int m_timeStamp;
+        long long m_seq;
+        int m_type;
+        void *m_pUser;
+        bool operator>(const CTimer &o) const { return m_timeStamp != o.m_timeStamp ? m_timeStamp > o.m_timeStamp : m_seq > o.m_seq; }
+    };
+
+    CXMLNode *m_pRoot;
+    const CXMLNode *m_pStrategyDesc;
+    CTimeSectionList m_sessions;
+    std::deque<CProduct> m_products;
+    std::map<std::string, int> m_productByID;
+    std::deque<CInstrument> m_instruments;
+    std::map<std::string, int> m_instrumentByID;
+    std::vector<CMarketData> m_marketData;
+    std::vector<CMercStrategyPosition> m_positions;
+    std::vector<char> m_subscribed;
+    std::deque<CTimeSectionList> m_sessionCopies;
+    std::deque<CMercStrategyStatus> m_statuses;
+    std::deque<CMercStrategyFlow> m_flows;
+    std::deque<CLogFile> m_logFiles;
+    std::deque<COrder> m_orders;
+    std::deque<CMercStrategyOrderItem> m_orderItems;
+    std::vector<std::pair<const CMercStrategyOrderItem *, bool> > m_pendingNotify;
+    std::priority_queue<CTimer, std::vector<CTimer>, std::greater<CTimer> > m_timers;
+    long long m_timerSeq;
+    CAccountManager m_account;
+    volatile int m_curTimeStamp;
+    int m_tradingDay;
+    IMercStrategy *m_pStrategy;
+
+    CReplayHost();
+    ~CReplayHost();
+    // the first <Strategy> element, or the one named strategyName
+    bool loadStrategy(const char *xmlFn, const char *strategyName);
+    // InstrumentID,ProductID,ExchangeID,PriceTick,VolumeMultiple,PreSettlePrice,PreClosePrice,PreOpenInterest,
+    // UpperLimitPrice,LowerLimitPrice,ExpireDate
+    bool loadInstruments(const char *csvFn);
+    // TradingDay,UpdateTime,UpdateMillisec,InstrumentID,LastPrice,Volume,BidPrice1,BidVolume1,AskPrice1,AskVolume1
+    bool loadTicks(const char *csvFn, std::vector<CTick> &ticks);
+    // runs every timer due at or before timeStamp, in time order
+    void fireTimers(int timeStamp);
+    // delivers the order reports queued by sends and cancels, including those queued while delivering
+    void dispatchOrders();
+    // index of the session holding timeStamp, -1 between sessions
+    int segment(int timeStamp) const;
+    const CMarketData *applyTick(const CTick &tick);
+    bool isSubscribed(int instRef) const { return unsigned(instRef) < m_subscribed.size() && m_subscribed[instRef]; }
+    const CMercStrategyOrderItem *insertOrder(CInputOrder *pInputOrder, const CInstrument *pInstrument);
+    void cancelOrder(const CMercStrategyOrderItem *pOrderItem);
+    void finishOrder(COrder *pOrder);
+};
+
+extern CReplayHost *g_pReplayHost;
+
+}
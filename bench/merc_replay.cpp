@@ -0,0 +1,120 @@
+// Replays a tick file through one strategy on the stand-in host and reports the latency of every
+// notifyMarketData call, timed from outside the strategy:
+//
+//     merc_replay -s mercStrategy_scale.xml -i instruments.csv -m ticks.csv [-l strategy.log] [-n name]
+//
+// prints  [replay],<strategy>,ticks,N,p50,..,p99,..,p999,..,max,..,mean,..,busyTps,..,wallTps,..
+// with latencies in nanoseconds. The file formats are those written by scale_bench.py gen.
+#include "ReplayHost.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <unistd.h>
+
+using namespace MERC;
+
+extern "C" IMercStrategy *createMercStrategy();
+
+static long long nowNanos()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static long long percentile(const std::vector<long long> &sorted, double q)
+{
+    if (sorted.empty()) return 0;
+    size_t k = size_t(q * sorted.size());
+    return sorted[std::min(k, sorted.size() - 1)];
+}
+
+static int usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s -s strategy.xml -i instruments.csv -m ticks.csv [-l strategy.log] [-n strategyName]\n", prog);
+    return 2;
+}
+
+int main(int argc, char **argv)
+{
+    const char *xmlFn = NULL, *instrumentFn = NULL, *tickFn = NULL, *logFn = NULL, *strategyName = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv, "s:i:m:l:n:")) != -1)
+    {
+        switch (opt)
+        {
+        case 's': xmlFn = optarg; break;
+        case 'i': instrumentFn = optarg; break;
+        case 'm': tickFn = optarg; break;
+        case 'l': logFn = optarg; break;
+        case 'n': strategyName = optarg; break;
+        default: return usage(argv[0]);
+        }
+    }
+    if (xmlFn == NULL || instrumentFn == NULL || tickFn == NULL) return usage(argv[0]);
+
+    CReplayHost host;
+    g_pReplayHost = &host;
+    std::vector<CReplayHost::CTick> ticks;
+    if (!host.loadStrategy(xmlFn, strategyName) || !host.loadInstruments(instrumentFn) || !host.loadTicks(tickFn, ticks)) return 1;
+
+    FILE *logFp = logFn != NULL ? fopen(logFn, "w") : stdout;
+    if (logFp == NULL) { fprintf(stderr, "cannot open %s\n", logFn); return 1; }
+    CLog log(logFp);
+    g_pMercLog = &log;
+
+    IMercStrategy *pStrategy = createMercStrategy();
+    host.m_pStrategy = pStrategy;
+    if (!pStrategy->initStrategy()) { fprintf(stderr, "initStrategy failed\n"); return 1; }
+    pStrategy->strategyReady();
+    host.dispatchOrders();
+
+    std::vector<long long> latency;
+    latency.reserve(ticks.size());
+    long long busyNs = 0;
+    int lastTS = -1, lastSegment = -2;
+    long long wall0 = nowNanos();
+    for (auto &tick: ticks)
+    {
+        if (!host.isSubscribed(tick.m_instRef)) continue;
+        if (tick.m_timeStamp != lastTS)
+        {
+            // the host idles between snapshot bursts
+            if (lastTS >= 0) { pStrategy->notifyFreeTime(); host.dispatchOrders(); }
+            host.fireTimers(tick.m_timeStamp);
+            host.m_curTimeStamp = tick.m_timeStamp;
+            int segment = host.segment(tick.m_timeStamp);
+            if (segment != lastSegment)
+            {
+                if (lastSegment != -2) { pStrategy->notifyTradeSegment(tick.m_timeStamp); host.dispatchOrders(); }
+                lastSegment = segment;
+            }
+            lastTS = tick.m_timeStamp;
+        }
+        const CMarketData *pMarketData = host.applyTick(tick);
+        long long t0 = nowNanos();
+        pStrategy->notifyMarketData(pMarketData, tick.m_instRef);
+        long long t1 = nowNanos();
+        latency.push_back(t1 - t0);
+        busyNs += t1 - t0;
+        host.dispatchOrders();
+    }
+    long long wallNs = nowNanos() - wall0;
+    pStrategy->notifyFreeTime();
+    host.dispatchOrders();
+    // day end timers run after the last tick; the periodic timer re-arms until midnight
+    host.fireTimers(24 * 3600 * 1000 - 1);
+
+    std::vector<long long> sorted(latency);
+    std::sort(sorted.begin(), sorted.end());
+    double mean = sorted.empty() ? 0.0 : double(busyNs) / sorted.size();
+    char line[512];
+    snprintf(line, sizeof(line), "[replay],%s,ticks,%zu,p50,%lld,p99,%lld,p999,%lld,max,%lld,mean,%.1f,busyTps,%.0f,wallTps,%.0f,orders,%zu",
+        pStrategy->getStrategyName(), sorted.size(), percentile(sorted, 0.5), percentile(sorted, 0.99), percentile(sorted, 0.999),
+        sorted.empty() ? 0LL : sorted.back(), mean, busyNs > 0 ? sorted.size() * 1e9 / busyNs : 0.0,
+        wallNs > 0 ? sorted.size() * 1e9 / wallNs : 0.0, host.m_orders.size());
+    log.log("%s", line);
+    if (logFp != stdout) printf("%s\n", line);
+    fflush(logFp);
+    if (logFp != stdout) fclose(logFp);
+    g_pMercLog = NULL;
+    return 0;
+}
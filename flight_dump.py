@@ -0,0 +1,72 @@
+"""Decode an EZDG flight recorder file (RecordEvents=1) into CSV.
+
+    python flight_dump.py env173_DynGrid_TTL.20251209.ezfr [--type md,order,trade,timer,cmd,send,cancel,ready]
+
+Layout (little endian): a 64-byte header then fixed 64-byte events, see
+CFlightRecorder in AioEZDG.cpp. A file may hold several sessions appended
+back to back, each starting with its own header. orderType -9 marks orders
+this strategy instance did not send.
+"""
+import argparse
+import csv
+import struct
+import sys
+
+HEADER = struct.Struct('<4siiiq40s')
+EVENT = struct.Struct('<BBHiq6i3d')
+
+TYPES = {1: 'md', 2: 'order', 3: 'trade', 4: 'timer', 5: 'cmd', 6: 'send', 7: 'cancel', 8: 'ready'}
+FIELDS = {
+    'md': (['tag', 'updateTS', 'bidVolume', 'askVolume', 'volume', ''], ['lastPrice', 'bidPrice', 'askPrice']),
+    'order': (['orderRef', 'orderType', 'hostOrderRef', 'tradeVolume', 'direction', ''], ['', '', '']),
+    'trade': (['orderRef', 'orderType', 'instRef', 'direction', 'volume', 'orderTradeVolume'], ['price', '', '']),
+    'timer': (['timeStamp', 'timerType', 'workerID', '', '', ''], ['', '', '']),
+    'cmd': (['commandID', 'index0', 'intValue0', '', '', ''], ['floatValue0', '', '']),
+    'send': (['orderRef', 'instRef', 'orderType', 'direction', 'volume', 'reason'], ['price', '', '']),
+    'cancel': (['orderRef', 'orderType', '', '', '', ''], ['', '', '']),
+    'ready': (['futures', 'spreads', 'tradable', '', '', ''], ['randSeed', '', '']),
+}
+FLAGS = {1: 'first', 2: 'finished', 4: 'rejected'}
+
+
+def read_events(path):
+    with open(path, 'rb') as f:
+        data = f.read()
+    pos, session = 0, None
+    while pos + EVENT.size <= len(data):
+        if data[pos:pos + 4] == b'EZFR':
+            magic, version, event_size, trading_day, start_ns, name = HEADER.unpack_from(data, pos)
+            if event_size != EVENT.size:
+                sys.exit('unsupported event size %d' % event_size)
+            session = (trading_day, name.rstrip(b'\0').decode(errors='replace'), start_ns)
+            pos += HEADER.size
+            continue
+        if session is None:
+            sys.exit('missing header at offset %d' % pos)
+        yield session, EVENT.unpack_from(data, pos)
+        pos += EVENT.size
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument('path')
+    ap.add_argument('--type', default='', help='comma separated event types to keep')
+    args = ap.parse_args()
+    keep = set(args.type.split(',')) if args.type else set(TYPES.values())
+    w = csv.writer(sys.stdout)
+    w.writerow(['tradingDay', 'strategy', 'relNs', 'curTS', 'type', 'flags', 'fields'])
+    for (day, name, start_ns), ev in read_events(args.path):
+        etype, flag, _, cur_ts, ns = ev[:5]
+        ints, dbls = ev[5:11], ev[11:14]
+        tname = TYPES.get(etype, str(etype))
+        if tname not in keep:
+            continue
+        inames, dnames = FIELDS.get(tname, ([''] * 6, [''] * 3))
+        kv = ['%s=%d' % (k, v) for k, v in zip(inames, ints) if k]
+        kv += ['%s=%.10g' % (k, v) for k, v in zip(dnames, dbls) if k]
+        flags = '|'.join(v for b, v in FLAGS.items() if flag & b)
+        w.writerow([day, name, ns - start_ns, cur_ts, tname, flags, ' '.join(kv)])
+
+
+if __name__ == '__main__':
+    main()
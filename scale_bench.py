@@ -0,0 +1,277 @@
+"""Synthetic scale benchmark for the EZDG strategy.
+
+gen: write a strategy XML with M ManSprds over N synthetic instruments, the
+     instrument definitions and a correlated tick stream (factor model:
+     market + product + contract noise) for the host backtest replay.
+run: generate a series of scale points, replay each through the host with
+     BenchLatency=1 and collect [benchStartup]/[benchLatency] log lines into
+     a scaling table (startup time, memory, per-tick latency vs spread count).
+
+The host replay command is site specific and passed as a template, e.g.
+    python scale_bench.py run --spreads 10,100,1000,3000 --instruments 400 \
+        --runner 'merc_bt -s {xml} -i {instruments} -m {ticks} -l {log}'
+or, on the stand-in host built from CMakeLists.txt,
+        --runner 'build/merc_replay -s {xml} -i {instruments} -m {ticks} -l {log}'
+"""
+import argparse
+import csv
+import math
+import os
+import random
+import re
+import subprocess
+import sys
+import time
+
+MONTHS = ['2603', '2606', '2609', '2612']
+EXCHANGE = 'SIM'
+SESSIONS = [('09:30:05', '11:29:50'), ('13:00:05', '15:14:50')]
+
+SPRD_ATTRS = ('TrdTp="0" TrdRt="0" RefMid="{ref:g}" SprdMaxLot="0" SprdStpLot="1" '
+              'EdgeInPrLong="0.05" EdgeInPrShrt="0.05" MdstInPrLong="0.15" MdstInPrShrt="0.15" '
+              'ClsEdgeInPrLong="0.8" ClsEdgeInPrShrt="0.8" ArbCfgDttm="20510101-21:30:00"')
+
+STRATEGY_ATTRS = ('type="EZDG" accountID="{account}" Prod="{prod}" ShmNmPrefix="{shm}" TradeSize="1" EnableTrade="1" '
+                  'IsBacktest="1" BenchLatency="1" BenchKernels="0" SlipTics="1" MaxTradeSize="10000" FrontTradeSize="100" '
+                  'MinAvailable="100000" MinOI="2" AnnualRollMonth="0" FuzzySort="1" EdgeInPct="0.0005" EdgeInStd="0" '
+                  'AdjPosStep="5" MinGroups="1" MaxGroups="1" MaxSteps="0" MinSteps="3" MACount="2" PeriodSecond="900" '
+                  'TryOrderWaitTime="100" ForceOrderWaitTime="100" DayTrade="09:29:30" OnlyClose="15:14:30" '
+                  'DaySettle="15:14:55" NtEnd="23:00:01" DayEnd="15:15:01" CancelRate="0.0" LogTrdFlw="0" MrgnRt="0.1" '
+                  'GridExitInterval="0.5" MinEntryInterval="0.1" ArbitrageN="120" RiskN="180" UpdateIntervalMinutes="15"')
+
+
+def product_name(i):
+    # letters only: spread names are parsed as <coef><product><month>
+    return chr(ord('A') + i // 26) + chr(ord('A') + i % 26)
+
+
+class Universe:
+    def __init__(self, n_inst, seed):
+        self.rng = random.Random(seed)
+        n_prod = int(math.ceil(n_inst / len(MONTHS)))
+        self.products = [product_name(i) for i in range(n_prod)]
+        self.insts = []
+        for p in self.products:
+            for m in MONTHS:
+                if len(self.insts) < n_inst:
+                    self.insts.append((p + m, p))
+        self.prod_idx = {p: i for i, p in enumerate(self.products)}
+        self.base = [self.rng.uniform(50.0, 5000.0) for _ in range(n_prod)]
+        self.tick = [0.2 if b < 500 else (1.0 if b < 2000 else 5.0) for b in self.base]
+        self.beta = [self.rng.uniform(0.3, 1.2) for _ in range(n_prod)]
+        self.carry = [self.rng.gauss(0.0, 0.004) for _ in range(n_prod)]
+        self.inst_prod = [self.prod_idx[p] for _, p in self.insts]
+        self.inst_month = [MONTHS.index(inst[len(p):]) for inst, p in self.insts]
+
+    def inst_price(self, prod_px):
+        return [prod_px[pi] * (1.0 + self.carry[pi] * mi) for pi, mi in zip(self.inst_prod, self.inst_month)]
+
+
+def make_spreads(uni, n_sprd):
+    rng = uni.rng
+    names, seen = [], set()
+    by_prod = {}
+    for inst, p in uni.insts:
+        by_prod.setdefault(p, []).append(inst)
+    prods = [p for p in uni.products if p in by_prod]
+    tries = 0
+    while len(names) < n_sprd and tries < n_sprd * 50:
+        tries += 1
+        kind = rng.random()
+        if kind < 0.4:
+            # calendar spread inside one product
+            legs = by_prod[rng.choice(prods)]
+            if len(legs) < 2:
+                continue
+            a, b = sorted(rng.sample(range(len(legs)), 2))
+            name = '1%s-1%s' % (legs[a], legs[b])
+        elif kind < 0.85:
+            # cross-product pair with ratio coefs
+            if len(prods) < 2:
+                continue
+            pa, pb = rng.sample(prods, 2)
+            name = '%d%s-%d%s' % (rng.randint(1, 3), rng.choice(by_prod[pa]), rng.randint(1, 3), rng.choice(by_prod[pb]))
+        else:
+            # butterfly, 3 legs
+            legs = by_prod[rng.choice(prods)]
+            if len(legs) < 3:
+                continue
+            a, b, c = sorted(rng.sample(range(len(legs)), 3))
+            name = '1%s-2%s-1%s' % (legs[a], legs[b], legs[c])
+        if name not in seen:
+            seen.add(name)
+            names.append(name)
+    return names
+
+
+def spread_ref_mid(uni, name, px0):
+    inst_px = dict(zip([i for i, _ in uni.insts], px0))
+    legs = name.split('-')
+    signs = {2: [1, -1], 3: [1, -1, 1]}[len(legs)]
+    mid = 0.0
+    for sgn, leg in zip(signs, legs):
+        m = re.match(r'(\d+)([A-Za-z]+\d+)', leg)
+        mid += sgn * float(m.group(1)) * inst_px[m.group(2)]
+    return round(mid, 4)
+
+
+def write_xml(path, uni, spreads, px0, shm):
+    used = sorted({re.match(r'\d+([A-Za-z]+)', leg).group(1) for s in spreads for leg in s.split('-')})
+    with open(path, 'w') as f:
+        f.write('<Strategies>\n')
+        f.write('    <Strategy name="scale_%d" %s>\n' % (len(spreads), STRATEGY_ATTRS.format(account='90180012', prod='-'.join(used), shm=shm)))
+        f.write('        <TradeSessions>\n')
+        for s, e in SESSIONS:
+            f.write('            <Session start="%s" end="%s"/>\n' % (s, e))
+        f.write('        </TradeSessions>\n')
+        f.write('        <ManSprds>\n')
+        for name in spreads:
+            f.write('            <Sprd name="%s" exeName="%s" %s />\n' % (name, name, SPRD_ATTRS.format(ref=spread_ref_mid(uni, name, px0))))
+        f.write('        </ManSprds>\n')
+        f.write('    </Strategy>\n')
+        f.write('</Strategies>\n')
+
+
+def write_instruments(path, uni, px0):
+    with open(path, 'w', newline='') as f:
+        w = csv.writer(f)
+        w.writerow(['InstrumentID', 'ProductID', 'ExchangeID', 'PriceTick', 'VolumeMultiple', 'PreSettlePrice',
+                    'PreClosePrice', 'PreOpenInterest', 'UpperLimitPrice', 'LowerLimitPrice', 'ExpireDate'])
+        for k, (inst, p) in enumerate(uni.insts):
+            tick = uni.tick[uni.prod_idx[p]]
+            pre = round(px0[k] / tick) * tick
+            w.writerow([inst, p, EXCHANGE, tick, 10, '%.4f' % pre, '%.4f' % pre, 10000, '%.4f' % (round(pre * 1.1 / tick) * tick),
+                        '%.4f' % (round(pre * 0.9 / tick) * tick), '20' + inst[len(p):] + '15'])
+
+
+def write_ticks(path, uni, trading_day, seconds, snap_ms, update_prob, vol):
+    rng = uni.rng
+    n_prod = len(uni.products)
+    tick = [uni.tick[pi] for pi in uni.inst_prod]
+    log_px = [math.log(b) for b in uni.base]
+    steps = int(seconds * 1000 / snap_ms)
+    step_vol = vol * math.sqrt(snap_ms / 1000.0 / 14400.0)
+    cum_vol = [0] * len(uni.insts)
+    start_ms = 9 * 3600 * 1000 + 30 * 60 * 1000 + 5000
+    rows = 0
+    with open(path, 'w') as f:
+        f.write('TradingDay,UpdateTime,UpdateMillisec,InstrumentID,LastPrice,Volume,BidPrice1,BidVolume1,AskPrice1,AskVolume1\n')
+        for s in range(steps):
+            mkt = rng.gauss(0.0, step_vol)
+            for i in range(n_prod):
+                log_px[i] += uni.beta[i] * mkt + rng.gauss(0.0, step_vol * 0.5)
+            px = uni.inst_price([math.exp(x) for x in log_px])
+            ms = start_ms + s * snap_ms
+            hms = '%02d:%02d:%02d' % (ms // 3600000, ms // 60000 % 60, ms // 1000 % 60)
+            lines = []
+            for k, (inst, _) in enumerate(uni.insts):
+                if rng.random() >= update_prob:
+                    continue
+                p = px[k] * (1.0 + rng.gauss(0.0, step_vol * 0.1))
+                bid = math.floor(p / tick[k]) * tick[k]
+                ask = bid + tick[k]
+                cum_vol[k] += rng.randint(0, 19)
+                lines.append('%d,%s,%d,%s,%.4f,%d,%.4f,%d,%.4f,%d\n' % (trading_day, hms, ms % 1000, inst, bid if rng.random() < 0.5 else ask,
+                                                                       cum_vol[k], bid, rng.randint(1, 199), ask, rng.randint(1, 199)))
+            f.write(''.join(lines))
+            rows += len(lines)
+    return rows
+
+
+def generate(out_dir, n_inst, n_sprd, seed, trading_day, seconds, snap_ms, update_prob, vol):
+    os.makedirs(out_dir, exist_ok=True)
+    uni = Universe(n_inst, seed)
+    px0 = uni.inst_price(uni.base)
+    spreads = make_spreads(uni, n_sprd)
+    if len(spreads) < n_sprd:
+        print('only %d distinct spreads fit %d instruments' % (len(spreads), n_inst), file=sys.stderr)
+    files = {
+        'xml': os.path.join(out_dir, 'mercStrategy_scale.xml'),
+        'instruments': os.path.join(out_dir, 'instruments.csv'),
+        'ticks': os.path.join(out_dir, 'ticks.csv'),
+        'log': os.path.join(out_dir, 'strategy.log'),
+    }
+    write_xml(files['xml'], uni, spreads, px0, os.path.join(os.path.abspath(out_dir), 'scale_'))
+    write_instruments(files['instruments'], uni, px0)
+    rows = write_ticks(files['ticks'], uni, trading_day, seconds, snap_ms, update_prob, vol)
+    print('%s: instruments %d, spreads %d, ticks %d' % (out_dir, len(uni.insts), len(spreads), rows))
+    return files
+
+
+def parse_fields(line, tag):
+    parts = line.strip().split(tag, 1)[1].strip(',').split(',')
+    return dict(zip(parts[1::2], parts[2::2])) if len(parts) > 2 else {}
+
+
+def parse_log(path):
+    res = {}
+    with open(path, errors='replace') as f:
+        for line in f:
+            if '[benchStartup]' in line:
+                kv = parse_fields(line, '[benchStartup]')
+                for k in ('instruments', 'spreads', 'tradable', 'startSubscribe', 'createSpreads', 'updateInstTriggerMap', 'totalMs', 'rssKB'):
+                    res['startup_' + k if k not in ('instruments', 'spreads', 'tradable') else k] = kv.get(k)
+            elif '[benchLatency]' in line and ',ticks,' in line:
+                # last stage line wins (EOD covers the whole replay)
+                m = re.search(r'ticks,(\d+),p50,(\d+),p99,(\d+),p999,(\d+),max,(\d+),mean,([\d.e+-]+),busyTps,([\d.e+-]+),wallTps,([\d.e+-]+)(?:,rssKB,(\d+))?', line)
+                if m:
+                    for k, v in zip(('ticks', 'p50', 'p99', 'p999', 'max', 'mean', 'busyTps', 'wallTps', 'rssKB'), m.groups()):
+                        res['tick_' + k] = v
+    return res
+
+
+def run(args):
+    points = [int(x) for x in args.spreads.split(',')]
+    rows = []
+    for n_sprd in points:
+        out_dir = os.path.join(args.out, 'S%d' % n_sprd)
+        files = generate(out_dir, args.instruments, n_sprd, args.seed, args.trading_day, args.seconds, args.snap_ms, args.update_prob, args.vol)
+        if not args.runner:
+            continue
+        cmd = args.runner.format(**files)
+        t0 = time.time()
+        rc = subprocess.call(cmd, shell=True)
+        wall = time.time() - t0
+        row = {'target_spreads': n_sprd, 'rc': rc, 'wall_s': round(wall, 3)}
+        if os.path.exists(files['log']):
+            row.update(parse_log(files['log']))
+        rows.append(row)
+        print(row)
+    if rows:
+        keys = []
+        for r in rows:
+            keys += [k for k in r if k not in keys]
+        with open(os.path.join(args.out, 'scale_results.csv'), 'w', newline='') as f:
+            w = csv.DictWriter(f, fieldnames=keys)
+            w.writeheader()
+            w.writerows(rows)
+        print('wrote', os.path.join(args.out, 'scale_results.csv'))
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = ap.add_subparsers(dest='cmd', required=True)
+    for name in ('gen', 'run'):
+        p = sub.add_parser(name)
+        p.add_argument('--out', default='scale_out')
+        p.add_argument('--instruments', type=int, default=400)
+        p.add_argument('--seed', type=int, default=20251209)
+        p.add_argument('--trading-day', type=int, default=20251209)
+        p.add_argument('--seconds', type=int, default=1800, help='replayed session seconds')
+        p.add_argument('--snap-ms', type=int, default=500, help='snapshot interval')
+        p.add_argument('--update-prob', type=float, default=0.6, help='chance an instrument updates per snapshot')
+        p.add_argument('--vol', type=float, default=0.01, help='daily log-price volatility of the market factor')
+        if name == 'gen':
+            p.add_argument('--spreads', type=int, default=1000)
+        else:
+            p.add_argument('--spreads', default='10,100,1000,3000', help='comma separated scale points')
+            p.add_argument('--runner', default='', help='host replay command, placeholders {xml} {instruments} {ticks} {log}')
+    args = ap.parse_args()
+    if args.cmd == 'gen':
+        generate(args.out, args.instruments, args.spreads, args.seed, args.trading_day, args.seconds, args.snap_ms, args.update_prob, args.vol)
+    else:
+        run(args)
+
+
+if __name__ == '__main__':
+    main()